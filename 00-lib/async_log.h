@@ -0,0 +1,298 @@
+#ifndef _ASYNC_LOG_H
+#define _ASYNC_LOG_H 1
+
+/**
+ * 异步日志：热路径上只往本线程的 SPSC 环形队列里写一条定长的二进制记录，
+ * 格式化和 write 都交给后台线程批量完成。
+ * - 每个线程一个环（单生产者：本线程；单消费者：后台线程），入队只有几次内存写和一次 release store，
+ *   不加锁、不分配内存、不做系统调用；环满时直接丢弃并计数，绝不阻塞业务线程；
+ * - 记录里只保存格式串的指针（必须是字符串字面量）和最多 LOG_MAX_ARGS 个 long 型参数，
+ *   所以格式串里的整数一律用 %ld / %lu / %lx；需要带上一段报文内容时用 LOG_xxx_STR，
+ *   内容会被截断拷贝到记录里，并在格式化结果后面原样追加；
+ * - 低于编译期阈值 LOG_LEVEL 的日志宏直接展开为空，连参数都不会求值：
+ *     gcc -DLOG_LEVEL=LOG_LEVEL_DEBUG ...
+ *
+ * 用法：
+ *   log_init(STDOUT_FILENO);     // 启动后台线程
+ *   log_thread_init();           // 每个线程开始时调用一次，提前分配好本线程的环
+ *   LOG_INFO("push fd %ld", fd);
+ *   log_thread_exit();           // 线程退出前调用，环留给以后新建的线程复用
+ *   log_shutdown();              // 退出前把剩余日志刷出去
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_MAX_ARGS 4
+#define LOG_STR_SIZE 72
+#define LOG_RING_SIZE 4096 // 每个线程的环能容纳的记录数，必须是 2 的幂
+#define LOG_MAX_THREADS 128
+#define LOG_BATCH_SIZE (64 * 1024)
+
+// 一条记录正好两个 cache line
+typedef struct
+{
+    uint64_t ts_ns;
+    const char *fmt;
+    long args[LOG_MAX_ARGS];
+    uint16_t level;
+    uint16_t str_len;
+    char str[LOG_STR_SIZE];
+} log_record;
+
+typedef struct
+{
+    uint64_t tail __attribute__((aligned(64))); // 生产者写
+    uint64_t dropped;                           // 生产者写，环满时丢弃的条数
+    uint64_t head __attribute__((aligned(64))); // 消费者写
+    int id;
+    int released; // 线程已经退出，剩下的记录被取走后可以分给新线程
+    log_record records[LOG_RING_SIZE] __attribute__((aligned(64)));
+} log_ring;
+
+static log_ring *log_rings[LOG_MAX_THREADS];
+static int log_ring_count;
+static pthread_mutex_t log_rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread log_ring *log_tls_ring;
+
+static pthread_t log_thread;
+static int log_out_fd = STDOUT_FILENO;
+static volatile int log_running;
+
+static const char *log_level_names[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+// 给当前线程分配并注册一个环，只在线程启动时调用，不在热路径上
+log_ring *log_thread_init(void)
+{
+    if (log_tls_ring != NULL)
+        return log_tls_ring;
+
+    // 线程池会不断创建和退出线程，先复用已经退出、记录也都输出了的线程留下的环
+    pthread_mutex_lock(&log_rings_lock);
+    for (int i = 0; i < log_ring_count; i++)
+    {
+        log_ring *old = log_rings[i];
+        if (__atomic_load_n(&old->released, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&old->head, __ATOMIC_ACQUIRE) == old->tail)
+        {
+            old->released = 0;
+            pthread_mutex_unlock(&log_rings_lock);
+            log_tls_ring = old;
+            return old;
+        }
+    }
+    pthread_mutex_unlock(&log_rings_lock);
+
+    log_ring *ring = aligned_alloc(64, sizeof(log_ring));
+    if (ring == NULL)
+        return NULL;
+    memset(ring, 0, sizeof(log_ring));
+
+    pthread_mutex_lock(&log_rings_lock);
+    if (log_ring_count < LOG_MAX_THREADS)
+    {
+        ring->id = log_ring_count;
+        log_rings[log_ring_count] = ring;
+        // 消费者读 log_ring_count 时要能看到完整的 ring 指针
+        __atomic_store_n(&log_ring_count, log_ring_count + 1, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        free(ring);
+        ring = NULL;
+    }
+    pthread_mutex_unlock(&log_rings_lock);
+
+    log_tls_ring = ring;
+    return ring;
+}
+
+void log_record_write(int level, const char *fmt, const long *args, const char *str, int str_len)
+{
+    log_ring *ring = log_tls_ring;
+    if (ring == NULL && (ring = log_thread_init()) == NULL)
+        return;
+
+    uint64_t tail = ring->tail;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (tail - head >= LOG_RING_SIZE)
+    {
+        // 后台线程跟不上时宁可丢日志，也不能让业务线程等
+        ring->dropped++;
+        return;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    log_record *rec = &ring->records[tail & (LOG_RING_SIZE - 1)];
+    rec->ts_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    rec->fmt = fmt;
+    rec->level = level;
+    memcpy(rec->args, args, sizeof(rec->args));
+    if (str_len > LOG_STR_SIZE)
+        str_len = LOG_STR_SIZE;
+    if (str_len > 0)
+        memcpy(rec->str, str, str_len);
+    rec->str_len = str_len > 0 ? str_len : 0;
+
+    // 记录内容写完之后再发布 tail
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// 把一条记录格式化成一行文本，返回长度
+int log_format(char *out, int cap, int thread_id, const log_record *rec)
+{
+    time_t sec = rec->ts_ns / 1000000000ull;
+    struct tm tm;
+    localtime_r(&sec, &tm);
+
+    int len = snprintf(out, cap, "%02d:%02d:%02d.%06lu %-5s [T%d] ",
+                       tm.tm_hour, tm.tm_min, tm.tm_sec,
+                       (unsigned long)(rec->ts_ns % 1000000000ull / 1000),
+                       log_level_names[rec->level], thread_id);
+    if (len >= cap)
+        return cap - 1;
+    len += snprintf(out + len, cap - len, rec->fmt,
+                    rec->args[0], rec->args[1], rec->args[2], rec->args[3]);
+    if (len >= cap)
+        return cap - 1;
+    if (rec->str_len > 0 && len + rec->str_len < cap)
+    {
+        memcpy(out + len, rec->str, rec->str_len);
+        len += rec->str_len;
+    }
+    if (len > 0 && out[len - 1] != '\n' && len < cap - 1)
+        out[len++] = '\n';
+    return len;
+}
+
+// 把所有环里现有的记录取出来，攒成大块再 write，返回本轮处理的记录数
+int log_drain(char *batch)
+{
+    int count = __atomic_load_n(&log_ring_count, __ATOMIC_ACQUIRE);
+    int len = 0, total = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        log_ring *ring = log_rings[i];
+        uint64_t head = ring->head;
+        uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; head++)
+        {
+            if (LOG_BATCH_SIZE - len < 512)
+            {
+                write(log_out_fd, batch, len);
+                len = 0;
+            }
+            len += log_format(batch + len, LOG_BATCH_SIZE - len, ring->id,
+                              &ring->records[head & (LOG_RING_SIZE - 1)]);
+            total++;
+        }
+        // 格式化完成后才把槽位还给生产者
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+    }
+
+    if (len > 0)
+        write(log_out_fd, batch, len);
+    return total;
+}
+
+void *log_thread_run(void *arg)
+{
+    (void)arg;
+    char *batch = malloc(LOG_BATCH_SIZE);
+
+    while (log_running)
+    {
+        // 空闲时睡 1ms，日志多的时候一直批量处理
+        if (log_drain(batch) == 0)
+            usleep(1000);
+    }
+    log_drain(batch);
+
+    free(batch);
+    return NULL;
+}
+
+// 线程退出前调用，之后这个线程不能再写日志
+void log_thread_exit(void)
+{
+    if (log_tls_ring == NULL)
+        return;
+    __atomic_store_n(&log_tls_ring->released, 1, __ATOMIC_RELEASE);
+    log_tls_ring = NULL;
+}
+
+int log_init(int fd)
+{
+    log_out_fd = fd;
+    log_running = 1;
+    return pthread_create(&log_thread, NULL, log_thread_run, NULL);
+}
+
+void log_shutdown(void)
+{
+    log_running = 0;
+    pthread_join(log_thread, NULL);
+}
+
+// 所有线程累计丢弃的日志条数
+uint64_t log_dropped(void)
+{
+    uint64_t n = 0;
+    int count = __atomic_load_n(&log_ring_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++)
+        n += __atomic_load_n(&log_rings[i]->dropped, __ATOMIC_RELAXED);
+    return n;
+}
+
+// 把可变参数转换成定长的 long 数组，未给出的参数为 0
+#define LOG_ARGS(...) ((const long[LOG_MAX_ARGS]){__VA_ARGS__})
+#define LOG_NOOP() ((void)0)
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(fmt, ...) log_record_write(LOG_LEVEL_DEBUG, fmt, LOG_ARGS(__VA_ARGS__), NULL, 0)
+#define LOG_DEBUG_STR(fmt, str, len, ...) log_record_write(LOG_LEVEL_DEBUG, fmt, LOG_ARGS(__VA_ARGS__), str, len)
+#else
+#define LOG_DEBUG(fmt, ...) LOG_NOOP()
+#define LOG_DEBUG_STR(fmt, str, len, ...) LOG_NOOP()
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(fmt, ...) log_record_write(LOG_LEVEL_INFO, fmt, LOG_ARGS(__VA_ARGS__), NULL, 0)
+#define LOG_INFO_STR(fmt, str, len, ...) log_record_write(LOG_LEVEL_INFO, fmt, LOG_ARGS(__VA_ARGS__), str, len)
+#else
+#define LOG_INFO(fmt, ...) LOG_NOOP()
+#define LOG_INFO_STR(fmt, str, len, ...) LOG_NOOP()
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(fmt, ...) log_record_write(LOG_LEVEL_WARN, fmt, LOG_ARGS(__VA_ARGS__), NULL, 0)
+#else
+#define LOG_WARN(fmt, ...) LOG_NOOP()
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(fmt, ...) log_record_write(LOG_LEVEL_ERROR, fmt, LOG_ARGS(__VA_ARGS__), NULL, 0)
+#else
+#define LOG_ERROR(fmt, ...) LOG_NOOP()
+#endif
+
+#endif /* async_log.h */
@@ -0,0 +1,227 @@
+#ifndef _CONN_POOL_H
+#define _CONN_POOL_H 1
+
+/**
+ * 客户端连接池：对一个服务端（endpoint）维护一组长连接，请求之间复用，不用每次都握手。
+ *
+ * 每个请求新建一个连接的代价：一次三次握手的往返，加上主动关闭的一方留下一个 TIME_WAIT 套接字（见 22-time-wait），
+ * 请求频繁时 TIME_WAIT 会堆到几万个，把临时端口耗尽。连接池的做法：
+ * - 有上限（max）：同时在用的加上空闲的连接数不超过 max，用完了 pool_get 就等别人归还；
+ * - 预热（prewarm）：pool_init 时先建好几个连接，第一批请求不用等握手；
+ * - 健康检查：从池子里取出空闲连接时，用 poll + MSG_PEEK 看一眼，
+ *   一个空闲连接上本不该有任何数据，可读就说明对端已经关闭（读到 EOF）、出错，或者协议已经乱了，直接丢掉换下一个；
+ * - 空闲回收：空闲超过 idle_timeout 的连接在下次 pool_get / pool_put 时关闭，免得服务端那边已经超时断开，
+ *   也不必一直占着服务端的资源。空闲连接按后进先出使用，最近用过的最 “热”，最久没用的留在底部等着被回收；
+ * - 请求出错（读写失败、协议不对）时调用方用 pool_put(pool, fd, 0) 归还，连接会被关闭而不是放回池子。
+ *
+ *   conn_pool pool;
+ *   pool_init(&pool, "127.0.0.1", 9190, 8, 2, 30000);
+ *   int fd = pool_get(&pool);
+ *   ... write / read 一个完整的请求和回复 ...
+ *   pool_put(&pool, fd, ok);
+ *
+ * pool_get / pool_put 内部加锁，可以在多个线程里共用一个池子。host 写成 "unix" 时走 UNIX 域套接字（见 unix_sock.h），
+ * 否则 host 可以是逗号分隔的多个副本地址，新建连接时用 race_connect 并行尝试（见 race_connect.h）。
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include "unix_sock.h"
+#include "race_connect.h"
+
+typedef struct
+{
+    int fd;
+    uint64_t idle_since_ns; // 放回池子的时间
+} pool_entry;
+
+typedef struct
+{
+    char host[256];
+    int port;
+    int max;                  // 连接总数上限（在用 + 空闲）
+    uint64_t idle_timeout_ns; // 空闲超过这个时间就关闭，0 表示不回收
+    pool_entry *idle;         // 空闲连接，idle[0] 最久没用，末尾是最近归还的
+    int nidle;
+    int total;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    // 统计
+    uint64_t connects;  // 新建的连接数
+    uint64_t reuses;    // 直接复用空闲连接的次数
+    uint64_t evictions; // 因为空闲太久被关闭的连接数
+    uint64_t broken;    // 健康检查不通过或调用方报告出错而关闭的连接数
+} conn_pool;
+
+uint64_t pool_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int pool_connect(conn_pool *pool)
+{
+    int fd = strcmp(pool->host, "unix") == 0 ? stream_connect(pool->host, pool->port)
+                                               : race_connect(pool->host, pool->port, 0, 0, NULL, 0);
+    if (fd == -1)
+        return -1;
+    // 请求-应答式的小消息不能让 Nagle 攒着（UNIX 域套接字会设置失败，不影响）
+    int option = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+    return fd;
+}
+
+/**
+ * 空闲连接是否还能用：不应该有任何可读的东西。
+ * 可读时 recv(MSG_PEEK) 返回 0 是对端关闭，返回 > 0 是多出来的数据（上一个请求的回复没读完之类），都不能再用。
+ */
+int pool_healthy(int fd)
+{
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, 0) == 0)
+        return 1;
+    char c;
+    ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+// 关闭空闲太久的连接，调用时必须持有锁。空闲连接按归还时间排列，从最老的开始看
+void pool_evict_locked(conn_pool *pool, uint64_t now)
+{
+    if (pool->idle_timeout_ns == 0)
+        return;
+    int expired = 0;
+    while (expired < pool->nidle && now - pool->idle[expired].idle_since_ns > pool->idle_timeout_ns)
+        close(pool->idle[expired++].fd);
+    if (expired == 0)
+        return;
+    memmove(pool->idle, pool->idle + expired, sizeof(pool_entry) * (pool->nidle - expired));
+    pool->nidle -= expired;
+    pool->total -= expired;
+    pool->evictions += expired;
+    pthread_cond_broadcast(&pool->cond);
+}
+
+/**
+ * 初始化连接池并预热 prewarm 个连接，idle_timeout_ms 为 0 时不回收空闲连接。
+ * 预热失败（服务端还没起来）不算错误，之后的 pool_get 会再去连接；参数不对返回 -1。
+ */
+int pool_init(conn_pool *pool, const char *host, int port, int max, int prewarm, int idle_timeout_ms)
+{
+    if (max <= 0 || prewarm > max || strlen(host) >= sizeof(pool->host))
+        return -1;
+    memset(pool, 0, sizeof(*pool));
+    strcpy(pool->host, host);
+    pool->port = port;
+    pool->max = max;
+    pool->idle_timeout_ns = (uint64_t)idle_timeout_ms * 1000000;
+    pool->idle = malloc(sizeof(pool_entry) * max);
+    if (pool->idle == NULL)
+        return -1;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    uint64_t now = pool_now_ns();
+    for (int i = 0; i < prewarm; i++)
+    {
+        int fd = pool_connect(pool);
+        if (fd == -1)
+            break;
+        pool->idle[pool->nidle].fd = fd;
+        pool->idle[pool->nidle++].idle_since_ns = now;
+        pool->total++;
+        pool->connects++;
+    }
+    return 0;
+}
+
+/**
+ * 取一个可用的连接：优先复用最近归还的空闲连接，没有空闲的且没到上限就新建，到了上限就等别人归还。
+ * 新建连接失败返回 -1。
+ */
+int pool_get(conn_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (1)
+    {
+        pool_evict_locked(pool, pool_now_ns());
+        while (pool->nidle > 0)
+        {
+            int fd = pool->idle[--pool->nidle].fd;
+            // 检查只是一次非阻塞的 poll，放在锁里做省得再处理并发
+            if (pool_healthy(fd))
+            {
+                pool->reuses++;
+                pthread_mutex_unlock(&pool->lock);
+                return fd;
+            }
+            close(fd);
+            pool->total--;
+            pool->broken++;
+        }
+        if (pool->total < pool->max)
+            break;
+        pthread_cond_wait(&pool->cond, &pool->lock);
+    }
+    // 先占住名额再解锁去连接，握手期间别的线程可以继续用池子
+    pool->total++;
+    pthread_mutex_unlock(&pool->lock);
+
+    int fd = pool_connect(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    if (fd == -1)
+    {
+        pool->total--;
+        pthread_cond_signal(&pool->cond);
+    }
+    else
+        pool->connects++;
+    pthread_mutex_unlock(&pool->lock);
+    return fd;
+}
+
+// 归还连接，ok 为 0 表示这个连接上出过错，直接关闭
+void pool_put(conn_pool *pool, int fd, int ok)
+{
+    uint64_t now = pool_now_ns();
+    pthread_mutex_lock(&pool->lock);
+    if (ok)
+    {
+        pool->idle[pool->nidle].fd = fd;
+        pool->idle[pool->nidle++].idle_since_ns = now;
+    }
+    else
+    {
+        close(fd);
+        pool->total--;
+        pool->broken++;
+    }
+    pool_evict_locked(pool, now);
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// 关闭所有空闲连接，调用前要保证在用的连接都已经归还
+void pool_destroy(conn_pool *pool)
+{
+    for (int i = 0; i < pool->nidle; i++)
+        close(pool->idle[i].fd);
+    pool->total -= pool->nidle;
+    pool->nidle = 0;
+    free(pool->idle);
+    pool->idle = NULL;
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->cond);
+}
+
+#endif /* conn_pool.h */
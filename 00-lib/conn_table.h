@@ -0,0 +1,209 @@
+#ifndef _CONN_TABLE_H
+#define _CONN_TABLE_H 1
+
+/**
+ * 以 fd 为下标的扁平连接表。
+ *
+ * 服务端只拿到 fd（epoll 的 data.fd、pollfd.fd），要找到这个连接的状态，
+ * 常见做法是哈希表或者每个连接单独 malloc，前者要多一次查找，后者让连接状态散落在堆的各处。
+ * 内核分配 fd 总是取最小的可用号，fd 本身就是稠密的，直接拿它当数组下标就行：
+ * - 热数据（每个事件都要访问的：状态、缓冲区指针、定时器）压缩在一个 cache line 里，conn_hot[fd]；
+ * - 冷数据（对端地址、累计统计等很少访问的）放在另一个数组 conn_cold[fd]，不会挤占热数据的 cache；
+ * - 两个数组都按最大 fd 一次性 mmap（MAP_NORESERVE，天然按页对齐），没被用到的页不占物理内存；
+ *   容器里 RLIMIT_NOFILE 常常是 2^30，照它分配就是上百 GB 的地址空间，超过内核 overcommit 的估算会直接失败，
+ *   所以最多只分配 CONN_TABLE_MAX 项，更大的 fd 由 conn_open 拒绝；
+ * - 处理一批就绪事件时，提前 prefetch 后面几个事件对应的表项，把 cache miss 和当前事件的处理重叠起来。
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#define CONN_PREFETCH_DISTANCE 4
+#define CONN_TABLE_MAX (1 << 20)
+// 输出缓冲的水位：待发送超过 HIGH 时停止读这个连接，降到 LOW 以下再恢复，MAX 是硬上限
+#define CONN_OUT_LOW (64 * 1024)
+#define CONN_OUT_HIGH (256 * 1024)
+#define CONN_OUT_MAX (4 * 1024 * 1024)
+
+enum conn_state
+{
+    CONN_FREE = 0,
+    CONN_OPEN,
+    CONN_CLOSING, // 对端已关闭或出错，等待输出缓冲写完后关闭
+};
+
+typedef struct
+{
+    int32_t fd;
+    uint8_t state;
+    uint8_t flags;
+    uint16_t events;       // 当前在多路复用器里关注的事件
+    uint32_t gen;          // 每次 open 加一，用来识别 fd 号被复用
+    uint32_t out_len;      // out_buf 中待发送的字节数
+    uint32_t out_off;      // out_buf 中已发送的位置
+    uint32_t out_cap;
+    char *out_buf;         // 写不完的数据暂存在这里，按需分配
+    uint64_t last_active_ns;
+    uint64_t deadline_ns;  // 定时器，0 表示没有
+    uint64_t user;         // 留给上层使用
+} __attribute__((aligned(64))) conn_hot;
+
+typedef struct
+{
+    struct sockaddr_storage peer;
+    socklen_t peer_len;
+    uint64_t accepted_ns;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t requests;
+} conn_cold;
+
+typedef struct
+{
+    conn_hot *hot;
+    conn_cold *cold;
+    int capacity; // 可容纳的最大 fd + 1
+    int count;    // 当前打开的连接数
+    uint32_t next_gen;
+} conn_table;
+
+_Static_assert(sizeof(conn_hot) == 64, "conn_hot must fit in one cache line");
+
+// 连接定时器用的时钟，COARSE 时钟精度是一个 tick（几毫秒），但读取只要几纳秒
+uint64_t conn_clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// capacity <= 0 时按 RLIMIT_NOFILE 分配，最多 CONN_TABLE_MAX 项
+int conn_table_init(conn_table *ct, int capacity)
+{
+    if (capacity <= 0)
+    {
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_NOFILE, &rl) == -1 || rl.rlim_cur >= CONN_TABLE_MAX)
+            capacity = CONN_TABLE_MAX;
+        else
+            capacity = rl.rlim_cur;
+    }
+
+    // 匿名映射的内容本来就是 0，不能再 memset，否则所有页都会被立即分配
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    ct->hot = mmap(NULL, sizeof(conn_hot) * capacity, PROT_READ | PROT_WRITE, flags, -1, 0);
+    ct->cold = mmap(NULL, sizeof(conn_cold) * capacity, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (ct->hot == MAP_FAILED || ct->cold == MAP_FAILED)
+    {
+        if (ct->hot != MAP_FAILED)
+            munmap(ct->hot, sizeof(conn_hot) * capacity);
+        if (ct->cold != MAP_FAILED)
+            munmap(ct->cold, sizeof(conn_cold) * capacity);
+        return -1;
+    }
+    ct->capacity = capacity;
+    ct->count = 0;
+    ct->next_gen = 0;
+    return 0;
+}
+
+conn_hot *conn_get(conn_table *ct, int fd)
+{
+    if (fd < 0 || fd >= ct->capacity || ct->hot[fd].state == CONN_FREE)
+        return NULL;
+    return &ct->hot[fd];
+}
+
+conn_cold *conn_get_cold(conn_table *ct, int fd)
+{
+    return &ct->cold[fd];
+}
+
+// 注册一个新连接，fd 超出表的容量时返回 NULL
+conn_hot *conn_open(conn_table *ct, int fd)
+{
+    if (fd < 0 || fd >= ct->capacity)
+        return NULL;
+
+    conn_hot *c = &ct->hot[fd];
+    memset(c, 0, sizeof(*c));
+    c->fd = fd;
+    c->state = CONN_OPEN;
+    c->gen = ++ct->next_gen;
+    memset(&ct->cold[fd], 0, sizeof(conn_cold));
+    ct->count++;
+    return c;
+}
+
+void conn_close(conn_table *ct, int fd)
+{
+    conn_hot *c = conn_get(ct, fd);
+    if (c == NULL)
+        return;
+    free(c->out_buf);
+    c->out_buf = NULL;
+    c->state = CONN_FREE;
+    ct->count--;
+}
+
+// 预取 fd 对应的热数据，写意图（第二个参数为 1），保留在各级 cache（第三个参数为 3）
+void conn_prefetch(conn_table *ct, int fd)
+{
+    if (fd >= 0 && fd < ct->capacity)
+        __builtin_prefetch(&ct->hot[fd], 1, 3);
+}
+
+/**
+ * 把未发送完的数据追加到连接的输出缓冲里，超过 CONN_OUT_MAX 时返回 -1。
+ * 对端只发不收时缓冲会一直涨，调用方应当在超过 CONN_OUT_HIGH 时停止读（见 conn_want_read）。
+ */
+int conn_buffer_output(conn_hot *c, const char *data, uint32_t len)
+{
+    // 已发送的部分先挪走，避免缓冲区无限增长
+    if (c->out_off > 0)
+    {
+        memmove(c->out_buf, c->out_buf + c->out_off, c->out_len - c->out_off);
+        c->out_len -= c->out_off;
+        c->out_off = 0;
+    }
+    size_t need = (size_t)c->out_len + len;
+    if (need > CONN_OUT_MAX)
+        return -1;
+    if (need > c->out_cap)
+    {
+        size_t cap = c->out_cap ? c->out_cap : 4096;
+        while (cap < need)
+            cap *= 2; // need 不超过 CONN_OUT_MAX，不会溢出
+        char *buf = realloc(c->out_buf, cap);
+        if (buf == NULL)
+            return -1;
+        c->out_buf = buf;
+        c->out_cap = cap;
+    }
+    memcpy(c->out_buf + c->out_len, data, len);
+    c->out_len += len;
+    return 0;
+}
+
+uint32_t conn_pending_output(const conn_hot *c)
+{
+    return c->out_len - c->out_off;
+}
+
+/**
+ * 按输出缓冲的水位决定还要不要读这个连接：正在读时积压超过 CONN_OUT_HIGH 停下，
+ * 已经停下时要等积压降到 CONN_OUT_LOW 以下才恢复，避免在水位线附近来回 mod。
+ * reading 是当前是否在关注可读事件。
+ */
+int conn_want_read(const conn_hot *c, int reading)
+{
+    uint32_t pending = conn_pending_output(c);
+    return reading ? pending <= CONN_OUT_HIGH : pending <= CONN_OUT_LOW;
+}
+
+#endif /* conn_table.h */
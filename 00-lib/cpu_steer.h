@@ -0,0 +1,153 @@
+#ifndef _CPU_STEER_H
+#define _CPU_STEER_H 1
+
+/**
+ * 让处理连接的线程和内核处理这个连接收包的 CPU 是同一个。
+ *
+ * 网卡收到的包在中断（以及后面的软中断 NET_RX）所在的 CPU 上走完协议栈，套接字、sk_buff 这些数据此时都在这个核的 cache 里；
+ * 如果读这个连接的线程跑在另一个核上，每个包都要把这些 cache line 从一个核搬到另一个核，
+ * 唤醒还要发一次核间中断（IPI）。线程随意漂移时大部分连接都是这种情况。做法分两步：
+ * 1. 绑核：线程固定在一组 CPU 上，最好就是网卡队列中断所在的 CPU（cpu_steer_parse 的 "irq:<网卡名>"，
+ *    从 /proc/interrupts 找到网卡的中断号，再读 /proc/irq/N/effective_affinity_list）；
+ * 2. 分流：新连接交给绑在它收包 CPU 上的线程。
+ *    - 连接上的 SO_INCOMING_CPU（getsockopt）是最近一次处理它收包的 CPU，accept 之后读出来就知道该给谁；
+ *    - 每个线程一个 SO_REUSEPORT 监听套接字时，可以在监听套接字上 setsockopt(SO_INCOMING_CPU, cpu)，
+ *      内核挑选监听套接字时优先选 CPU 匹配的那个；
+ *    - 更确定的办法是给 reuseport 组挂一个经典 BPF 程序（SO_ATTACH_REUSEPORT_CBPF），
+ *      程序读出当前 CPU 号（SKF_AD_CPU），返回值就是组里第几个套接字，reuseport_attach_cpu_bpf 生成这个程序。
+ * 多队列网卡上还要配合 RSS / RPS 把流分散到这些 CPU 上；回环设备上收包的 CPU 就是发送方所在的 CPU。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+#define CPU_STEER_MAX 64
+
+// 把 "0-3,6" 这样的 CPU 列表追加到 cpus，去掉重复的，返回总个数，格式错误返回 -1
+int cpu_list_parse(const char *list, int *cpus, int n, int max)
+{
+    const char *p = list;
+    while (*p && *p != '\n')
+    {
+        char *end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (end == p || lo < 0)
+            return -1;
+        if (*end == '-')
+        {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo)
+                return -1;
+        }
+        for (long cpu = lo; cpu <= hi; cpu++)
+        {
+            int dup = 0;
+            for (int i = 0; i < n; i++)
+                dup |= cpus[i] == cpu;
+            if (!dup && n < max)
+                cpus[n++] = cpu;
+        }
+        p = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0' && *end != '\n')
+            return -1;
+    }
+    return n;
+}
+
+/**
+ * 找出名字里含有 dev 的中断（/proc/interrupts 最后一列，比如 "eth0-TxRx-0"、"virtio0-input.0"）
+ * 被分配到的 CPU，返回个数，没有找到返回 0。
+ */
+int cpu_irq_cpus(const char *dev, int *cpus, int max)
+{
+    char line[4096], path[64], list[256];
+    int n = 0;
+    FILE *fp = fopen("/proc/interrupts", "r");
+    if (fp == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        int irq;
+        if (sscanf(line, " %d:", &irq) != 1 || strstr(line, dev) == NULL)
+            continue;
+        // 较新的内核有 effective_affinity_list，是中断实际投递的 CPU；smp_affinity_list 是允许的范围
+        snprintf(path, sizeof(path), "/proc/irq/%d/effective_affinity_list", irq);
+        FILE *aff = fopen(path, "r");
+        if (aff == NULL)
+        {
+            snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity_list", irq);
+            aff = fopen(path, "r");
+        }
+        if (aff == NULL)
+            continue;
+        if (fgets(list, sizeof(list), aff) != NULL)
+        {
+            int got = cpu_list_parse(list, cpus, n, max);
+            if (got > 0)
+                n = got;
+        }
+        fclose(aff);
+    }
+    fclose(fp);
+    return n;
+}
+
+// 解析命令行上的 CPU 设置："0-3,6" 或者 "irq:<网卡名>"，返回 CPU 个数，失败返回 -1
+int cpu_steer_parse(const char *spec, int *cpus, int max)
+{
+    if (strncmp(spec, "irq:", 4) == 0)
+    {
+        int n = cpu_irq_cpus(spec + 4, cpus, max);
+        return n > 0 ? n : -1;
+    }
+    return cpu_list_parse(spec, cpus, 0, max);
+}
+
+// 最近一次处理这个连接收包的 CPU，不知道时返回 -1
+int sock_incoming_cpu(int sock)
+{
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    if (getsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == -1)
+        return -1;
+    return cpu;
+}
+
+/**
+ * 给 sock 所在的 reuseport 组挂上按 CPU 选择套接字的 BPF 程序：
+ * 在 cpus[i] 上收到的 SYN 交给组里第 i 个套接字（按 bind 的先后顺序），其他 CPU 按 CPU 号取模。
+ * 组里所有套接字都 bind 之后再调用，成功返回 0。
+ */
+int reuseport_attach_cpu_bpf(int sock, const int *cpus, int n)
+{
+    struct sock_filter code[CPU_STEER_MAX * 2 + 3];
+    int len = 0;
+    if (n <= 0 || n > CPU_STEER_MAX)
+        return -1;
+
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+    for (int i = 0; i < n; i++)
+    {
+        // A == cpus[i] 时执行下一条（返回 i），否则跳过它
+        code[len++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, cpus[i], 0, 1);
+        code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, i);
+    }
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, n);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);
+
+    struct sock_fprog prog = {len, code};
+    return setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+}
+
+#endif /* cpu_steer.h */
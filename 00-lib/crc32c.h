@@ -0,0 +1,279 @@
+#ifndef _CRC32C_H
+#define _CRC32C_H 1
+
+/**
+ * CRC32C（Castagnoli 多项式，iSCSI / ext4 / SCTP 用的那个），用于文件传输时逐块校验（见 file_xfer.h）。
+ *
+ * 选 CRC32C 而不是 zlib 的 CRC32，是因为 x86 的 SSE4.2 和 ARMv8 的 CRC 扩展都有专门计算它的指令：
+ * - x86：crc32 指令一次处理 8 字节，延迟 3 个周期、吞吐 1 个周期，
+ *   一条依赖链上串行算只能用到 1/3 的吞吐（3GHz 下约 8GB/s），
+ *   所以把数据分成三段交错计算三条独立的链，最后再把三个结果合并，能到 20GB/s 以上，超过内存带宽；
+ * - ARM：crc32cx 指令，同样三路交错；
+ * - 都没有时用 slicing-by-8 查表，一次处理 8 字节，大约 1~2GB/s。
+ * 合并的原理：CRC 是 GF(2) 上的线性运算，crc(A || B) = crc(A) 后面接 len(B) 个 0 字节再异或 crc(B)，
+ * “接 n 个 0 字节” 是一个固定的 32x32 矩阵，对固定的段长预先算成 4 张 256 项的表，合并一次只要查 4 次表。
+ *
+ * crc32c(crc, buf, len) 可以分段调用，crc 初值为 0：
+ *   uint32_t crc = crc32c(0, a, alen);
+ *   crc = crc32c(crc, b, blen);   // 等于 crc32c(0, a || b, alen + blen)
+ * 第一次调用时检测 CPU 并建表，多线程可以直接用。
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+// 反射形式的 Castagnoli 多项式
+#define CRC32C_POLY 0x82F63B78
+// 三路交错时每一路的长度，长段合并一次的开销可以忽略，短段处理长段剩下的尾巴
+#define CRC32C_LONG 8192
+#define CRC32C_SHORT 256
+
+uint32_t crc32c_table[8][256];
+uint32_t crc32c_long_zeros[4][256];
+uint32_t crc32c_short_zeros[4][256];
+uint32_t (*crc32c_impl)(uint32_t, const void *, size_t);
+const char *crc32c_impl_name = "none";
+pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+// GF(2) 上 32x32 矩阵乘向量，矩阵按列存放
+uint32_t crc32c_gf2_times(const uint32_t *mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+    while (vec)
+    {
+        if (vec & 1)
+            sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+void crc32c_gf2_square(uint32_t *square, const uint32_t *mat)
+{
+    for (int n = 0; n < 32; n++)
+        square[n] = crc32c_gf2_times(mat, mat[n]);
+}
+
+// 构造 “在后面接 len 个 0 字节” 的矩阵，len 必须是 2 的幂
+void crc32c_zeros_op(uint32_t *even, size_t len)
+{
+    uint32_t odd[32];
+    uint32_t row = 1;
+    odd[0] = CRC32C_POLY; // 接 1 个 0 比特的矩阵
+    for (int n = 1; n < 32; n++)
+    {
+        odd[n] = row;
+        row <<= 1;
+    }
+    crc32c_gf2_square(even, odd); // 2 个比特
+    crc32c_gf2_square(odd, even); // 4 个比特
+    // 再平方一次是 1 个字节，之后每平方一次长度翻倍
+    do
+    {
+        crc32c_gf2_square(even, odd);
+        len >>= 1;
+        if (len == 0)
+            return;
+        crc32c_gf2_square(odd, even);
+        len >>= 1;
+    } while (len);
+    memcpy(even, odd, sizeof(odd));
+}
+
+// 把矩阵展开成按字节查的 4 张表
+void crc32c_zeros(uint32_t zeros[][256], size_t len)
+{
+    uint32_t op[32];
+    crc32c_zeros_op(op, len);
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        zeros[0][n] = crc32c_gf2_times(op, n);
+        zeros[1][n] = crc32c_gf2_times(op, n << 8);
+        zeros[2][n] = crc32c_gf2_times(op, n << 16);
+        zeros[3][n] = crc32c_gf2_times(op, n << 24);
+    }
+}
+
+static inline uint32_t crc32c_shift(uint32_t zeros[][256], uint32_t crc)
+{
+    return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^ zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+// slicing-by-8 查表实现，没有硬件指令时使用
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+    const unsigned char *next = buf;
+    crc = ~crc;
+    while (len > 0 && ((uintptr_t)next & 7) != 0)
+    {
+        crc = crc32c_table[0][(crc ^ *next++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+    while (len >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, next, 8);
+        word ^= crc; // 小端：低 4 字节和 crc 对齐
+        crc = crc32c_table[7][word & 0xff] ^ crc32c_table[6][(word >> 8) & 0xff] ^
+              crc32c_table[5][(word >> 16) & 0xff] ^ crc32c_table[4][(word >> 24) & 0xff] ^
+              crc32c_table[3][(word >> 32) & 0xff] ^ crc32c_table[2][(word >> 40) & 0xff] ^
+              crc32c_table[1][(word >> 48) & 0xff] ^ crc32c_table[0][word >> 56];
+        next += 8;
+        len -= 8;
+    }
+    while (len > 0)
+    {
+        crc = crc32c_table[0][(crc ^ *next++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+    return ~crc;
+}
+
+#if defined(__x86_64__)
+#define CRC32C_HW_TARGET __attribute__((target("sse4.2")))
+#define CRC32C_U8(crc, p) _mm_crc32_u8((crc), *(const uint8_t *)(p))
+#define CRC32C_U64(crc, p) ((uint32_t)_mm_crc32_u64((crc), *(const uint64_t *)(p)))
+#elif defined(__aarch64__)
+#define CRC32C_HW_TARGET __attribute__((target("+crc")))
+#define CRC32C_U8(crc, p) __crc32cb((crc), *(const uint8_t *)(p))
+#define CRC32C_U64(crc, p) __crc32cd((crc), *(const uint64_t *)(p))
+#endif
+
+#ifdef CRC32C_HW_TARGET
+// 硬件指令实现，长数据三路交错
+CRC32C_HW_TARGET uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len)
+{
+    const unsigned char *next = buf;
+    uint32_t crc0 = ~crc, crc1, crc2;
+
+    while (len > 0 && ((uintptr_t)next & 7) != 0)
+    {
+        crc0 = CRC32C_U8(crc0, next);
+        next++;
+        len--;
+    }
+
+    // 三段各 CRC32C_LONG 字节同时算，算完把前面的结果“接上”后面一段的长度再异或进来
+    while (len >= CRC32C_LONG * 3)
+    {
+        const unsigned char *end = next + CRC32C_LONG;
+        crc1 = crc2 = 0;
+        do
+        {
+            crc0 = CRC32C_U64(crc0, next);
+            crc1 = CRC32C_U64(crc1, next + CRC32C_LONG);
+            crc2 = CRC32C_U64(crc2, next + CRC32C_LONG * 2);
+            next += 8;
+        } while (next < end);
+        crc0 = crc32c_shift(crc32c_long_zeros, crc0) ^ crc1;
+        crc0 = crc32c_shift(crc32c_long_zeros, crc0) ^ crc2;
+        next += CRC32C_LONG * 2;
+        len -= CRC32C_LONG * 3;
+    }
+    while (len >= CRC32C_SHORT * 3)
+    {
+        const unsigned char *end = next + CRC32C_SHORT;
+        crc1 = crc2 = 0;
+        do
+        {
+            crc0 = CRC32C_U64(crc0, next);
+            crc1 = CRC32C_U64(crc1, next + CRC32C_SHORT);
+            crc2 = CRC32C_U64(crc2, next + CRC32C_SHORT * 2);
+            next += 8;
+        } while (next < end);
+        crc0 = crc32c_shift(crc32c_short_zeros, crc0) ^ crc1;
+        crc0 = crc32c_shift(crc32c_short_zeros, crc0) ^ crc2;
+        next += CRC32C_SHORT * 2;
+        len -= CRC32C_SHORT * 3;
+    }
+
+    while (len >= 8)
+    {
+        crc0 = CRC32C_U64(crc0, next);
+        next += 8;
+        len -= 8;
+    }
+    while (len > 0)
+    {
+        crc0 = CRC32C_U8(crc0, next);
+        next++;
+        len--;
+    }
+    return ~crc0;
+}
+
+int crc32c_hw_available(void)
+{
+#if defined(__x86_64__)
+    return __builtin_cpu_supports("sse4.2");
+#else
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#endif
+}
+#else
+uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len)
+{
+    return crc32c_sw(crc, buf, len);
+}
+
+int crc32c_hw_available(void)
+{
+    return 0;
+}
+#endif
+
+void crc32c_init_once(void)
+{
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t crc = n;
+        for (int k = 0; k < 8; k++)
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        crc32c_table[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; n++)
+        for (int k = 1; k < 8; k++)
+            crc32c_table[k][n] = crc32c_table[0][crc32c_table[k - 1][n] & 0xff] ^ (crc32c_table[k - 1][n] >> 8);
+    crc32c_zeros(crc32c_long_zeros, CRC32C_LONG);
+    crc32c_zeros(crc32c_short_zeros, CRC32C_SHORT);
+
+    if (crc32c_hw_available())
+    {
+        crc32c_impl = crc32c_hw;
+#if defined(__x86_64__)
+        crc32c_impl_name = "sse4.2";
+#else
+        crc32c_impl_name = "armv8-crc";
+#endif
+    }
+    else
+    {
+        crc32c_impl = crc32c_sw;
+        crc32c_impl_name = "table";
+    }
+}
+
+// 建表并选择实现，crc32c 第一次调用时会自动执行；直接调用 crc32c_sw / crc32c_hw 之前要先调用它
+void crc32c_init(void)
+{
+    pthread_once(&crc32c_once, crc32c_init_once);
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+    crc32c_init();
+    return crc32c_impl(crc, buf, len);
+}
+
+#endif /* crc32c.h */
@@ -0,0 +1,122 @@
+#ifndef _FD_BITMAP_H
+#define _FD_BITMAP_H 1
+
+/**
+ * 可以动态扩容的 fd 位图，用来突破 fd_set 固定 FD_SETSIZE（1024）位的限制。
+ *
+ * Linux 内核里 select 的 fd_set 参数本来就只是一段 unsigned long 数组，长度由第一个参数 nfds 决定，
+ * 1024 的限制只来自 glibc 里 fd_set 类型的大小（以及 FD_SET 宏的越界检查）。
+ * 所以只要自己分配足够大的 unsigned long 数组并自己置位，就可以把它强转成 fd_set * 传给 select。
+ *
+ * 遍历时按字（64 位）扫描，用 __builtin_ctzl（count trailing zeros）直接跳到下一个置位的 bit，
+ * 只访问真正就绪的 fd，而不是像 FD_ISSET 那样从 0 到 fd_max 逐个测试。
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+
+#define FD_BITMAP_WORD_BITS (8 * (int)sizeof(unsigned long))
+
+typedef struct
+{
+    unsigned long *words;
+    int nwords;
+} fd_bitmap;
+
+int fd_bitmap_init(fd_bitmap *bm, int nbits)
+{
+    // 至少和 fd_set 一样大，这样也可以安全地传给只认 fd_set 的代码
+    if (nbits < FD_SETSIZE)
+        nbits = FD_SETSIZE;
+    bm->nwords = (nbits + FD_BITMAP_WORD_BITS - 1) / FD_BITMAP_WORD_BITS;
+    bm->words = calloc(bm->nwords, sizeof(unsigned long));
+    return bm->words == NULL ? -1 : 0;
+}
+
+void fd_bitmap_free(fd_bitmap *bm)
+{
+    free(bm->words);
+    bm->words = NULL;
+    bm->nwords = 0;
+}
+
+// 保证 fd 这一位可用，按 2 倍扩容，新增部分清零
+int fd_bitmap_reserve(fd_bitmap *bm, int fd)
+{
+    int need = fd / FD_BITMAP_WORD_BITS + 1;
+    if (need <= bm->nwords)
+        return 0;
+
+    int nwords = bm->nwords * 2;
+    while (nwords < need)
+        nwords *= 2;
+    unsigned long *words = realloc(bm->words, nwords * sizeof(unsigned long));
+    if (words == NULL)
+        return -1;
+    memset(words + bm->nwords, 0, (nwords - bm->nwords) * sizeof(unsigned long));
+    bm->words = words;
+    bm->nwords = nwords;
+    return 0;
+}
+
+void fd_bitmap_set(fd_bitmap *bm, int fd)
+{
+    bm->words[fd / FD_BITMAP_WORD_BITS] |= 1ul << (fd % FD_BITMAP_WORD_BITS);
+}
+
+void fd_bitmap_clr(fd_bitmap *bm, int fd)
+{
+    bm->words[fd / FD_BITMAP_WORD_BITS] &= ~(1ul << (fd % FD_BITMAP_WORD_BITS));
+}
+
+int fd_bitmap_isset(const fd_bitmap *bm, int fd)
+{
+    if (fd / FD_BITMAP_WORD_BITS >= bm->nwords)
+        return 0;
+    return (bm->words[fd / FD_BITMAP_WORD_BITS] >> (fd % FD_BITMAP_WORD_BITS)) & 1;
+}
+
+// 把 src 的前 nfds 位拷贝到 dst（dst 容量不够时先扩容），供每次 select 前重置就绪集合
+int fd_bitmap_copy(fd_bitmap *dst, const fd_bitmap *src, int nfds)
+{
+    if (nfds > 0 && fd_bitmap_reserve(dst, nfds - 1) == -1)
+        return -1;
+    int nwords = (nfds + FD_BITMAP_WORD_BITS - 1) / FD_BITMAP_WORD_BITS;
+    memcpy(dst->words, src->words, nwords * sizeof(unsigned long));
+    return 0;
+}
+
+fd_set *fd_bitmap_as_fdset(fd_bitmap *bm)
+{
+    return (fd_set *)bm->words;
+}
+
+/**
+ * 返回 >= from 的下一个置位的 fd，没有则返回 -1。nfds 为需要检查的位数上限。
+ * 典型用法：
+ *   for (int fd = fd_bitmap_next(&bm, 0, nfds); fd >= 0; fd = fd_bitmap_next(&bm, fd + 1, nfds))
+ */
+int fd_bitmap_next(const fd_bitmap *bm, int from, int nfds)
+{
+    if (from >= nfds)
+        return -1;
+    int w = from / FD_BITMAP_WORD_BITS;
+    int last = (nfds - 1) / FD_BITMAP_WORD_BITS;
+    // 第一个字要屏蔽掉 from 之前的位
+    unsigned long bits = bm->words[w] & (~0ul << (from % FD_BITMAP_WORD_BITS));
+
+    while (1)
+    {
+        if (bits != 0)
+        {
+            int fd = w * FD_BITMAP_WORD_BITS + __builtin_ctzl(bits);
+            return fd < nfds ? fd : -1;
+        }
+        if (++w > last)
+            return -1;
+        bits = bm->words[w];
+    }
+}
+
+#endif /* fd_bitmap.h */
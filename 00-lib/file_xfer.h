@@ -0,0 +1,703 @@
+#ifndef _FILE_XFER_H
+#define _FILE_XFER_H 1
+
+/**
+ * 分块、带校验的文件传输协议（见 21-tcp-half-close 的 file-server.c / file-client.c）。
+ *
+ * 原来的做法是服务端把文件写完后 shutdown(SHUT_WR)，客户端读到 EOF 就认为收完了，
+ * 这样客户端事先不知道文件多大，连接中途断开和正常结束也分不清，收到的数据对不对更无从验证。
+ * 这里的协议（所有整数都是网络字节序）：
+ *   客户端 -> 服务端  xfer_request { magic, flags, offset, length }        要文件的哪一段，length 为 0 表示到文件末尾
+ *   服务端 -> 客户端  xfer_header  { magic, chunk_size, file_size, offset, length, flags, status }
+ *                     xfer_chunk   { len, crc } + len 字节数据          重复多次，每块不超过 chunk_size
+ *                     xfer_chunk   { 0, 0 }                            结束
+ * 请求带 XFER_FLAG_STAT 时只回复文件头和结束块，用来先问文件大小。
+ * 请求带 XFER_FLAG_LZ 时服务端在文件头的 flags 里同样带上它表示同意，之后每块用 lz_fast.h 压缩，
+ * 块头变成 xfer_lz_chunk { len, crc, raw_len }，crc 是压缩前数据的校验，解压之后再验，连编解码的错误也能发现；
+ * 压缩后没有变小的块原样发送（raw_len 等于 len）。压缩 / 解压和网络收发放在两个线程里，
+ * 中间用一个深度为 XFER_PIPE_DEPTH 的队列连起来，压缩下一块的同时上一块在发送（见 xfer_pipe）。
+ * 一个连接上可以依次发多个请求，多连接并行下载时每个连接一段接一段地取（见 xfer_parallel.h）。
+ * 每块数据带自己的 CRC32C（见 crc32c.h），客户端边收边校验边写盘，出错时知道是哪一块，
+ * 已经校验通过写到盘上的部分不用重传。收到结束块且字节数等于 length 才算传完。
+ *
+ *   服务端：xfer_serve(sock, file_fd, file_size, chunk_size, &stats);
+ *   客户端：xfer_fetch(sock, out_fd, offset, length, flags, &hdr, &stats);
+ * 出错时返回 XFER_ERR_*（都是负数），xfer_strerror 转成文字。
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <endian.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include "crc32c.h"
+#include "lz_fast.h"
+
+#define XFER_MAGIC 0x58464552 // "XFER"
+#define XFER_DEFAULT_CHUNK (256 * 1024)
+#define XFER_MAX_CHUNK (16 * 1024 * 1024)
+
+// xfer_request.flags
+#define XFER_FLAG_STAT 0x1 // 只要文件头，不要数据
+#define XFER_FLAG_LZ 0x2   // 逐块压缩
+
+// 压缩模式下收发两个线程之间的队列深度
+#define XFER_PIPE_DEPTH 4
+
+// xfer_header.status
+#define XFER_STATUS_OK 0
+#define XFER_STATUS_RANGE 1 // offset 超出了文件末尾
+
+// 出错时的返回值
+#define XFER_ERR_IO -1    // 读写套接字或文件出错，或者连接中途断开
+#define XFER_ERR_PROTO -2 // 魔数、长度等对不上
+#define XFER_ERR_CRC -3   // 某一块数据校验失败
+#define XFER_ERR_RANGE -4 // 服务端拒绝了请求的范围
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t length;
+} xfer_request;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t chunk_size;
+    uint64_t file_size;
+    uint64_t offset;
+    uint64_t length; // 实际要发送的字节数（请求的范围超过文件末尾时会被截短）
+    uint32_t flags;
+    uint32_t status;
+} xfer_header;
+
+typedef struct
+{
+    uint32_t len;
+    uint32_t crc;
+} xfer_chunk;
+
+// 压缩模式下的块头
+typedef struct
+{
+    uint32_t len;     // 线上的字节数
+    uint32_t crc;     // 原始数据的 CRC32C
+    uint32_t raw_len; // 原始数据的字节数，等于 len 时数据没有压缩
+} xfer_lz_chunk;
+
+typedef struct
+{
+    uint64_t bytes;      // 已经发出 / 校验通过并写盘的数据字节数（压缩前）
+    uint64_t wire_bytes; // 线上实际传输的数据字节数，不压缩时和 bytes 相同
+    uint64_t chunks;
+    uint64_t crc_ns;   // 花在计算 CRC 上的时间，用来确认校验不是瓶颈
+    uint64_t codec_ns; // 花在压缩（服务端）/ 解压（客户端）上的时间
+} xfer_stats;
+
+// 压缩模式下队列里的一个槽位，生产者填好后交给消费者，消费者用完再还回来
+typedef struct
+{
+    char *raw;  // 原始数据，chunk_size 字节
+    char *wire; // 压缩后的数据
+    uint32_t raw_len;
+    uint32_t wire_len; // 等于 raw_len 时数据在 raw 里，没有压缩
+    uint32_t crc;
+} xfer_slot;
+
+/**
+ * 一个生产者线程和一个消费者线程之间的有界队列。
+ * 服务端：生产者 pread + CRC + 压缩，消费者发送；客户端：生产者接收，消费者解压 + CRC + pwrite。
+ * 两边各自只更新 xfer_stats 里自己那几项，线程结束后再由消费者一方汇总，不用加锁。
+ */
+typedef struct
+{
+    xfer_slot slots[XFER_PIPE_DEPTH];
+    int head;      // 下一个要消费的槽位
+    int count;     // 已经填好、还没消费的槽位数
+    int closed;    // 生产者不会再放入了
+    int cancelled; // 消费者出错不要了，生产者也停下
+    int error;     // 生产者出错时的 XFER_ERR_*
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    // 生产者线程的参数
+    int fd;
+    uint64_t offset;
+    uint64_t length;
+    uint32_t chunk_size;
+    xfer_stats *stats;
+} xfer_pipe;
+
+const char *xfer_strerror(int err)
+{
+    switch (err)
+    {
+    case XFER_ERR_IO:
+        return "I/O error or connection closed";
+    case XFER_ERR_PROTO:
+        return "protocol error";
+    case XFER_ERR_CRC:
+        return "chunk CRC mismatch";
+    case XFER_ERR_RANGE:
+        return "requested range is beyond end of file";
+    default:
+        return "ok";
+    }
+}
+
+uint64_t xfer_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int xfer_read_full(int fd, void *buf, size_t len)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = read(fd, (char *)buf + done, len - done);
+        if (n > 0)
+            done += n;
+        else if (n == -1 && errno == EINTR)
+            continue;
+        else
+            return -1;
+    }
+    return 0;
+}
+
+// 把 iov 全部写出去，会修改 iov
+int xfer_writev_full(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0)
+    {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+int xfer_write_full(int fd, const void *buf, size_t len)
+{
+    struct iovec iov = {(void *)buf, len};
+    return xfer_writev_full(fd, &iov, 1);
+}
+
+int xfer_send_request(int sock, uint64_t offset, uint64_t length, uint32_t flags)
+{
+    xfer_request req = {htonl(XFER_MAGIC), htonl(flags), htobe64(offset), htobe64(length)};
+    return xfer_write_full(sock, &req, sizeof(req));
+}
+
+int xfer_recv_request(int sock, xfer_request *req)
+{
+    if (xfer_read_full(sock, req, sizeof(*req)) == -1)
+        return XFER_ERR_IO;
+    req->magic = ntohl(req->magic);
+    req->flags = ntohl(req->flags);
+    req->offset = be64toh(req->offset);
+    req->length = be64toh(req->length);
+    return req->magic == XFER_MAGIC ? 0 : XFER_ERR_PROTO;
+}
+
+int xfer_send_header(int sock, const xfer_header *hdr)
+{
+    xfer_header h = {htonl(XFER_MAGIC), htonl(hdr->chunk_size), htobe64(hdr->file_size), htobe64(hdr->offset),
+                     htobe64(hdr->length), htonl(hdr->flags), htonl(hdr->status)};
+    return xfer_write_full(sock, &h, sizeof(h));
+}
+
+int xfer_recv_header(int sock, xfer_header *hdr)
+{
+    if (xfer_read_full(sock, hdr, sizeof(*hdr)) == -1)
+        return XFER_ERR_IO;
+    hdr->magic = ntohl(hdr->magic);
+    hdr->chunk_size = ntohl(hdr->chunk_size);
+    hdr->file_size = be64toh(hdr->file_size);
+    hdr->offset = be64toh(hdr->offset);
+    hdr->length = be64toh(hdr->length);
+    hdr->flags = ntohl(hdr->flags);
+    hdr->status = ntohl(hdr->status);
+    if (hdr->magic != XFER_MAGIC || hdr->chunk_size == 0 || hdr->chunk_size > XFER_MAX_CHUNK)
+        return XFER_ERR_PROTO;
+    return 0;
+}
+
+int xfer_pipe_init(xfer_pipe *p, uint32_t chunk_size)
+{
+    memset(p, 0, sizeof(*p));
+    p->chunk_size = chunk_size;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    for (int i = 0; i < XFER_PIPE_DEPTH; i++)
+    {
+        p->slots[i].raw = malloc(chunk_size);
+        p->slots[i].wire = malloc(lz_compress_bound(chunk_size));
+        if (p->slots[i].raw == NULL || p->slots[i].wire == NULL)
+            return -1;
+    }
+    return 0;
+}
+
+void xfer_pipe_free(xfer_pipe *p)
+{
+    for (int i = 0; i < XFER_PIPE_DEPTH; i++)
+    {
+        free(p->slots[i].raw);
+        free(p->slots[i].wire);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->cond);
+}
+
+// 生产者取一个空槽位，队列满了就等，消费者已经放弃时返回 NULL
+xfer_slot *xfer_pipe_produce(xfer_pipe *p)
+{
+    pthread_mutex_lock(&p->lock);
+    while (p->count == XFER_PIPE_DEPTH && !p->cancelled)
+        pthread_cond_wait(&p->cond, &p->lock);
+    xfer_slot *slot = p->cancelled ? NULL : &p->slots[(p->head + p->count) % XFER_PIPE_DEPTH];
+    pthread_mutex_unlock(&p->lock);
+    return slot;
+}
+
+// 生产者填好了 xfer_pipe_produce 给的槽位
+void xfer_pipe_push(xfer_pipe *p)
+{
+    pthread_mutex_lock(&p->lock);
+    p->count++;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// 生产者结束，error 为 0 表示正常结束
+void xfer_pipe_close(xfer_pipe *p, int error)
+{
+    pthread_mutex_lock(&p->lock);
+    p->closed = 1;
+    p->error = error;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// 消费者取下一个填好的槽位，队列空了就等，生产者已经结束时返回 NULL（看 p->error 区分是否出错）
+xfer_slot *xfer_pipe_consume(xfer_pipe *p)
+{
+    pthread_mutex_lock(&p->lock);
+    while (p->count == 0 && !p->closed)
+        pthread_cond_wait(&p->cond, &p->lock);
+    xfer_slot *slot = p->count > 0 ? &p->slots[p->head] : NULL;
+    pthread_mutex_unlock(&p->lock);
+    return slot;
+}
+
+// 消费者用完了 xfer_pipe_consume 给的槽位
+void xfer_pipe_release(xfer_pipe *p)
+{
+    pthread_mutex_lock(&p->lock);
+    p->head = (p->head + 1) % XFER_PIPE_DEPTH;
+    p->count--;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void xfer_pipe_cancel(xfer_pipe *p)
+{
+    pthread_mutex_lock(&p->lock);
+    p->cancelled = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// 服务端压缩模式的生产者线程：按块读文件、算 CRC、压缩
+void *xfer_lz_reader(void *arg)
+{
+    xfer_pipe *p = arg;
+    uint64_t done = 0;
+    while (done < p->length)
+    {
+        xfer_slot *slot = xfer_pipe_produce(p);
+        if (slot == NULL)
+            return NULL;
+        uint32_t len = p->length - done < p->chunk_size ? p->length - done : p->chunk_size;
+        uint32_t n = 0;
+        while (n < len)
+        {
+            ssize_t r = pread(p->fd, slot->raw + n, len - n, p->offset + done + n);
+            if (r <= 0)
+            {
+                xfer_pipe_close(p, XFER_ERR_IO);
+                return NULL;
+            }
+            n += r;
+        }
+
+        uint64_t t0 = xfer_now_ns();
+        slot->raw_len = len;
+        slot->crc = crc32c(0, slot->raw, len);
+        uint64_t t1 = xfer_now_ns();
+        // 只接受比原来小的结果，放不下时 lz_compress 返回 0，原样发送
+        int clen = lz_compress(slot->raw, len, slot->wire, len - 1);
+        slot->wire_len = clen > 0 ? (uint32_t)clen : len;
+        p->stats->crc_ns += t1 - t0;
+        p->stats->codec_ns += xfer_now_ns() - t1;
+        xfer_pipe_push(p);
+        done += len;
+    }
+    xfer_pipe_close(p, 0);
+    return NULL;
+}
+
+// 服务端压缩模式：另起一个线程读文件和压缩，这个线程只管发送
+int xfer_serve_lz(int sock, int file_fd, const xfer_header *hdr, xfer_stats *stats)
+{
+    xfer_pipe p;
+    pthread_t tid;
+    if (xfer_pipe_init(&p, hdr->chunk_size) == -1)
+    {
+        xfer_pipe_free(&p);
+        return XFER_ERR_IO;
+    }
+    p.fd = file_fd;
+    p.offset = hdr->offset;
+    p.length = hdr->length;
+    p.stats = stats;
+    if (pthread_create(&tid, NULL, xfer_lz_reader, &p) != 0)
+    {
+        xfer_pipe_free(&p);
+        return XFER_ERR_IO;
+    }
+
+    int ret = 0;
+    xfer_slot *slot;
+    while ((slot = xfer_pipe_consume(&p)) != NULL)
+    {
+        xfer_lz_chunk ch = {htonl(slot->wire_len), htonl(slot->crc), htonl(slot->raw_len)};
+        struct iovec iov[2] = {{&ch, sizeof(ch)}, {slot->wire_len < slot->raw_len ? slot->wire : slot->raw, slot->wire_len}};
+        if (xfer_writev_full(sock, iov, 2) == -1)
+        {
+            ret = XFER_ERR_IO;
+            xfer_pipe_cancel(&p);
+            break;
+        }
+        stats->bytes += slot->raw_len;
+        stats->wire_bytes += slot->wire_len;
+        stats->chunks++;
+        xfer_pipe_release(&p);
+    }
+    pthread_join(tid, NULL);
+    if (ret == 0)
+        ret = p.error;
+    if (ret == 0)
+    {
+        xfer_lz_chunk end = {0, 0, 0};
+        if (xfer_write_full(sock, &end, sizeof(end)) == -1)
+            ret = XFER_ERR_IO;
+    }
+    xfer_pipe_free(&p);
+    return ret;
+}
+
+/**
+ * 服务端：读一个请求，回复文件头，再把请求的范围逐块发出去。
+ * 每块用 pread 读到缓冲区，算好 CRC 后和块头一起用一次 writev 发出。
+ */
+int xfer_serve(int sock, int file_fd, uint64_t file_size, uint32_t chunk_size, xfer_stats *stats)
+{
+    xfer_request req;
+    xfer_header hdr;
+    xfer_stats local = {0};
+    if (stats == NULL)
+        stats = &local;
+    int ret = xfer_recv_request(sock, &req);
+    if (ret < 0)
+        return ret;
+
+    if (chunk_size == 0 || chunk_size > XFER_MAX_CHUNK)
+        chunk_size = XFER_DEFAULT_CHUNK;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.chunk_size = chunk_size;
+    hdr.file_size = file_size;
+    hdr.offset = req.offset;
+    hdr.flags = req.flags & XFER_FLAG_LZ;
+    if (req.offset > file_size)
+        hdr.status = XFER_STATUS_RANGE;
+    else if (req.flags & XFER_FLAG_STAT)
+        hdr.length = 0;
+    else if (req.length == 0 || req.length > file_size - req.offset)
+        hdr.length = file_size - req.offset;
+    else
+        hdr.length = req.length;
+    if (xfer_send_header(sock, &hdr) == -1)
+        return XFER_ERR_IO;
+    if (hdr.status != XFER_STATUS_OK)
+        return XFER_ERR_RANGE;
+    if (hdr.flags & XFER_FLAG_LZ)
+        return xfer_serve_lz(sock, file_fd, &hdr, stats);
+
+    char *buf = malloc(chunk_size);
+    if (buf == NULL)
+        return XFER_ERR_IO;
+    uint64_t done = 0;
+    ret = 0;
+    while (ret == 0)
+    {
+        size_t len = hdr.length - done < chunk_size ? hdr.length - done : chunk_size;
+        ssize_t n = 0;
+        while ((size_t)n < len)
+        {
+            ssize_t r = pread(file_fd, buf + n, len - n, hdr.offset + done + n);
+            if (r <= 0) // 文件在传输过程中被截短了也算出错，不能发出比文件头说的少的数据
+            {
+                ret = XFER_ERR_IO;
+                break;
+            }
+            n += r;
+        }
+        if (ret != 0)
+            break;
+
+        uint64_t t0 = xfer_now_ns();
+        xfer_chunk ch = {htonl(len), htonl(len > 0 ? crc32c(0, buf, len) : 0)};
+        stats->crc_ns += xfer_now_ns() - t0;
+        struct iovec iov[2] = {{&ch, sizeof(ch)}, {buf, len}};
+        if (xfer_writev_full(sock, iov, 2) == -1)
+        {
+            ret = XFER_ERR_IO;
+            break;
+        }
+        if (len == 0) // 结束块
+            break;
+        done += len;
+        stats->bytes += len;
+        stats->wire_bytes += len;
+        stats->chunks++;
+    }
+    free(buf);
+    return ret;
+}
+
+// 客户端压缩模式的生产者线程：接收块，放进队列
+void *xfer_lz_receiver(void *arg)
+{
+    xfer_pipe *p = arg;
+    while (1)
+    {
+        xfer_lz_chunk ch;
+        if (xfer_read_full(p->fd, &ch, sizeof(ch)) == -1)
+        {
+            xfer_pipe_close(p, XFER_ERR_IO);
+            return NULL;
+        }
+        ch.len = ntohl(ch.len);
+        ch.crc = ntohl(ch.crc);
+        ch.raw_len = ntohl(ch.raw_len);
+        if (ch.len == 0)
+        {
+            xfer_pipe_close(p, 0);
+            return NULL;
+        }
+        if (ch.raw_len > p->chunk_size || ch.len > ch.raw_len)
+        {
+            xfer_pipe_close(p, XFER_ERR_PROTO);
+            return NULL;
+        }
+        xfer_slot *slot = xfer_pipe_produce(p);
+        if (slot == NULL)
+            return NULL;
+        slot->raw_len = ch.raw_len;
+        slot->wire_len = ch.len;
+        slot->crc = ch.crc;
+        // 没有压缩的块直接收进 raw，省一次复制
+        if (xfer_read_full(p->fd, ch.len < ch.raw_len ? slot->wire : slot->raw, ch.len) == -1)
+        {
+            xfer_pipe_close(p, XFER_ERR_IO);
+            return NULL;
+        }
+        p->stats->wire_bytes += ch.len;
+        xfer_pipe_push(p);
+    }
+}
+
+// 客户端压缩模式：另起一个线程接收，这个线程解压、校验、写盘
+int xfer_fetch_lz(int sock, int out_fd, uint64_t offset, const xfer_header *hdr, xfer_stats *stats)
+{
+    xfer_pipe p;
+    pthread_t tid;
+    if (xfer_pipe_init(&p, hdr->chunk_size) == -1)
+    {
+        xfer_pipe_free(&p);
+        return XFER_ERR_IO;
+    }
+    p.fd = sock;
+    p.stats = stats;
+    if (pthread_create(&tid, NULL, xfer_lz_receiver, &p) != 0)
+    {
+        xfer_pipe_free(&p);
+        return XFER_ERR_IO;
+    }
+
+    int ret = 0;
+    xfer_slot *slot;
+    while ((slot = xfer_pipe_consume(&p)) != NULL)
+    {
+        if (stats->bytes + slot->raw_len > hdr->length)
+        {
+            ret = XFER_ERR_PROTO;
+            break;
+        }
+        uint64_t t0 = xfer_now_ns();
+        if (slot->wire_len < slot->raw_len &&
+            lz_decompress(slot->wire, slot->wire_len, slot->raw, slot->raw_len) != (int)slot->raw_len)
+        {
+            ret = XFER_ERR_CRC; // 压缩数据损坏，和校验失败一样处理
+            break;
+        }
+        uint64_t t1 = xfer_now_ns();
+        uint32_t crc = crc32c(0, slot->raw, slot->raw_len);
+        stats->codec_ns += t1 - t0;
+        stats->crc_ns += xfer_now_ns() - t1;
+        if (crc != slot->crc)
+        {
+            ret = XFER_ERR_CRC;
+            break;
+        }
+        if (pwrite(out_fd, slot->raw, slot->raw_len, offset + stats->bytes) != (ssize_t)slot->raw_len)
+        {
+            ret = XFER_ERR_IO;
+            break;
+        }
+        stats->bytes += slot->raw_len;
+        stats->chunks++;
+        xfer_pipe_release(&p);
+    }
+    if (ret != 0)
+    {
+        // 接收线程可能正阻塞在 read 上，关掉连接把它叫醒；出错之后这个连接本来也不能再用了
+        shutdown(sock, SHUT_RDWR);
+        xfer_pipe_cancel(&p);
+    }
+    pthread_join(tid, NULL);
+    if (ret == 0)
+        ret = p.error != 0 ? p.error : stats->bytes == hdr->length ? 0 : XFER_ERR_PROTO;
+    xfer_pipe_free(&p);
+    return ret;
+}
+
+/**
+ * 客户端：请求 [offset, offset + length)（length 为 0 表示到文件末尾），收到的每一块校验通过后
+ * 用 pwrite 写到 out_fd 的同一位置。flags 可以带 XFER_FLAG_LZ 要求压缩传输。hdr 非空时写入服务端的文件头。
+ * 出错时 stats->bytes 是已经校验通过并写盘的字节数，从 offset + stats->bytes 处重新请求即可续传。
+ */
+int xfer_fetch(int sock, int out_fd, uint64_t offset, uint64_t length, uint32_t flags, xfer_header *hdr,
+               xfer_stats *stats)
+{
+    xfer_header h;
+    xfer_stats local;
+    if (hdr == NULL)
+        hdr = &h;
+    if (stats == NULL)
+        stats = &local;
+    memset(stats, 0, sizeof(*stats));
+
+    if (xfer_send_request(sock, offset, length, flags) == -1)
+        return XFER_ERR_IO;
+    int ret = xfer_recv_header(sock, hdr);
+    if (ret < 0)
+        return ret;
+    if (hdr->status == XFER_STATUS_RANGE)
+        return XFER_ERR_RANGE;
+    if (hdr->status != XFER_STATUS_OK || hdr->offset != offset)
+        return XFER_ERR_PROTO;
+    if (hdr->flags & XFER_FLAG_LZ)
+        return xfer_fetch_lz(sock, out_fd, offset, hdr, stats);
+
+    char *buf = malloc(hdr->chunk_size);
+    if (buf == NULL)
+        return XFER_ERR_IO;
+    while (1)
+    {
+        xfer_chunk ch;
+        if (xfer_read_full(sock, &ch, sizeof(ch)) == -1)
+        {
+            ret = XFER_ERR_IO;
+            break;
+        }
+        ch.len = ntohl(ch.len);
+        ch.crc = ntohl(ch.crc);
+        if (ch.len == 0)
+        {
+            // 结束块来得太早说明服务端那边出了问题
+            ret = stats->bytes == hdr->length ? 0 : XFER_ERR_PROTO;
+            break;
+        }
+        if (ch.len > hdr->chunk_size || stats->bytes + ch.len > hdr->length)
+        {
+            ret = XFER_ERR_PROTO;
+            break;
+        }
+        if (xfer_read_full(sock, buf, ch.len) == -1)
+        {
+            ret = XFER_ERR_IO;
+            break;
+        }
+
+        uint64_t t0 = xfer_now_ns();
+        uint32_t crc = crc32c(0, buf, ch.len);
+        stats->crc_ns += xfer_now_ns() - t0;
+        if (crc != ch.crc)
+        {
+            ret = XFER_ERR_CRC;
+            break;
+        }
+        if (pwrite(out_fd, buf, ch.len, offset + stats->bytes) != (ssize_t)ch.len)
+        {
+            ret = XFER_ERR_IO;
+            break;
+        }
+        stats->bytes += ch.len;
+        stats->wire_bytes += ch.len;
+        stats->chunks++;
+    }
+    free(buf);
+    return ret;
+}
+
+// 只取文件头（文件大小、块大小），连接可以接着用来请求数据
+int xfer_stat(int sock, xfer_header *hdr)
+{
+    xfer_chunk end;
+    if (xfer_send_request(sock, 0, 0, XFER_FLAG_STAT) == -1)
+        return XFER_ERR_IO;
+    int ret = xfer_recv_header(sock, hdr);
+    if (ret < 0)
+        return ret;
+    if (xfer_read_full(sock, &end, sizeof(end)) == -1)
+        return XFER_ERR_IO;
+    return hdr->status == XFER_STATUS_OK && end.len == 0 ? 0 : XFER_ERR_PROTO;
+}
+
+#endif /* file_xfer.h */
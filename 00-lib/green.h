@@ -0,0 +1,454 @@
+#ifndef _GREEN_H
+#define _GREEN_H 1
+
+/**
+ * 用户态协程（green thread）运行时：M 个协程跑在 N 个系统线程上，让 “一个连接一个线程” 的直线式代码
+ * （46-multi-thread/thread_server.c）可以服务上万个连接。
+ *
+ * - 每个协程有自己的栈，用 mmap 分配（默认 GREEN_STACK_SIZE），最低处留一页 PROT_NONE 做保护页，
+ *   栈溢出时直接段错误而不是悄悄改写别人的内存；物理内存只按实际用到的页分配，echo 这种逻辑只占一两页。
+ *   退出的协程的栈放进缓存，下一个协程直接复用，不用每次都 mmap / munmap；
+ * - 协程切换只保存 callee-saved 寄存器和栈指针（x86-64 上十几条指令），不进内核；
+ *   其他架构退回 ucontext（swapcontext 每次还要一次 sigprocmask 系统调用）；
+ * - green_read / green_write / green_accept 的用法和 read / write / accept 一样，fd 要设成非阻塞，
+ *   遇到 EAGAIN 就把 fd 登记到共享的 epoll 里（EPOLLONESHOT），切回调度器去跑别的协程，fd 就绪后再接着执行；
+ * - N 个调度线程共用一个就绪队列和一个 epoll：就绪队列空了就阻塞在 epoll_wait 上，
+ *   EPOLLONESHOT 保证一次就绪只有一个线程拿到，被唤醒的协程放进就绪队列，可能换到另一个线程上继续运行。
+ *
+ * 协程会在线程之间迁移，带来两个限制：
+ * - 登记 fd 必须等协程已经切出去之后由调度器来做，否则另一个线程可能在它还没切出去时就开始运行它（栈被两个线程同时用）；
+ * - 协程里不能跨 green_* 调用持有线程局部变量的地址（errno 除外，它每次都重新取地址），运行时内部读 TLS 都通过 noinline 函数。
+ *
+ *   green_init(4);
+ *   green_spawn(acceptor, &serv_sock);
+ *   green_run();       // 当前线程也成为调度线程之一，不返回
+ *
+ * 要用 pthread 和 ucontext，编译时加 -lpthread。
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#if !defined(__x86_64__)
+#include <ucontext.h>
+#endif
+
+#ifndef GREEN_STACK_SIZE
+#define GREEN_STACK_SIZE (64 * 1024)
+#endif
+#define GREEN_GUARD_SIZE 4096
+#define GREEN_STACK_CACHE 1024
+#define GREEN_MAX_THREADS 64
+#define GREEN_EPOLL_BATCH 64
+
+enum
+{
+    GREEN_RUNNING,
+    GREEN_YIELD, // 让出 CPU，放回就绪队列
+    GREEN_WAIT,  // 等 fd 就绪，由调度器登记到 epoll
+    GREEN_DONE   // 函数已返回，由调度器回收
+};
+
+typedef struct green_task
+{
+#if defined(__x86_64__)
+    void *sp; // 切出去时保存的栈指针，寄存器都压在栈上
+#else
+    ucontext_t uc;
+#endif
+    void (*fn)(void *);
+    void *arg;
+    char *stack; // mmap 得到的整块内存，包括保护页
+    int state;
+    int wait_fd;
+    uint32_t wait_events;
+    struct green_task *next;
+} green_task;
+
+// 每个调度线程一份
+typedef struct
+{
+#if defined(__x86_64__)
+    void *sched_sp;
+#else
+    ucontext_t sched_uc;
+#endif
+    green_task *current;
+    uint64_t switches; // 切换到协程的次数
+} green_worker;
+
+static struct
+{
+    pthread_mutex_t lock;
+    green_task *head, *tail; // 就绪队列
+    int epfd;
+    int wake_efd;   // 就绪队列里有了任务而有线程睡在 epoll_wait 里时，写它叫醒一个
+    int nthreads;
+    int idle;       // 正阻塞在 epoll_wait 里的调度线程数
+    int ntasks;     // 还没结束的协程数
+    char *stack_cache[GREEN_STACK_CACHE];
+    int ncached;
+    green_worker *workers[GREEN_MAX_THREADS];
+    int nworkers;
+} green_sched = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static __thread green_worker *green_tls_worker;
+
+#if defined(__x86_64__)
+/**
+ * void green_switch(void **save_sp, void *new_sp)
+ * 把 callee-saved 寄存器压到当前栈上，栈指针存进 *save_sp，换到 new_sp 上把寄存器弹出来，ret 到对方上次切出去的位置。
+ * caller-saved 寄存器按调用约定本来就由调用者保存，不用管。
+ */
+void green_switch(void **save_sp, void *new_sp);
+__asm__(".text\n"
+        ".globl green_switch\n"
+        ".type green_switch, @function\n"
+        "green_switch:\n"
+        "    pushq %rbp\n"
+        "    pushq %rbx\n"
+        "    pushq %r12\n"
+        "    pushq %r13\n"
+        "    pushq %r14\n"
+        "    pushq %r15\n"
+        "    movq %rsp, (%rdi)\n"
+        "    movq %rsi, %rsp\n"
+        "    popq %r15\n"
+        "    popq %r14\n"
+        "    popq %r13\n"
+        "    popq %r12\n"
+        "    popq %rbx\n"
+        "    popq %rbp\n"
+        "    ret\n"
+        ".size green_switch, .-green_switch\n");
+#endif
+
+// 读 TLS 的地方都走这个函数：协程切回来时可能已经换了线程，编译器不能沿用切换前算好的 TLS 地址
+__attribute__((noinline)) green_worker *green_self(void)
+{
+    __asm__ __volatile__("" ::: "memory");
+    return green_tls_worker;
+}
+
+// 当前协程切回调度器，返回时可能已经在另一个线程上
+void green_suspend(green_task *t)
+{
+    green_worker *w = green_self();
+#if defined(__x86_64__)
+    green_switch(&t->sp, w->sched_sp);
+#else
+    swapcontext(&t->uc, &w->sched_uc);
+#endif
+}
+
+void green_trampoline(void)
+{
+    green_task *t = green_self()->current;
+    t->fn(t->arg);
+    t->state = GREEN_DONE;
+    green_suspend(t);
+    abort(); // 已经结束的协程不会再被调度
+}
+
+// 放进就绪队列，有线程在 epoll_wait 里睡着时叫醒一个
+void green_ready(green_task *t)
+{
+    int wake;
+    t->next = NULL;
+    pthread_mutex_lock(&green_sched.lock);
+    if (green_sched.tail != NULL)
+        green_sched.tail->next = t;
+    else
+        green_sched.head = t;
+    green_sched.tail = t;
+    wake = green_sched.idle > 0;
+    pthread_mutex_unlock(&green_sched.lock);
+    if (wake)
+    {
+        uint64_t one = 1;
+        write(green_sched.wake_efd, &one, sizeof(one));
+    }
+}
+
+green_task *green_pop(void)
+{
+    pthread_mutex_lock(&green_sched.lock);
+    green_task *t = green_sched.head;
+    if (t != NULL)
+    {
+        green_sched.head = t->next;
+        if (green_sched.head == NULL)
+            green_sched.tail = NULL;
+    }
+    pthread_mutex_unlock(&green_sched.lock);
+    return t;
+}
+
+char *green_stack_alloc(void)
+{
+    char *stack = NULL;
+    pthread_mutex_lock(&green_sched.lock);
+    if (green_sched.ncached > 0)
+        stack = green_sched.stack_cache[--green_sched.ncached];
+    pthread_mutex_unlock(&green_sched.lock);
+    if (stack != NULL)
+        return stack;
+
+    stack = mmap(NULL, GREEN_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (stack == MAP_FAILED)
+        return NULL;
+    // 栈向下增长，保护页放在最低处
+    mprotect(stack, GREEN_GUARD_SIZE, PROT_NONE);
+    return stack;
+}
+
+void green_stack_free(char *stack)
+{
+    pthread_mutex_lock(&green_sched.lock);
+    if (green_sched.ncached < GREEN_STACK_CACHE)
+    {
+        green_sched.stack_cache[green_sched.ncached++] = stack;
+        stack = NULL;
+    }
+    pthread_mutex_unlock(&green_sched.lock);
+    if (stack != NULL)
+        munmap(stack, GREEN_STACK_SIZE);
+}
+
+int green_init(int nthreads)
+{
+    if (nthreads <= 0 || nthreads > GREEN_MAX_THREADS)
+        return -1;
+    green_sched.nthreads = nthreads;
+    green_sched.epfd = epoll_create1(EPOLL_CLOEXEC);
+    green_sched.wake_efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (green_sched.epfd == -1 || green_sched.wake_efd == -1)
+        return -1;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    return epoll_ctl(green_sched.epfd, EPOLL_CTL_ADD, green_sched.wake_efd, &ev);
+}
+
+// 创建协程，放进就绪队列，失败返回 -1。可以在 green_run 之前调用，也可以在协程里调用
+int green_spawn(void (*fn)(void *), void *arg)
+{
+    green_task *t = calloc(1, sizeof(green_task));
+    if (t == NULL)
+        return -1;
+    t->stack = green_stack_alloc();
+    if (t->stack == NULL)
+    {
+        free(t);
+        return -1;
+    }
+    t->fn = fn;
+    t->arg = arg;
+
+#if defined(__x86_64__)
+    // 初始栈：6 个寄存器的占位 + green_switch 的返回地址（指向 green_trampoline）+ 8 字节空位，
+    // ret 之后 rsp % 16 == 8，和正常 call 进入函数时一样
+    uintptr_t top = ((uintptr_t)t->stack + GREEN_STACK_SIZE) & ~(uintptr_t)15;
+    void **sp = (void **)(top - 16);
+    sp[0] = (void *)green_trampoline;
+    sp[1] = NULL;
+    sp -= 6;
+    memset(sp, 0, sizeof(void *) * 6);
+    t->sp = sp;
+#else
+    getcontext(&t->uc);
+    t->uc.uc_stack.ss_sp = t->stack + GREEN_GUARD_SIZE;
+    t->uc.uc_stack.ss_size = GREEN_STACK_SIZE - GREEN_GUARD_SIZE;
+    t->uc.uc_link = NULL;
+    makecontext(&t->uc, green_trampoline, 0);
+#endif
+
+    __atomic_add_fetch(&green_sched.ntasks, 1, __ATOMIC_RELAXED);
+    green_ready(t);
+    return 0;
+}
+
+// 在协程里调用，让出 CPU，排到就绪队列末尾
+void green_yield(void)
+{
+    green_task *t = green_self()->current;
+    t->state = GREEN_YIELD;
+    green_suspend(t);
+}
+
+// 在协程里调用，等 fd 上出现 events（EPOLLIN / EPOLLOUT），出错或挂断也会返回
+void green_wait_fd(int fd, uint32_t events)
+{
+    green_task *t = green_self()->current;
+    t->state = GREEN_WAIT;
+    t->wait_fd = fd;
+    t->wait_events = events;
+    green_suspend(t);
+}
+
+// 协程切出去之后，由调度器根据它的状态收尾
+void green_after_switch(green_task *t)
+{
+    switch (t->state)
+    {
+    case GREEN_YIELD:
+        green_ready(t);
+        break;
+    case GREEN_WAIT:
+    {
+        struct epoll_event ev;
+        ev.events = t->wait_events | EPOLLONESHOT;
+        ev.data.ptr = t;
+        // fd 第一次等待时还没加进 epoll；之后 ONESHOT 触发过的 fd 仍在里面，只需要重新打开
+        // 这一步之后 t 随时可能被别的线程拿去运行，不能再碰它
+        if (epoll_ctl(green_sched.epfd, EPOLL_CTL_MOD, t->wait_fd, &ev) == -1 &&
+            (errno != ENOENT || epoll_ctl(green_sched.epfd, EPOLL_CTL_ADD, t->wait_fd, &ev) == -1))
+            green_ready(t); // fd 无效，让协程醒来自己去碰到错误
+        break;
+    }
+    case GREEN_DONE:
+        green_stack_free(t->stack);
+        free(t);
+        __atomic_sub_fetch(&green_sched.ntasks, 1, __ATOMIC_RELAXED);
+        break;
+    }
+}
+
+// 就绪队列空了：阻塞在 epoll 上，把就绪的协程放回队列
+void green_poll(int timeout)
+{
+    struct epoll_event evs[GREEN_EPOLL_BATCH];
+
+    pthread_mutex_lock(&green_sched.lock);
+    // 加锁检查，避免刚有任务入队、入队的一方又没看到我们睡着
+    if (green_sched.head != NULL)
+    {
+        pthread_mutex_unlock(&green_sched.lock);
+        return;
+    }
+    green_sched.idle++;
+    pthread_mutex_unlock(&green_sched.lock);
+
+    int n = epoll_wait(green_sched.epfd, evs, GREEN_EPOLL_BATCH, timeout);
+
+    pthread_mutex_lock(&green_sched.lock);
+    green_sched.idle--;
+    pthread_mutex_unlock(&green_sched.lock);
+
+    for (int i = 0; i < n; i++)
+    {
+        green_task *t = evs[i].data.ptr;
+        if (t == NULL)
+        {
+            uint64_t cnt;
+            read(green_sched.wake_efd, &cnt, sizeof(cnt));
+            continue;
+        }
+        green_ready(t);
+    }
+}
+
+void *green_worker_main(void *arg)
+{
+    (void)arg;
+    green_worker *w = calloc(1, sizeof(green_worker));
+    green_tls_worker = w;
+    pthread_mutex_lock(&green_sched.lock);
+    green_sched.workers[green_sched.nworkers++] = w;
+    pthread_mutex_unlock(&green_sched.lock);
+
+    while (1)
+    {
+        green_task *t = green_pop();
+        if (t == NULL)
+        {
+            green_poll(-1);
+            continue;
+        }
+        w->current = t;
+        w->switches++;
+        t->state = GREEN_RUNNING;
+#if defined(__x86_64__)
+        green_switch(&w->sched_sp, t->sp);
+#else
+        swapcontext(&w->sched_uc, &t->uc);
+#endif
+        w->current = NULL;
+        green_after_switch(t);
+    }
+    return NULL;
+}
+
+// 启动 nthreads - 1 个调度线程，当前线程也开始调度，不返回
+void green_run(void)
+{
+    pthread_t tid;
+    for (int i = 1; i < green_sched.nthreads; i++)
+        pthread_create(&tid, NULL, green_worker_main, NULL);
+    green_worker_main(NULL);
+}
+
+// 所有调度线程累计切换到协程的次数
+uint64_t green_switch_count(void)
+{
+    uint64_t total = 0;
+    pthread_mutex_lock(&green_sched.lock);
+    for (int i = 0; i < green_sched.nworkers; i++)
+        total += green_sched.workers[i]->switches;
+    pthread_mutex_unlock(&green_sched.lock);
+    return total;
+}
+
+int green_task_count(void)
+{
+    return __atomic_load_n(&green_sched.ntasks, __ATOMIC_RELAXED);
+}
+
+ssize_t green_read(int fd, void *buf, size_t len)
+{
+    while (1)
+    {
+        ssize_t n = read(fd, buf, len);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return n;
+        green_wait_fd(fd, EPOLLIN);
+    }
+}
+
+// 和阻塞 write 一样写完全部数据才返回，出错返回 -1
+ssize_t green_write(int fd, const void *buf, size_t len)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = write(fd, (const char *)buf + done, len - done);
+        if (n >= 0)
+            done += n;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            green_wait_fd(fd, EPOLLOUT);
+        else
+            return -1;
+    }
+    return done;
+}
+
+// 返回的连接已经是非阻塞的
+int green_accept(int fd, struct sockaddr *addr, socklen_t *addrlen)
+{
+    while (1)
+    {
+        int clnt = accept4(fd, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clnt >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return clnt;
+        green_wait_fd(fd, EPOLLIN);
+    }
+}
+
+#endif /* green.h */
@@ -0,0 +1,119 @@
+#ifndef _HOT_RESTART_H
+#define _HOT_RESTART_H 1
+
+/**
+ * 热重启：新版本的进程从正在运行的进程手里接过监听套接字，旧进程不再 accept，处理完已有的连接后退出。
+ *
+ * 直接停掉旧进程再启动新进程，中间这段时间 connect 会被拒绝（ECONNREFUSED），
+ * 旧的监听套接字关闭时已完成连接队列里还没 accept 的连接也会被 RST；没设置 SO_REUSEADDR 的话，
+ * 新进程还可能因为端口上有 TIME_WAIT 连接 bind 失败（见 22-time-wait）。
+ * 换一种做法，监听套接字根本不关闭：旧进程用 SCM_RIGHTS（见 unix_sock.h 的 send_fds）把它交给新进程，
+ * 两个进程的 fd 指向内核里同一个监听套接字，监听队列一直都在，交接期间到达的连接在队列里等着被新进程取走。
+ *
+ * 交接通过控制套接字 UNIX_SOCK_DIR/netsock-<port>.ctl 进行：
+ *   新进程                          旧进程
+ *   hr_takeover: connect，发 'U'  →  hr_handoff: accept，读到 'U'
+ *                                 ←  send_fds 发送监听套接字
+ *   把监听套接字加入事件循环
+ *   hr_ready: 发 'R'              →  收到 'R'：从事件循环里删掉监听套接字并 close，开始排空连接
+ *   hr_listen: 接管控制套接字的路径，等待下一次升级
+ * 新进程在发 'R' 之前崩溃或者超时没有回应时，旧进程收到的是 EOF / 超时，照常继续服务，这次升级作废。
+ * 旧进程 close 监听套接字之后，内核里的监听套接字还被新进程引用着，不会关闭。
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include "unix_sock.h"
+
+// 等待对方回应的时间，旧进程在这段时间里不处理连接上的事件（新连接在监听队列里等着，不会被拒绝）
+#define HR_TIMEOUT_MS 5000
+
+// 端口 port 对应的控制套接字路径
+void hr_path(char *path, size_t len, int port)
+{
+    snprintf(path, len, "%s/netsock-%d.ctl", UNIX_SOCK_DIR, port);
+}
+
+/**
+ * 在控制套接字上监听，等待新进程来接管，返回非阻塞的监听套接字，失败返回 -1。
+ * 路径上已有的文件会被删掉，所以旧进程的控制套接字在新进程调用这个函数之后就连不上了。
+ */
+int hr_listen(int port)
+{
+    char path[108];
+    hr_path(path, sizeof(path), port);
+    int sock = unix_listen(path, 1);
+    if (sock != -1)
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    return sock;
+}
+
+// 在 timeout_ms 内从 sock 读 1 字节，读到 expect 返回 0
+int hr_expect(int sock, char expect, int timeout_ms)
+{
+    char c;
+    struct pollfd pfd = {sock, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) != 1 || read(sock, &c, 1) != 1 || c != expect)
+        return -1;
+    return 0;
+}
+
+/**
+ * 新进程调用：向正在运行的进程要监听套接字，最多 max_fds 个，*nfds 为收到的个数。
+ * 返回控制连接，收到的监听套接字加入事件循环之后用它调用 hr_ready；
+ * 没有正在运行的进程（连不上控制套接字）或者对方没有给出监听套接字时返回 -1。
+ */
+int hr_takeover(int port, int *fds, int max_fds, int *nfds)
+{
+    char path[108];
+    hr_path(path, sizeof(path), port);
+    *nfds = 0;
+    int ctl = unix_connect(path);
+    if (ctl == -1)
+        return -1;
+
+    struct timeval tv = {HR_TIMEOUT_MS / 1000, HR_TIMEOUT_MS % 1000 * 1000};
+    setsockopt(ctl, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char c;
+    if (send(ctl, "U", 1, MSG_NOSIGNAL) != 1 || recv_fds(ctl, fds, max_fds, nfds, &c, 1) != 1 || *nfds == 0)
+    {
+        for (int i = 0; i < *nfds; i++)
+            close(fds[i]);
+        *nfds = 0;
+        close(ctl);
+        return -1;
+    }
+    return ctl;
+}
+
+// 新进程调用：已经开始在收到的监听套接字上 accept，通知旧进程退出监听，成功返回 0
+int hr_ready(int ctl)
+{
+    int ret = send(ctl, "R", 1, MSG_NOSIGNAL) == 1 ? 0 : -1;
+    close(ctl);
+    return ret;
+}
+
+/**
+ * 旧进程调用：控制套接字 ctl_listen 可读时，把 nfds 个监听套接字交给新进程。
+ * 返回 0 表示新进程已经接管，调用方应当停止 accept、关闭这些监听套接字并排空已有的连接；
+ * 返回 -1 表示交接没有完成（新进程出错或超时），调用方照常服务。
+ */
+int hr_handoff(int ctl_listen, const int *fds, int nfds, int timeout_ms)
+{
+    int ctl = accept(ctl_listen, NULL, NULL);
+    if (ctl == -1)
+        return -1;
+
+    int ret = -1;
+    if (hr_expect(ctl, 'U', timeout_ms) == 0 && send_fds(ctl, fds, nfds, "L", 1) == 1)
+        ret = hr_expect(ctl, 'R', timeout_ms);
+    close(ctl);
+    return ret;
+}
+
+#endif /* hot_restart.h */
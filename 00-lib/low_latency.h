@@ -0,0 +1,58 @@
+#ifndef _LOW_LATENCY_H
+#define _LOW_LATENCY_H 1
+
+/**
+ * 低延迟模式用到的几个小工具。
+ *
+ * 阻塞在 epoll_wait(-1) 里的线程，数据到达后要经过 软中断 -> 唤醒 -> 调度 -> 切换回用户态，
+ * 这一段通常要几微秒到几十微秒，而且抖动很大。低延迟模式用 CPU 换延迟：
+ * - 事件处理完后先用 epoll_wait(0) 自旋一段时间（spin budget），这段时间里来的消息不需要唤醒；
+ * - SO_BUSY_POLL：阻塞读、poll/epoll 时让内核直接去轮询网卡队列，而不是等中断，
+ *   SO_PREFER_BUSY_POLL 进一步让忙轮询优先于软中断处理（需要网卡驱动支持 NAPI，回环设备上没有效果）；
+ * - 把循环线程绑在一个 CPU 上，避免被迁移后 cache 失效，也方便把其他任务挪走（isolcpus 等）。
+ *
+ * SO_BUSY_POLL 设置得比 net.core.busy_read 大、以及打开 SO_PREFER_BUSY_POLL 都需要 CAP_NET_ADMIN，
+ * 没有权限时函数返回 -1，调用方可以忽略，自旋和绑核照样有效。
+ */
+
+// sched_setaffinity 需要 _GNU_SOURCE，使用者要在包含任何系统头文件之前定义它
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+// 自旋预算要按微秒算，COARSE 时钟的精度不够
+uint64_t ll_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * 给套接字打开忙轮询，usec 为每次最多轮询的微秒数。
+ * 设置在监听套接字上时，accept 得到的连接会继承这个值。
+ */
+int ll_set_busy_poll(int fd, int usec)
+{
+    int ret = setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec));
+    int prefer = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) == -1)
+        ret = -1;
+    return ret;
+}
+
+// 把调用线程绑定到 cpu 上
+int ll_pin_to_cpu(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set);
+}
+
+#endif /* low_latency.h */
@@ -0,0 +1,117 @@
+#ifndef _MUX_H
+#define _MUX_H 1
+
+/**
+ * 统一的 I/O 多路复用接口，select / poll / epoll / io_uring(poll) 四种后端在运行时按名字选择。
+ * 上层的连接处理代码只和 mux_xxx 函数打交道，比较不同后端时，差别就只剩后端本身的开销。
+ *
+ * 语义统一为 “条件触发”（level-triggered）：只要 fd 仍然可读/可写，下一次 mux_wait 还会报告它。
+ *
+ *   mux *m = mux_create("epoll");
+ *   mux_add(m, fd, MUX_READ);
+ *   int n = mux_wait(m, events, MAX_EVENTS, -1);
+ *   for (int i = 0; i < n; i++) ... events[i].fd, events[i].events ...
+ *   mux_del(m, fd);   // 必须在 close(fd) 之前调用
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MUX_READ 0x1
+#define MUX_WRITE 0x2
+#define MUX_ERROR 0x4 // 错误或挂断，只会出现在返回的事件里
+
+typedef struct
+{
+    int fd;
+    int events;
+} mux_event;
+
+typedef struct mux mux;
+
+typedef struct
+{
+    const char *name;
+    int (*init)(mux *m);
+    int (*add)(mux *m, int fd, int events);
+    int (*mod)(mux *m, int fd, int events);
+    int (*del)(mux *m, int fd);
+    // 返回就绪事件数，超时返回 0，出错返回 -1（errno 有效，被信号打断时为 EINTR）
+    int (*wait)(mux *m, mux_event *evs, int max, int timeout_ms);
+    void (*destroy)(mux *m);
+} mux_ops;
+
+struct mux
+{
+    const mux_ops *ops;
+    void *impl;
+};
+
+#include "mux_select.h"
+#include "mux_poll.h"
+#include "mux_epoll.h"
+#include "mux_uring.h"
+
+static const mux_ops *mux_backends[] = {
+    &select_mux_ops,
+    &poll_mux_ops,
+    &epoll_mux_ops,
+    &uring_mux_ops,
+};
+
+#define MUX_BACKEND_COUNT (int)(sizeof(mux_backends) / sizeof(mux_backends[0]))
+
+// 按名字创建后端实例，名字不存在或初始化失败时返回 NULL
+mux *mux_create(const char *name)
+{
+    for (int i = 0; i < MUX_BACKEND_COUNT; i++)
+    {
+        if (strcmp(mux_backends[i]->name, name) != 0)
+            continue;
+
+        mux *m = calloc(1, sizeof(mux));
+        if (m == NULL)
+            return NULL;
+        m->ops = mux_backends[i];
+        if (m->ops->init(m) == -1)
+        {
+            free(m);
+            return NULL;
+        }
+        return m;
+    }
+    return NULL;
+}
+
+int mux_add(mux *m, int fd, int events)
+{
+    return m->ops->add(m, fd, events);
+}
+
+int mux_mod(mux *m, int fd, int events)
+{
+    return m->ops->mod(m, fd, events);
+}
+
+int mux_del(mux *m, int fd)
+{
+    return m->ops->del(m, fd);
+}
+
+int mux_wait(mux *m, mux_event *evs, int max, int timeout_ms)
+{
+    return m->ops->wait(m, evs, max, timeout_ms);
+}
+
+const char *mux_name(const mux *m)
+{
+    return m->ops->name;
+}
+
+void mux_destroy(mux *m)
+{
+    m->ops->destroy(m);
+    free(m);
+}
+
+#endif /* mux.h */
@@ -0,0 +1,106 @@
+#ifndef _MUX_EPOLL_H
+#define _MUX_EPOLL_H 1
+
+/**
+ * epoll 后端，使用默认的条件触发。
+ * 只由 mux.h 包含。
+ */
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+typedef struct
+{
+    int epfd;
+    struct epoll_event *ep_events;
+    int ep_size;
+} epoll_mux;
+
+uint32_t epoll_mux_to_events(int events)
+{
+    return ((events & MUX_READ) ? EPOLLIN : 0) | ((events & MUX_WRITE) ? EPOLLOUT : 0);
+}
+
+int epoll_mux_init(mux *m)
+{
+    epoll_mux *em = calloc(1, sizeof(epoll_mux));
+    if (em == NULL)
+        return -1;
+    em->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (em->epfd == -1)
+    {
+        free(em);
+        return -1;
+    }
+    m->impl = em;
+    return 0;
+}
+
+int epoll_mux_add(mux *m, int fd, int events)
+{
+    epoll_mux *em = m->impl;
+    struct epoll_event event;
+    event.events = epoll_mux_to_events(events);
+    event.data.fd = fd;
+    return epoll_ctl(em->epfd, EPOLL_CTL_ADD, fd, &event);
+}
+
+int epoll_mux_mod(mux *m, int fd, int events)
+{
+    epoll_mux *em = m->impl;
+    struct epoll_event event;
+    event.events = epoll_mux_to_events(events);
+    event.data.fd = fd;
+    return epoll_ctl(em->epfd, EPOLL_CTL_MOD, fd, &event);
+}
+
+int epoll_mux_del(mux *m, int fd)
+{
+    epoll_mux *em = m->impl;
+    return epoll_ctl(em->epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int epoll_mux_wait(mux *m, mux_event *evs, int max, int timeout_ms)
+{
+    epoll_mux *em = m->impl;
+
+    if (max > em->ep_size)
+    {
+        struct epoll_event *ep_events = realloc(em->ep_events, sizeof(struct epoll_event) * max);
+        if (ep_events == NULL)
+            return -1;
+        em->ep_events = ep_events;
+        em->ep_size = max;
+    }
+
+    int n = epoll_wait(em->epfd, em->ep_events, max, timeout_ms);
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t re = em->ep_events[i].events;
+        evs[i].fd = em->ep_events[i].data.fd;
+        evs[i].events = ((re & EPOLLIN) ? MUX_READ : 0) | ((re & EPOLLOUT) ? MUX_WRITE : 0) |
+                        ((re & (EPOLLERR | EPOLLHUP)) ? MUX_ERROR : 0);
+    }
+    return n;
+}
+
+void epoll_mux_destroy(mux *m)
+{
+    epoll_mux *em = m->impl;
+    close(em->epfd);
+    free(em->ep_events);
+    free(em);
+}
+
+static const mux_ops epoll_mux_ops = {
+    "epoll",
+    epoll_mux_init,
+    epoll_mux_add,
+    epoll_mux_mod,
+    epoll_mux_del,
+    epoll_mux_wait,
+    epoll_mux_destroy,
+};
+
+#endif /* mux_epoll.h */
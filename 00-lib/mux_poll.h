@@ -0,0 +1,154 @@
+#ifndef _MUX_POLL_H
+#define _MUX_POLL_H 1
+
+/**
+ * poll 后端：pollfd 数组始终是紧凑的，再加一张 fd -> 下标 的表，
+ * 这样 add / mod / del 都是 O(1)，del 时用末尾元素填补空洞。
+ * mux_wait 已经把结果拷贝到调用方的数组里，所以两次 wait 之间随意 del 不会影响遍历。
+ * 只由 mux.h 包含。
+ */
+
+#include <poll.h>
+
+typedef struct
+{
+    struct pollfd *fds;
+    int nfds;
+    int capacity;
+    int *index;     // index[fd] 为 fd 在 fds 中的下标，-1 表示未注册
+    int index_size;
+} poll_mux;
+
+short poll_mux_to_events(int events)
+{
+    return ((events & MUX_READ) ? POLLIN : 0) | ((events & MUX_WRITE) ? POLLOUT : 0);
+}
+
+int poll_mux_init(mux *m)
+{
+    poll_mux *pm = calloc(1, sizeof(poll_mux));
+    if (pm == NULL)
+        return -1;
+    pm->capacity = 128;
+    pm->fds = malloc(sizeof(struct pollfd) * pm->capacity);
+    pm->index_size = 1024;
+    pm->index = malloc(sizeof(int) * pm->index_size);
+    if (pm->fds == NULL || pm->index == NULL)
+        return -1;
+    memset(pm->index, -1, sizeof(int) * pm->index_size);
+    m->impl = pm;
+    return 0;
+}
+
+int poll_mux_add(mux *m, int fd, int events)
+{
+    poll_mux *pm = m->impl;
+
+    if (fd >= pm->index_size)
+    {
+        int size = pm->index_size * 2;
+        while (size <= fd)
+            size *= 2;
+        int *index = realloc(pm->index, sizeof(int) * size);
+        if (index == NULL)
+            return -1;
+        memset(index + pm->index_size, -1, sizeof(int) * (size - pm->index_size));
+        pm->index = index;
+        pm->index_size = size;
+    }
+    if (pm->index[fd] >= 0)
+    {
+        errno = EEXIST;
+        return -1;
+    }
+    if (pm->nfds == pm->capacity)
+    {
+        struct pollfd *fds = realloc(pm->fds, sizeof(struct pollfd) * pm->capacity * 2);
+        if (fds == NULL)
+            return -1;
+        pm->fds = fds;
+        pm->capacity *= 2;
+    }
+
+    int idx = pm->nfds++;
+    pm->fds[idx].fd = fd;
+    pm->fds[idx].events = poll_mux_to_events(events);
+    pm->fds[idx].revents = 0;
+    pm->index[fd] = idx;
+    return 0;
+}
+
+int poll_mux_mod(mux *m, int fd, int events)
+{
+    poll_mux *pm = m->impl;
+    if (fd >= pm->index_size || pm->index[fd] < 0)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    pm->fds[pm->index[fd]].events = poll_mux_to_events(events);
+    return 0;
+}
+
+int poll_mux_del(mux *m, int fd)
+{
+    poll_mux *pm = m->impl;
+    if (fd >= pm->index_size || pm->index[fd] < 0)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    int idx = pm->index[fd];
+    int last = --pm->nfds;
+    if (idx != last)
+    {
+        pm->fds[idx] = pm->fds[last];
+        pm->index[pm->fds[idx].fd] = idx;
+    }
+    pm->index[fd] = -1;
+    return 0;
+}
+
+int poll_mux_wait(mux *m, mux_event *evs, int max, int timeout_ms)
+{
+    poll_mux *pm = m->impl;
+
+    int ready = poll(pm->fds, pm->nfds, timeout_ms);
+    if (ready <= 0)
+        return ready;
+
+    int n = 0;
+    // 处理完 poll 返回的就绪数量就停止扫描
+    for (int i = 0; i < pm->nfds && n < ready && n < max; i++)
+    {
+        short re = pm->fds[i].revents;
+        if (re == 0)
+            continue;
+        evs[n].fd = pm->fds[i].fd;
+        evs[n].events = ((re & POLLIN) ? MUX_READ : 0) | ((re & POLLOUT) ? MUX_WRITE : 0) |
+                        ((re & (POLLERR | POLLHUP | POLLNVAL)) ? MUX_ERROR : 0);
+        n++;
+    }
+    return n;
+}
+
+void poll_mux_destroy(mux *m)
+{
+    poll_mux *pm = m->impl;
+    free(pm->fds);
+    free(pm->index);
+    free(pm);
+}
+
+static const mux_ops poll_mux_ops = {
+    "poll",
+    poll_mux_init,
+    poll_mux_add,
+    poll_mux_mod,
+    poll_mux_del,
+    poll_mux_wait,
+    poll_mux_destroy,
+};
+
+#endif /* mux_poll.h */
@@ -0,0 +1,134 @@
+#ifndef _MUX_SELECT_H
+#define _MUX_SELECT_H 1
+
+/**
+ * select 后端，基于 fd_bitmap.h，没有 FD_SETSIZE 的限制。
+ * 只由 mux.h 包含。
+ */
+
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include "fd_bitmap.h"
+
+typedef struct
+{
+    fd_bitmap reads, writes;         // 关注的事件
+    fd_bitmap ready_r, ready_w;      // select 返回的就绪集合
+    int fd_max;
+} select_mux;
+
+int select_mux_init(mux *m)
+{
+    select_mux *sm = calloc(1, sizeof(select_mux));
+    if (sm == NULL)
+        return -1;
+    if (fd_bitmap_init(&sm->reads, FD_SETSIZE) == -1 || fd_bitmap_init(&sm->writes, FD_SETSIZE) == -1 ||
+        fd_bitmap_init(&sm->ready_r, FD_SETSIZE) == -1 || fd_bitmap_init(&sm->ready_w, FD_SETSIZE) == -1)
+        return -1;
+    sm->fd_max = -1;
+    m->impl = sm;
+    return 0;
+}
+
+int select_mux_mod(mux *m, int fd, int events)
+{
+    select_mux *sm = m->impl;
+    if (fd_bitmap_reserve(&sm->reads, fd) == -1 || fd_bitmap_reserve(&sm->writes, fd) == -1)
+        return -1;
+
+    if (events & MUX_READ)
+        fd_bitmap_set(&sm->reads, fd);
+    else
+        fd_bitmap_clr(&sm->reads, fd);
+    if (events & MUX_WRITE)
+        fd_bitmap_set(&sm->writes, fd);
+    else
+        fd_bitmap_clr(&sm->writes, fd);
+
+    if (fd > sm->fd_max)
+        sm->fd_max = fd;
+    return 0;
+}
+
+int select_mux_add(mux *m, int fd, int events)
+{
+    return select_mux_mod(m, fd, events);
+}
+
+int select_mux_del(mux *m, int fd)
+{
+    select_mux *sm = m->impl;
+    fd_bitmap_clr(&sm->reads, fd);
+    fd_bitmap_clr(&sm->writes, fd);
+    while (sm->fd_max >= 0 && !fd_bitmap_isset(&sm->reads, sm->fd_max) && !fd_bitmap_isset(&sm->writes, sm->fd_max))
+        sm->fd_max--;
+    return 0;
+}
+
+int select_mux_wait(mux *m, mux_event *evs, int max, int timeout_ms)
+{
+    select_mux *sm = m->impl;
+    int nfds = sm->fd_max + 1;
+    struct timeval tv, *ptv = NULL;
+
+    fd_bitmap_copy(&sm->ready_r, &sm->reads, nfds);
+    fd_bitmap_copy(&sm->ready_w, &sm->writes, nfds);
+    // select 会改写 timeout，每次都重新设置
+    if (timeout_ms >= 0)
+    {
+        tv.tv_sec = timeout_ms / 1000;
+        tv.tv_usec = (timeout_ms % 1000) * 1000;
+        ptv = &tv;
+    }
+
+    int ready = select(nfds, fd_bitmap_as_fdset(&sm->ready_r), fd_bitmap_as_fdset(&sm->ready_w), NULL, ptv);
+    if (ready <= 0)
+        return ready;
+
+    /**
+     * 同一个 fd 可能同时可读可写，select 的返回值会把它算两次，
+     * 所以按字把两个集合合并后再用 ctz 遍历，一个 fd 只产生一个事件。
+     */
+    int n = 0;
+    int nwords = (nfds + FD_BITMAP_WORD_BITS - 1) / FD_BITMAP_WORD_BITS;
+    for (int w = 0; w < nwords && n < max && ready > 0; w++)
+    {
+        unsigned long r = sm->ready_r.words[w], wr = sm->ready_w.words[w];
+        unsigned long bits = r | wr;
+        while (bits != 0 && n < max)
+        {
+            int b = __builtin_ctzl(bits);
+            unsigned long mask = 1ul << b;
+            bits &= bits - 1;
+
+            evs[n].fd = w * FD_BITMAP_WORD_BITS + b;
+            evs[n].events = ((r & mask) ? MUX_READ : 0) | ((wr & mask) ? MUX_WRITE : 0);
+            ready -= ((r & mask) != 0) + ((wr & mask) != 0);
+            n++;
+        }
+    }
+    return n;
+}
+
+void select_mux_destroy(mux *m)
+{
+    select_mux *sm = m->impl;
+    fd_bitmap_free(&sm->reads);
+    fd_bitmap_free(&sm->writes);
+    fd_bitmap_free(&sm->ready_r);
+    fd_bitmap_free(&sm->ready_w);
+    free(sm);
+}
+
+static const mux_ops select_mux_ops = {
+    "select",
+    select_mux_init,
+    select_mux_add,
+    select_mux_mod,
+    select_mux_del,
+    select_mux_wait,
+    select_mux_destroy,
+};
+
+#endif /* mux_select.h */
@@ -0,0 +1,413 @@
+#ifndef _MUX_URING_H
+#define _MUX_URING_H 1
+
+/**
+ * io_uring 后端，只用到了 IORING_OP_POLL_ADD（把 io_uring 当作多路复用器），
+ * 直接用 io_uring_setup / io_uring_enter 系统调用和 mmap 出来的环，不依赖 liburing。
+ *
+ * - 每个 fd 提交一个一次性的 POLL_ADD，完成（就绪）后在下一次 mux_wait 时重新提交。
+ *   重新提交时内核会立即检查一次就绪状态，所以整体仍是条件触发；
+ *   多次性（multishot）poll 只在有新的唤醒时才产生完成事件，读不完的数据会被 “卡住”，不适合这里的语义。
+ * - 重新提交 POLL_ADD 和等待完成是同一次 io_uring_enter，批量提交，一轮只有一次系统调用。
+ * - user_data = (代数 << 32) | fd，mod / del 时代数加一，并提交 POLL_REMOVE 取消旧的请求，
+ *   之后才到达的旧完成事件因为代数对不上会被丢弃，所以 del 之后立刻 close 并复用 fd 号也不会串。
+ *   代数只用低 30 位，最高两位留给 POLL_REMOVE 和 TIMEOUT 自己的完成事件。
+ * - 和 epoll / poll 后端一样，mod 成 0 个事件的 fd 仍然是注册着的，出错和挂断照样会报告。
+ * - 带超时的等待用 IORING_ENTER_EXT_ARG（5.11 起）；更老的内核没有这个特性，
+ *   改为随 POLL_ADD 一起提交一个 IORING_OP_TIMEOUT，到时间或者有任何完成事件时它就结束。
+ * 只由 mux.h 包含。
+ */
+
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_MUX_ENTRIES 4096
+#define URING_MUX_REMOVE_TAG (1ull << 63)  // POLL_REMOVE 自己的完成事件
+#define URING_MUX_TIMEOUT_TAG (1ull << 62) // 老内核上代替 EXT_ARG 的 TIMEOUT 的完成事件
+#define URING_MUX_GEN_MASK 0x3fffffffu
+
+typedef struct
+{
+    int registered; // 是否已经 add（还没有 del）
+    int events;     // 关注的事件，可以是 0：只报告出错和挂断
+    uint32_t gen;   // 当前有效请求的代数
+    int armed;    // 是否有一个 POLL_ADD 正在内核里等待
+    int queued;   // 是否已经在 arm_list 里
+} uring_fd_state;
+
+typedef struct
+{
+    int ring_fd;
+    void *ring_ptr;
+    size_t ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    int ext_arg; // 内核支持 IORING_ENTER_EXT_ARG
+    uint32_t next_gen;
+    uring_fd_state *fds;
+    int fds_size;
+    int *arm_list; // 等待（重新）提交 POLL_ADD 的 fd
+    int arm_cnt, arm_cap;
+} uring_mux;
+
+int uring_mux_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+    return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+int uring_mux_init(mux *m)
+{
+    uring_mux *um = calloc(1, sizeof(uring_mux));
+    if (um == NULL)
+        return -1;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    um->ring_fd = syscall(__NR_io_uring_setup, URING_MUX_ENTRIES, &p);
+    if (um->ring_fd < 0)
+    {
+        free(um);
+        return -1;
+    }
+    // 老内核（5.4 以前）SQ 和 CQ 需要分别 mmap，这里只支持单次 mmap 的新内核
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        close(um->ring_fd);
+        free(um);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    um->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    um->ring_ptr = mmap(NULL, um->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        um->ring_fd, IORING_OFF_SQ_RING);
+    um->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    um->sqes = mmap(NULL, um->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    um->ring_fd, IORING_OFF_SQES);
+    if (um->ring_ptr == MAP_FAILED || um->sqes == MAP_FAILED)
+    {
+        close(um->ring_fd);
+        free(um);
+        return -1;
+    }
+
+    char *ring = um->ring_ptr;
+    um->sq_head = (unsigned *)(ring + p.sq_off.head);
+    um->sq_tail = (unsigned *)(ring + p.sq_off.tail);
+    um->sq_mask = (unsigned *)(ring + p.sq_off.ring_mask);
+    um->sq_array = (unsigned *)(ring + p.sq_off.array);
+    um->sq_entries = p.sq_entries;
+    um->cq_head = (unsigned *)(ring + p.cq_off.head);
+    um->cq_tail = (unsigned *)(ring + p.cq_off.tail);
+    um->cq_mask = (unsigned *)(ring + p.cq_off.ring_mask);
+    um->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+    um->ext_arg = (p.features & IORING_FEAT_EXT_ARG) != 0;
+    // SQ 的间接数组固定为恒等映射，第 i 个 SQE 就放在 sqes[i]
+    for (unsigned i = 0; i < p.sq_entries; i++)
+        um->sq_array[i] = i;
+
+    m->impl = um;
+    return 0;
+}
+
+// 已经放进 SQ 但内核还没有取走的 SQE 数量
+unsigned uring_mux_pending(uring_mux *um)
+{
+    return *um->sq_tail - __atomic_load_n(um->sq_head, __ATOMIC_ACQUIRE);
+}
+
+// 取一个空闲的 SQE，SQ 满了就先把已有的提交给内核
+struct io_uring_sqe *uring_mux_get_sqe(uring_mux *um)
+{
+    unsigned tail = *um->sq_tail;
+    if (uring_mux_pending(um) >= um->sq_entries)
+    {
+        if (uring_mux_enter(um->ring_fd, uring_mux_pending(um), 0, 0, NULL, 0) < 0)
+            return NULL;
+        if (uring_mux_pending(um) >= um->sq_entries)
+            return NULL;
+    }
+
+    struct io_uring_sqe *sqe = &um->sqes[tail & *um->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// SQE 填好之后发布给内核（还没有真正提交，要等下一次 io_uring_enter）
+void uring_mux_push_sqe(uring_mux *um)
+{
+    __atomic_store_n(um->sq_tail, *um->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t uring_mux_user_data(int fd, uint32_t gen)
+{
+    return ((uint64_t)gen << 32) | (uint32_t)fd;
+}
+
+uint32_t uring_mux_next_gen(uring_mux *um)
+{
+    um->next_gen = (um->next_gen + 1) & URING_MUX_GEN_MASK;
+    return um->next_gen;
+}
+
+int uring_mux_queue_arm(uring_mux *um, int fd)
+{
+    if (um->fds[fd].queued)
+        return 0;
+    if (um->arm_cnt == um->arm_cap)
+    {
+        int cap = um->arm_cap ? um->arm_cap * 2 : 1024;
+        int *list = realloc(um->arm_list, sizeof(int) * cap);
+        if (list == NULL)
+            return -1;
+        um->arm_list = list;
+        um->arm_cap = cap;
+    }
+    um->arm_list[um->arm_cnt++] = fd;
+    um->fds[fd].queued = 1;
+    return 0;
+}
+
+// 取消 fd 当前在内核里等待的 POLL_ADD
+int uring_mux_cancel(uring_mux *um, int fd)
+{
+    uring_fd_state *st = &um->fds[fd];
+    if (!st->armed)
+        return 0;
+
+    struct io_uring_sqe *sqe = uring_mux_get_sqe(um);
+    if (sqe == NULL)
+        return -1;
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = uring_mux_user_data(fd, st->gen);
+    sqe->user_data = URING_MUX_REMOVE_TAG;
+    uring_mux_push_sqe(um);
+    st->armed = 0;
+    return 0;
+}
+
+int uring_mux_mod(mux *m, int fd, int events)
+{
+    uring_mux *um = m->impl;
+    if (fd >= um->fds_size || !um->fds[fd].registered)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    if (uring_mux_cancel(um, fd) == -1)
+        return -1;
+    um->fds[fd].events = events;
+    um->fds[fd].gen = uring_mux_next_gen(um);
+    return uring_mux_queue_arm(um, fd);
+}
+
+int uring_mux_add(mux *m, int fd, int events)
+{
+    uring_mux *um = m->impl;
+
+    if (fd >= um->fds_size)
+    {
+        int size = um->fds_size ? um->fds_size * 2 : 1024;
+        while (size <= fd)
+            size *= 2;
+        uring_fd_state *fds = realloc(um->fds, sizeof(uring_fd_state) * size);
+        if (fds == NULL)
+            return -1;
+        memset(fds + um->fds_size, 0, sizeof(uring_fd_state) * (size - um->fds_size));
+        um->fds = fds;
+        um->fds_size = size;
+    }
+    if (um->fds[fd].registered)
+    {
+        errno = EEXIST;
+        return -1;
+    }
+    um->fds[fd].registered = 1;
+    um->fds[fd].events = events;
+    um->fds[fd].gen = uring_mux_next_gen(um);
+    return uring_mux_queue_arm(um, fd);
+}
+
+int uring_mux_del(mux *m, int fd)
+{
+    uring_mux *um = m->impl;
+    if (fd >= um->fds_size || !um->fds[fd].registered)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    if (uring_mux_cancel(um, fd) == -1)
+        return -1;
+    // 代数加一，之后到达的旧完成事件都会被忽略；arm_list 里的残留项在提交时跳过
+    um->fds[fd].registered = 0;
+    um->fds[fd].events = 0;
+    um->fds[fd].gen = uring_mux_next_gen(um);
+    return 0;
+}
+
+// 为 arm_list 里的 fd 排入 POLL_ADD，已经 del 或者已经在等待的跳过
+int uring_mux_arm_pending(uring_mux *um)
+{
+    for (int i = 0; i < um->arm_cnt; i++)
+    {
+        int fd = um->arm_list[i];
+        uring_fd_state *st = &um->fds[fd];
+        st->queued = 0;
+        if (!st->registered || st->armed)
+            continue;
+
+        struct io_uring_sqe *sqe = uring_mux_get_sqe(um);
+        if (sqe == NULL)
+            return -1;
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = ((st->events & MUX_READ) ? POLLIN : 0) | ((st->events & MUX_WRITE) ? POLLOUT : 0);
+        sqe->user_data = uring_mux_user_data(fd, st->gen);
+        uring_mux_push_sqe(um);
+        st->armed = 1;
+    }
+    um->arm_cnt = 0;
+    return 0;
+}
+
+int uring_mux_wait(mux *m, mux_event *evs, int max, int timeout_ms)
+{
+    uring_mux *um = m->impl;
+
+    // 把上一轮就绪过的 fd 和新注册的 fd 的 POLL_ADD 排进 SQ
+    if (uring_mux_arm_pending(um) == -1)
+        return -1;
+
+    while (1)
+    {
+        unsigned head = *um->cq_head;
+        int have_cqe = head != __atomic_load_n(um->cq_tail, __ATOMIC_ACQUIRE);
+
+        // 已经有完成事件时只提交不等待；否则按 timeout 等待至少一个完成事件
+        if (uring_mux_pending(um) > 0 || (!have_cqe && timeout_ms != 0))
+        {
+            unsigned flags = 0, min_complete = 0;
+            struct io_uring_getevents_arg arg;
+            struct __kernel_timespec ts;
+            void *parg = NULL;
+            size_t argsz = 0;
+
+            if (!have_cqe && timeout_ms != 0)
+            {
+                flags |= IORING_ENTER_GETEVENTS;
+                min_complete = 1;
+                if (timeout_ms > 0)
+                {
+                    ts.tv_sec = timeout_ms / 1000;
+                    ts.tv_nsec = (timeout_ms % 1000) * 1000000ll;
+                    if (um->ext_arg)
+                    {
+                        memset(&arg, 0, sizeof(arg));
+                        arg.ts = (uint64_t)(uintptr_t)&ts;
+                        flags |= IORING_ENTER_EXT_ARG;
+                        parg = &arg;
+                        argsz = sizeof(arg);
+                    }
+                    else
+                    {
+                        // off = 1：有一个别的完成事件时也结束，不会在内核里越积越多；ts 在提交时就被内核复制走
+                        struct io_uring_sqe *sqe = uring_mux_get_sqe(um);
+                        if (sqe == NULL)
+                            return -1;
+                        sqe->opcode = IORING_OP_TIMEOUT;
+                        sqe->fd = -1;
+                        sqe->addr = (uint64_t)(uintptr_t)&ts;
+                        sqe->len = 1;
+                        sqe->off = 1;
+                        sqe->user_data = URING_MUX_TIMEOUT_TAG;
+                        uring_mux_push_sqe(um);
+                    }
+                }
+            }
+
+            if (uring_mux_enter(um->ring_fd, uring_mux_pending(um), min_complete, flags, parg, argsz) < 0 &&
+                errno != ETIME)
+                return -1;
+        }
+
+        int n = 0;
+        unsigned tail = __atomic_load_n(um->cq_tail, __ATOMIC_ACQUIRE);
+        for (head = *um->cq_head; head != tail && n < max; head++)
+        {
+            struct io_uring_cqe *cqe = &um->cqes[head & *um->cq_mask];
+            uint64_t ud = cqe->user_data;
+            if (ud & (URING_MUX_REMOVE_TAG | URING_MUX_TIMEOUT_TAG))
+                continue;
+
+            int fd = (int)(uint32_t)ud;
+            uint32_t gen = ud >> 32;
+            if (fd >= um->fds_size || !um->fds[fd].registered || um->fds[fd].gen != gen)
+                continue; // 已经 del 或 mod 过的旧请求
+
+            uring_fd_state *st = &um->fds[fd];
+            st->armed = 0;
+            uring_mux_queue_arm(um, fd);
+            if (cqe->res == -ECANCELED)
+                continue;
+
+            int re = cqe->res;
+            evs[n].fd = fd;
+            if (re < 0)
+                evs[n].events = MUX_ERROR;
+            else
+                evs[n].events = ((re & POLLIN) ? MUX_READ : 0) | ((re & POLLOUT) ? MUX_WRITE : 0) |
+                                ((re & (POLLERR | POLLHUP | POLLNVAL)) ? MUX_ERROR : 0);
+            n++;
+        }
+        __atomic_store_n(um->cq_head, head, __ATOMIC_RELEASE);
+
+        /**
+         * 收到的都是被丢弃的旧事件时，如果调用方要求一直等待，就接着等，
+         * 否则调用方会把返回的 0 当作超时。
+         */
+        if (n > 0 || timeout_ms >= 0)
+            return n;
+
+        // 再等之前先把刚才重新排队的 fd 提交上去
+        if (uring_mux_arm_pending(um) == -1)
+            return -1;
+    }
+}
+
+void uring_mux_destroy(mux *m)
+{
+    uring_mux *um = m->impl;
+    munmap(um->sqes, um->sqes_size);
+    munmap(um->ring_ptr, um->ring_size);
+    close(um->ring_fd);
+    free(um->fds);
+    free(um->arm_list);
+    free(um);
+}
+
+static const mux_ops uring_mux_ops = {
+    "uring",
+    uring_mux_init,
+    uring_mux_add,
+    uring_mux_mod,
+    uring_mux_del,
+    uring_mux_wait,
+    uring_mux_destroy,
+};
+
+#endif /* mux_uring.h */
@@ -0,0 +1,273 @@
+#ifndef _RACE_CONNECT_H
+#define _RACE_CONNECT_H 1
+
+/**
+ * 并行的非阻塞 connect：同时尝试多个候选地址，谁先连上用谁（RFC 8305 Happy Eyeballs 的做法）。
+ *
+ * 阻塞的 connect 只能一个地址一个地址地试，某个地址不通时要等到超时：
+ * 对端的 accept 队列满了（或者丢包）时 SYN 被丢掉，内核 1 秒、3 秒、7 秒……地重传，connect 就卡在那里。
+ * race_connect 的做法：
+ * - 候选列表 spec 是逗号分隔的 host、host:port 或 [IPv6]:port，比如 "localhost,127.0.0.2:9191,[::1]:9192"，
+ *   每一项用 getaddrinfo 解析，一个主机名可能得到 IPv6 和 IPv4 两个地址；
+ * - 候选按地址族交替排列（第一个地址的族优先），一个族整体不通时不会拖累另一个；
+ * - 先对第一个候选发起非阻塞 connect，每过 stagger_ms 还没有结果就再加一个，某个尝试失败（比如 ECONNREFUSED）时立即加下一个；
+ * - 用 poll 等所有在途的尝试，第一个完成的胜出，其余的关闭。
+ * 错开发起而不是一次全部发出，是为了正常情况下只建立一个连接，不给每个副本都带去一次握手。
+ *
+ * 返回的套接字已经恢复成阻塞模式，用法和 connect 成功后的套接字一样。
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+// 最多同时考虑的候选地址个数
+#define RACE_MAX 16
+// RFC 8305 建议的错开间隔是 250ms
+#define RACE_DEFAULT_STAGGER_MS 250
+
+typedef struct
+{
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+} race_candidate;
+
+uint64_t race_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 把 spec 里的一项拆成 host 和 port，没写端口时用 default_port
+int race_split(const char *item, int default_port, char *host, size_t host_len, char *port, size_t port_len)
+{
+    const char *colon;
+    size_t hlen;
+    if (item[0] == '[') // [IPv6]:port
+    {
+        const char *end = strchr(item, ']');
+        if (end == NULL)
+            return -1;
+        item++;
+        hlen = end - item;
+        colon = end[1] == ':' ? end + 1 : NULL;
+    }
+    else
+    {
+        colon = strrchr(item, ':');
+        // 没加方括号的 IPv6 地址里有多个冒号，整个当作地址
+        if (colon != NULL && strchr(item, ':') != colon)
+            colon = NULL;
+        hlen = colon != NULL ? (size_t)(colon - item) : strlen(item);
+    }
+    if (hlen == 0 || hlen >= host_len)
+        return -1;
+    memcpy(host, item, hlen);
+    host[hlen] = 0;
+    snprintf(port, port_len, "%d", colon != NULL ? atoi(colon + 1) : default_port);
+    return 0;
+}
+
+/**
+ * 解析候选列表，结果按地址族交替排列，返回候选个数。
+ * 解析失败的项直接跳过，同一个地址只保留一次。
+ */
+int race_resolve(const char *spec, int default_port, race_candidate *out, int max)
+{
+    race_candidate all[RACE_MAX];
+    int nall = 0;
+    char buf[512];
+    if (strlen(spec) >= sizeof(buf))
+        return 0;
+    strcpy(buf, spec);
+
+    char *save = NULL;
+    for (char *item = strtok_r(buf, ",", &save); item != NULL && nall < RACE_MAX; item = strtok_r(NULL, ",", &save))
+    {
+        char host[256], port[16];
+        struct addrinfo hints, *res;
+        if (race_split(item, default_port, host, sizeof(host), port, sizeof(port)) == -1)
+            continue;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host, port, &hints, &res) != 0)
+            continue;
+        for (struct addrinfo *ai = res; ai != NULL && nall < RACE_MAX; ai = ai->ai_next)
+        {
+            int dup = 0;
+            for (int i = 0; i < nall && !dup; i++)
+                dup = all[i].addrlen == ai->ai_addrlen && memcmp(&all[i].addr, ai->ai_addr, ai->ai_addrlen) == 0;
+            if (dup)
+                continue;
+            memcpy(&all[nall].addr, ai->ai_addr, ai->ai_addrlen);
+            all[nall++].addrlen = ai->ai_addrlen;
+        }
+        freeaddrinfo(res);
+    }
+
+    // 两个族各自保持原来的顺序，从第一个候选的族开始交替取
+    int n = 0, used[RACE_MAX] = {0};
+    int family = nall > 0 ? all[0].addr.ss_family : AF_INET;
+    while (n < nall && n < max)
+    {
+        int pick = -1;
+        for (int i = 0; i < nall && pick == -1; i++)
+            if (!used[i] && all[i].addr.ss_family == family)
+                pick = i;
+        for (int i = 0; i < nall && pick == -1; i++) // 这个族用完了，剩下的都是另一个族
+            if (!used[i])
+                pick = i;
+        used[pick] = 1;
+        out[n++] = all[pick];
+        family = family == AF_INET6 ? AF_INET : AF_INET6;
+    }
+    return n;
+}
+
+// 把地址格式化成 "1.2.3.4:80" 或 "[::1]:80"
+void race_format(const struct sockaddr_storage *addr, char *buf, size_t len)
+{
+    char ip[INET6_ADDRSTRLEN];
+    if (addr->ss_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *a = (const struct sockaddr_in6 *)addr;
+        inet_ntop(AF_INET6, &a->sin6_addr, ip, sizeof(ip));
+        snprintf(buf, len, "[%s]:%d", ip, ntohs(a->sin6_port));
+    }
+    else
+    {
+        const struct sockaddr_in *a = (const struct sockaddr_in *)addr;
+        inet_ntop(AF_INET, &a->sin_addr, ip, sizeof(ip));
+        snprintf(buf, len, "%s:%d", ip, ntohs(a->sin_port));
+    }
+}
+
+/**
+ * 对 spec 里的候选地址并行 connect，返回最先连上的套接字，全部失败或超过 timeout_ms 返回 -1（errno 为最后一次的错误）。
+ * winner 非空时写入胜出的地址。stagger_ms <= 0 时用默认的 250ms，timeout_ms <= 0 表示不限时间。
+ */
+int race_connect(const char *spec, int default_port, int stagger_ms, int timeout_ms, char *winner, size_t winner_len)
+{
+    race_candidate cands[RACE_MAX];
+    struct pollfd pfds[RACE_MAX];
+    int idx[RACE_MAX]; // pfds[i] 对应的候选下标
+    int ncand = race_resolve(spec, default_port, cands, RACE_MAX);
+    int npending = 0, next = 0, last_errno = ECONNREFUSED, won = -1, won_fd = -1;
+
+    if (ncand == 0)
+    {
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+    if (stagger_ms <= 0)
+        stagger_ms = RACE_DEFAULT_STAGGER_MS;
+
+    uint64_t start = race_now_ms();
+    uint64_t next_start = start;
+    while (won == -1)
+    {
+        uint64_t now = race_now_ms();
+        if (timeout_ms > 0 && now - start >= (uint64_t)timeout_ms)
+        {
+            last_errno = ETIMEDOUT;
+            break;
+        }
+
+        // 到点了，或者在途的尝试都失败了，就发起下一个
+        while (next < ncand && (now >= next_start || npending == 0))
+        {
+            race_candidate *c = &cands[next++];
+            int fd = socket(c->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd == -1)
+            {
+                last_errno = errno;
+                continue;
+            }
+            int ret = connect(fd, (struct sockaddr *)&c->addr, c->addrlen);
+            if (ret == 0) // 回环上可能立即完成
+            {
+                won = next - 1;
+                won_fd = fd;
+                break;
+            }
+            if (errno != EINPROGRESS)
+            {
+                last_errno = errno;
+                close(fd);
+                continue;
+            }
+            pfds[npending].fd = fd;
+            pfds[npending].events = POLLOUT;
+            idx[npending++] = next - 1;
+            next_start = now + stagger_ms;
+            break;
+        }
+        if (won != -1)
+            break;
+        if (npending == 0 && next == ncand)
+            break; // 全部失败
+
+        // 等到有尝试完成、下一个候选该发起、或者总的超时，取最早的一个
+        int wait = -1;
+        if (next < ncand)
+            wait = next_start > now ? (int)(next_start - now) : 0;
+        if (timeout_ms > 0)
+        {
+            int left = (int)(start + timeout_ms - now);
+            if (wait == -1 || left < wait)
+                wait = left;
+        }
+        if (poll(pfds, npending, wait) <= 0)
+            continue;
+
+        for (int i = 0; i < npending; i++)
+        {
+            if (pfds[i].revents == 0)
+                continue;
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err == 0 && won == -1)
+            {
+                won = idx[i];
+                won_fd = pfds[i].fd;
+            }
+            else
+            {
+                if (err != 0)
+                    last_errno = err;
+                close(pfds[i].fd);
+            }
+            // 从在途列表里去掉，胜出的那个也要去掉，免得下面被当成输家关闭
+            pfds[i] = pfds[--npending];
+            idx[i] = idx[npending];
+            i--;
+        }
+    }
+
+    for (int i = 0; i < npending; i++)
+        close(pfds[i].fd);
+    if (won == -1)
+    {
+        errno = last_errno;
+        return -1;
+    }
+
+    fcntl(won_fd, F_SETFL, fcntl(won_fd, F_GETFL, 0) & ~O_NONBLOCK);
+    if (winner != NULL)
+        race_format(&cands[won].addr, winner, winner_len);
+    return won_fd;
+}
+
+#endif /* race_connect.h */
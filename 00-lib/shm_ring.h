@@ -0,0 +1,393 @@
+#ifndef _SHM_RING_H
+#define _SHM_RING_H 1
+
+/**
+ * 同一台机器上的客户端和服务端通过共享内存交换数据（memfd + 一对单生产者单消费者环形缓冲区）。
+ *
+ * UNIX 域套接字每条消息仍然要 write + read 两次系统调用、两次复制（用户 -> 内核 -> 用户），
+ * 还要唤醒对方。这里客户端用 memfd_create 创建一块匿名共享内存，里面放两个方向的字节环：
+ * - 写入方把数据复制进环，再更新 tail；读取方看到 tail 变化就能直接读，整个过程不进内核；
+ * - 每个环只有一个生产者、一个消费者：head 只由消费者写，tail 只由生产者写，
+ *   两者放在不同的 cache line 上，生产者还在本地缓存一份 head，环没满时不用去读对方的 cache line；
+ * - 读取方没有数据时先自旋一小段（spin_ns），还是没有就在环里打上 “我要睡了” 的标记，再阻塞在 eventfd 上；
+ *   写入方只有看到这个标记时才写 eventfd 唤醒对方。双方都忙的时候完全没有系统调用。
+ *   标记和 tail 的检查是经典的 Dekker 式配对：一方 “写标记 -> 全屏障 -> 读 tail”，
+ *   另一方 “写 tail -> 全屏障 -> 读标记”，保证不会出现数据已经写入、对方却睡着没人叫醒的情况；
+ * - 写满时同理，写入方在另一个标记上等，读取方取走数据后发现标记就唤醒它。
+ *
+ * 建立连接仍然借助 UNIX 域套接字（路径见 shm_ring_path）：客户端连上后，
+ * 通过 SCM_RIGHTS 把 memfd 和两个 eventfd 一起发给服务端（00-lib/unix_sock.h 的 send_fds）。
+ * 这条控制连接一直保持到结束，任何一方退出时另一方从它上面读到 EOF，不会永远等在 eventfd 上。
+ * memfd 发出去之前先封住大小（F_SEAL_SHRINK | F_SEAL_GROW），服务端只接受封好的：
+ * 否则客户端可以随时把它 ftruncate 小，服务端访问映射时就会收到 SIGBUS。
+ * 同样，环里的 head / tail 对端随时可以改：每次算可读 / 可写字节数时都检查 tail - head 不超过环的大小，
+ * 超过说明对端写坏了下标，连接标记为 corrupt，之后不再读写，由调用方关闭。
+ *
+ * 客户端接口和套接字的 connect / read / write / close 一一对应：
+ *   shm_conn *c = shm_connect(9190, 0);
+ *   shm_write(c, msg, len);
+ *   n = shm_read(c, buf, sizeof(buf));   // 和 read 一样可能只读到一部分，0 表示对端关闭
+ *   shm_close(c);
+ * 服务端见 49-shm-ring/shm_echo_server.c。
+ *
+ * 要用 memfd_create，使用者要在包含任何系统头文件之前定义 _GNU_SOURCE。
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include "unix_sock.h"
+
+// 每个方向的环大小，必须是 2 的幂
+#define SHM_RING_SIZE (64 * 1024)
+#define SHM_RING_MAGIC 0x52494e47u // "RING"
+
+typedef struct
+{
+    // 消费者写的部分
+    uint64_t head __attribute__((aligned(64)));
+    uint32_t reader_waiting; // 消费者没有数据可读，准备或已经睡在 eventfd 上
+    // 生产者写的部分
+    uint64_t tail __attribute__((aligned(64)));
+    uint32_t writer_waiting; // 生产者没有空间可写，准备或已经睡在 eventfd 上
+    char data[SHM_RING_SIZE] __attribute__((aligned(64)));
+} shm_ring;
+
+typedef struct
+{
+    uint32_t magic;
+    shm_ring c2s; // 客户端 -> 服务端
+    shm_ring s2c; // 服务端 -> 客户端
+} shm_region;
+
+typedef struct
+{
+    shm_region *region;
+    shm_ring *tx;         // 本端写入的环
+    shm_ring *rx;         // 本端读取的环
+    int wake_efd;         // 本端睡在这个 eventfd 上
+    int peer_efd;         // 写它来唤醒对端
+    int ctl;              // 控制连接，对端退出时可读（EOF）
+    uint64_t spin_ns;     // 阻塞之前先自旋多久
+    uint64_t tx_head;     // 生产者缓存的 tx->head，只有看起来写满了才重新读
+    uint64_t rx_tail;     // 消费者缓存的 rx->tail，只有看起来读空了才重新读
+    uint64_t notifies;    // 写 eventfd 唤醒对端的次数
+    uint64_t sleeps;      // 本端真正阻塞的次数
+    int peer_closed;
+    int corrupt;          // 对端写了不合法的 head / tail
+} shm_conn;
+
+// 端口 port 对应的控制连接路径，和 unix_sock_path 的流套接字区分开
+void shm_ring_path(char *path, size_t len, int port)
+{
+    snprintf(path, len, "%s/netsock-%d.shm", UNIX_SOCK_DIR, port);
+}
+
+uint64_t shm_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void shm_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// 环里可读的字节数，只由消费者调用；下标不合法时标记 corrupt 并返回 0
+uint32_t shm_ring_readable(shm_conn *c)
+{
+    if (c->rx_tail == c->rx->head)
+        c->rx_tail = __atomic_load_n(&c->rx->tail, __ATOMIC_ACQUIRE);
+    uint64_t avail = c->rx_tail - c->rx->head;
+    if (avail > SHM_RING_SIZE)
+    {
+        c->corrupt = 1;
+        return 0;
+    }
+    return avail;
+}
+
+// 环里可写的字节数，只由生产者调用；下标不合法时标记 corrupt 并返回 0
+uint32_t shm_ring_writable(shm_conn *c)
+{
+    uint64_t tail = c->tx->tail;
+    if (tail - c->tx_head == SHM_RING_SIZE)
+        c->tx_head = __atomic_load_n(&c->tx->head, __ATOMIC_ACQUIRE);
+    uint64_t used = tail - c->tx_head;
+    if (used > SHM_RING_SIZE)
+    {
+        c->corrupt = 1;
+        return 0;
+    }
+    return SHM_RING_SIZE - used;
+}
+
+void shm_notify(shm_conn *c)
+{
+    uint64_t one = 1;
+    if (write(c->peer_efd, &one, sizeof(one)) == sizeof(one))
+        c->notifies++;
+}
+
+// 生产者发布了新数据之后调用：对端在等数据时才唤醒它
+void shm_tx_publish(shm_conn *c, uint64_t new_tail)
+{
+    __atomic_store_n(&c->tx->tail, new_tail, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&c->tx->reader_waiting, __ATOMIC_RELAXED))
+        shm_notify(c);
+}
+
+// 消费者取走数据之后调用：对端在等空间时才唤醒它
+void shm_rx_consume(shm_conn *c, uint64_t new_head)
+{
+    __atomic_store_n(&c->rx->head, new_head, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&c->rx->writer_waiting, __ATOMIC_RELAXED))
+        shm_notify(c);
+}
+
+/**
+ * 把最多 len 字节写进 tx 环，不阻塞，返回实际写入的字节数。
+ * 环的数据区可能要分成尾部和头部两段复制。
+ */
+size_t shm_try_write(shm_conn *c, const void *buf, size_t len)
+{
+    uint32_t space = shm_ring_writable(c);
+    size_t n = len < space ? len : space;
+    if (n == 0)
+        return 0;
+
+    uint64_t tail = c->tx->tail;
+    uint32_t off = tail & (SHM_RING_SIZE - 1);
+    size_t first = n < SHM_RING_SIZE - off ? n : SHM_RING_SIZE - off;
+    memcpy(c->tx->data + off, buf, first);
+    memcpy(c->tx->data, (const char *)buf + first, n - first);
+    shm_tx_publish(c, tail + n);
+    return n;
+}
+
+// 从 rx 环读最多 len 字节，不阻塞，返回实际读到的字节数
+size_t shm_try_read(shm_conn *c, void *buf, size_t len)
+{
+    uint32_t avail = shm_ring_readable(c);
+    size_t n = len < avail ? len : avail;
+    if (n == 0)
+        return 0;
+
+    uint64_t head = c->rx->head;
+    uint32_t off = head & (SHM_RING_SIZE - 1);
+    size_t first = n < SHM_RING_SIZE - off ? n : SHM_RING_SIZE - off;
+    memcpy(buf, c->rx->data + off, first);
+    memcpy((char *)buf + first, c->rx->data, n - first);
+    shm_rx_consume(c, head + n);
+    return n;
+}
+
+/**
+ * 等到 rx 有数据（want_read）或 tx 有空间，返回 0；对端关闭或者写坏了下标时返回 -1。
+ * 先自旋 spin_ns，再打上标记阻塞在 wake_efd 上，同时盯着控制连接。
+ */
+int shm_wait(shm_conn *c, int want_read)
+{
+    uint64_t start = 0;
+    while (1)
+    {
+        if (want_read ? shm_ring_readable(c) > 0 : shm_ring_writable(c) > 0)
+            return 0;
+        if (c->peer_closed || c->corrupt)
+            return -1;
+        if (c->spin_ns > 0)
+        {
+            uint64_t now = shm_now_ns();
+            if (start == 0)
+                start = now;
+            if (now - start < c->spin_ns)
+            {
+                shm_cpu_relax();
+                continue;
+            }
+        }
+
+        uint32_t *flag = want_read ? &c->rx->reader_waiting : &c->tx->writer_waiting;
+        __atomic_store_n(flag, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        // 打上标记之后必须再检查一次：对端可能恰好在标记之前写了数据，它不会再来唤醒我们
+        int ready = want_read ? (c->rx_tail = __atomic_load_n(&c->rx->tail, __ATOMIC_ACQUIRE)) != c->rx->head
+                              : c->tx->tail - (c->tx_head = __atomic_load_n(&c->tx->head, __ATOMIC_ACQUIRE)) < SHM_RING_SIZE;
+        if (!ready)
+        {
+            struct pollfd pfds[2] = {{c->wake_efd, POLLIN, 0}, {c->ctl, POLLIN, 0}};
+            c->sleeps++;
+            if (poll(pfds, 2, -1) > 0)
+            {
+                uint64_t cnt;
+                if (pfds[0].revents & POLLIN)
+                    read(c->wake_efd, &cnt, sizeof(cnt));
+                // 控制连接上不会有数据，可读只可能是对端关闭
+                if (pfds[1].revents & (POLLIN | POLLHUP | POLLERR))
+                    c->peer_closed = 1;
+            }
+        }
+        __atomic_store_n(flag, 0, __ATOMIC_RELAXED);
+        start = 0;
+    }
+}
+
+// 和阻塞套接字的 write 一样，写完全部 len 字节才返回，对端关闭返回 -1
+ssize_t shm_write(shm_conn *c, const void *buf, size_t len)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        done += shm_try_write(c, (const char *)buf + done, len - done);
+        if (done < len && shm_wait(c, 0) == -1)
+            return -1;
+    }
+    return len;
+}
+
+// 和阻塞套接字的 read 一样，有数据就返回（可能少于 len），对端关闭且没有剩余数据时返回 0
+ssize_t shm_read(shm_conn *c, void *buf, size_t len)
+{
+    while (1)
+    {
+        size_t n = shm_try_read(c, buf, len);
+        if (n > 0 || len == 0)
+            return n;
+        if (shm_wait(c, 1) == -1)
+            return shm_try_read(c, buf, len); // 对端关闭前写的数据还要读完
+    }
+}
+
+shm_conn *shm_conn_new(shm_region *region, int is_server, int wake_efd, int peer_efd, int ctl, uint64_t spin_ns)
+{
+    shm_conn *c = calloc(1, sizeof(shm_conn));
+    if (c == NULL)
+        return NULL;
+    c->region = region;
+    c->tx = is_server ? &region->s2c : &region->c2s;
+    c->rx = is_server ? &region->c2s : &region->s2c;
+    c->wake_efd = wake_efd;
+    c->peer_efd = peer_efd;
+    c->ctl = ctl;
+    c->spin_ns = spin_ns;
+    c->tx_head = c->tx->head;
+    c->rx_tail = c->rx->tail;
+    return c;
+}
+
+shm_region *shm_region_map(int memfd)
+{
+    void *p = mmap(NULL, sizeof(shm_region), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+/**
+ * 连接端口 port 上的服务端，spin_us 为读写阻塞前的自旋时间（微秒），失败返回 NULL。
+ * 客户端创建共享内存和两个 eventfd，发给服务端之后，本端只保留映射和 eventfd。
+ */
+shm_conn *shm_connect(int port, int spin_us)
+{
+    char path[108];
+    shm_ring_path(path, sizeof(path), port);
+    int ctl = unix_connect(path);
+    if (ctl == -1)
+        return NULL;
+
+    int fds[3] = {-1, -1, -1}; // memfd，服务端的 eventfd，客户端的 eventfd
+    shm_region *region = NULL;
+    fds[0] = memfd_create("shm_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    fds[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    fds[2] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fds[0] == -1 || fds[1] == -1 || fds[2] == -1 || ftruncate(fds[0], sizeof(shm_region)) == -1 ||
+        fcntl(fds[0], F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) == -1 || (region = shm_region_map(fds[0])) == NULL)
+        goto fail;
+
+    // ftruncate 出来的内存全是 0，两个环都是空的
+    region->magic = SHM_RING_MAGIC;
+    if (send_fds(ctl, fds, 3, NULL, 0) == -1)
+        goto fail;
+
+    close(fds[0]);
+    shm_conn *c = shm_conn_new(region, 0, fds[2], fds[1], ctl, (uint64_t)spin_us * 1000);
+    if (c != NULL)
+        return c;
+    fds[0] = -1;
+
+fail:
+    if (region != NULL)
+        munmap(region, sizeof(shm_region));
+    for (int i = 0; i < 3; i++)
+        if (fds[i] != -1)
+            close(fds[i]);
+    close(ctl);
+    return NULL;
+}
+
+/**
+ * 服务端收下客户端发来的 memfd 和 eventfd，建立连接，失败返回 NULL（ctl 由调用方关闭）。
+ * 服务端一般不会阻塞在单个连接上，spin_ns 只在它调用 shm_read / shm_write 时有意义。
+ */
+shm_conn *shm_accept(int ctl)
+{
+    int fds[3], nfds;
+    if (recv_fds(ctl, fds, 3, &nfds, NULL, 0) <= 0)
+        return NULL;
+    shm_region *region = NULL;
+    if (nfds == 3)
+    {
+        struct stat st;
+        // 大小不对的共享内存映射之后访问会 SIGBUS；没有封住大小的，客户端事后还能改
+        int seals = fcntl(fds[0], F_GET_SEALS);
+        if (seals != -1 && (seals & (F_SEAL_SHRINK | F_SEAL_GROW)) == (F_SEAL_SHRINK | F_SEAL_GROW) &&
+            fstat(fds[0], &st) == 0 && st.st_size == sizeof(shm_region))
+            region = shm_region_map(fds[0]);
+        if (region != NULL && region->magic != SHM_RING_MAGIC)
+        {
+            munmap(region, sizeof(shm_region));
+            region = NULL;
+        }
+    }
+    // 映射建立后 memfd 就不需要了
+    for (int i = 0; i < nfds; i++)
+        if (i == 0 || region == NULL)
+            close(fds[i]);
+    if (region == NULL)
+        return NULL;
+
+    shm_conn *c = shm_conn_new(region, 1, fds[1], fds[2], ctl, 0);
+    if (c == NULL)
+    {
+        munmap(region, sizeof(shm_region));
+        close(fds[1]);
+        close(fds[2]);
+    }
+    return c;
+}
+
+void shm_close(shm_conn *c)
+{
+    munmap(c->region, sizeof(shm_region));
+    close(c->wake_efd);
+    close(c->peer_efd);
+    close(c->ctl);
+    free(c);
+}
+
+#endif /* shm_ring.h */
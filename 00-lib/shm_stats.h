@@ -0,0 +1,161 @@
+#ifndef _SHM_STATS_H
+#define _SHM_STATS_H 1
+
+/**
+ * 多进程共享的统计段（POSIX 共享内存 shm_open + mmap）。
+ *
+ * 布局：一个 shm_stats 头部，后面紧跟 nworkers 个 worker_stats 槽位。
+ * - 每个槽位按 cache line 对齐，一个 worker 进程只写自己的槽位，不会和别的 worker 发生伪共享；
+ * - 每个计数器只有一个写者，所以写入不需要锁，也不需要原子 RMW 指令，用 relaxed 的 load + store 即可；
+ * - 读者（stats_reader）只做 relaxed load，64 位对齐的读在 64 位平台上是原子的，不会读到撕裂的值。
+ *
+ * 子进程退出后它写过的计数仍然留在共享内存里，父进程重新拉起的 worker 接着在同一个槽位上累加。
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define CACHE_LINE_SIZE 64
+
+#define SHM_STATS_MAGIC 0x53544154u // "STAT"
+#define SHM_STATS_MAX_WORKERS 256
+// 延迟直方图按 log2(微秒) 分桶：第 0 桶 <1us，第 i 桶 [2^(i-1), 2^i) us，最后一桶收集所有更大的值
+#define SHM_STATS_LAT_BUCKETS 24
+
+typedef struct
+{
+    uint64_t connections; // 累计受理的连接数
+    uint64_t active;      // 当前正在服务的连接数（仪表值，可增可减）
+    uint64_t requests;    // 累计请求数（echo 服务里一次 read 到数据就算一次请求）
+    uint64_t bytes_in;    // 累计读入字节
+    uint64_t bytes_out;   // 累计写出字节
+    uint64_t latency[SHM_STATS_LAT_BUCKETS];
+    int32_t pid;          // 当前占用此槽位的进程，0 表示空闲
+} __attribute__((aligned(CACHE_LINE_SIZE))) worker_stats;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t nworkers;
+    uint64_t start_ns; // 创建统计段时的 CLOCK_MONOTONIC 时间
+    worker_stats slots[] __attribute__((aligned(CACHE_LINE_SIZE)));
+} shm_stats;
+
+uint64_t stats_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+size_t shm_stats_size(int nworkers)
+{
+    return sizeof(shm_stats) + sizeof(worker_stats) * nworkers;
+}
+
+// 创建（或重建）统计段，失败返回 NULL
+shm_stats *shm_stats_create(const char *name, int nworkers)
+{
+    if (nworkers <= 0 || nworkers > SHM_STATS_MAX_WORKERS)
+        return NULL;
+
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd == -1)
+        return NULL;
+
+    size_t size = shm_stats_size(nworkers);
+    if (ftruncate(fd, size) == -1)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    shm_stats *st = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // 映射建立后 fd 就可以关闭了，映射本身会保持共享内存对象的引用
+    close(fd);
+    if (st == MAP_FAILED)
+        return NULL;
+
+    memset(st, 0, size);
+    st->nworkers = nworkers;
+    st->start_ns = stats_now_ns();
+    // magic 最后写，读者看到 magic 才认为统计段已经初始化完成
+    __atomic_store_n(&st->magic, SHM_STATS_MAGIC, __ATOMIC_RELEASE);
+    return st;
+}
+
+// 以只读方式打开已有的统计段，失败返回 NULL
+const shm_stats *shm_stats_open(const char *name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1)
+        return NULL;
+
+    struct stat sb;
+    if (fstat(fd, &sb) == -1 || (size_t)sb.st_size < sizeof(shm_stats))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    const shm_stats *st = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (st == MAP_FAILED)
+        return NULL;
+
+    if (__atomic_load_n(&st->magic, __ATOMIC_ACQUIRE) != SHM_STATS_MAGIC ||
+        (size_t)sb.st_size < shm_stats_size(st->nworkers))
+    {
+        munmap((void *)st, sb.st_size);
+        return NULL;
+    }
+    return st;
+}
+
+/**
+ * 单写者计数：只有槽位的主人会调用，所以不需要 lock 前缀的原子加，
+ * 用 relaxed 的 load/store 只是为了告诉编译器这块内存有并发读者，不要把写入优化掉或拆开。
+ */
+void stats_add(uint64_t *counter, uint64_t n)
+{
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+void stats_sub(uint64_t *counter, uint64_t n)
+{
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) - n, __ATOMIC_RELAXED);
+}
+
+uint64_t stats_read(const uint64_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+int stats_latency_bucket(uint64_t ns)
+{
+    uint64_t us = ns / 1000;
+    if (us == 0)
+        return 0;
+    // 64 - clz 就是 floor(log2(us)) + 1
+    int b = 64 - __builtin_clzll(us);
+    return b < SHM_STATS_LAT_BUCKETS ? b : SHM_STATS_LAT_BUCKETS - 1;
+}
+
+void stats_record_latency(worker_stats *ws, uint64_t ns)
+{
+    stats_add(&ws->latency[stats_latency_bucket(ns)], 1);
+}
+
+// 桶的上界（微秒），用于打印分位数
+uint64_t stats_bucket_upper_us(int b)
+{
+    return 1ull << b;
+}
+
+#endif /* shm_stats.h */
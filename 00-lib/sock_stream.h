@@ -0,0 +1,204 @@
+#ifndef _SOCK_STREAM_H
+#define _SOCK_STREAM_H 1
+
+/**
+ * 套接字上按行读写的缓冲层，用来代替 fdopen + fgets / fputs / fflush（见 09-std-io-func）。
+ *
+ * stdio 的问题：
+ * - 每次 fgets / fputs 都要加锁解锁 FILE（多线程安全），fgets 逐段扫描换行符；
+ * - 回声服务每行都要 fflush，一行一次 write 系统调用，短行时系统调用的开销远大于数据本身；
+ * - 读缓冲只有 BUFSIZ（4KB 或 8KB），对端一次发来很多行时要反复 read。
+ * 这里的做法：
+ * - sock_reader 自己管一块大缓冲区（默认 64KB），一次 read 尽量读满，然后用 memchr 在缓冲区里找换行符，
+ *   一次 read 可以切出很多行，返回的行直接指向缓冲区，不复制（glibc 的 memchr 用 SSE2/AVX2 一次比较 16/32 字节）；
+ * - sock_writer 把要写的数据攒在自己的缓冲区里，满了或者调用方要求时才 write；
+ * - 调用方在缓冲区里已经没有完整的行、马上要阻塞去 read 之前调用 sw_flush，
+ *   这样一批请求的回复合成一次 write，又不会出现对端在等回复、回复却还压在缓冲区里的死锁：
+ *     while ((line = sr_read_line(&r, &len, &w)) != NULL)
+ *         sw_write(&w, line, len);
+ * 单线程使用，不加锁。
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define SOCK_STREAM_BUF (64 * 1024)
+
+typedef struct
+{
+    int fd;
+    char *buf;
+    size_t size;
+    size_t start; // 还没交给调用方的数据从这里开始
+    size_t end;   // 缓冲区里有效数据的末尾
+    size_t scan;  // start 到 scan 之间已经确认没有换行符，下次从 scan 接着找
+    int eof;
+    uint64_t reads; // read 系统调用次数
+} sock_reader;
+
+typedef struct
+{
+    int fd;
+    char *buf;
+    size_t size;
+    size_t len;
+    int error;
+    uint64_t writes; // write 系统调用次数
+} sock_writer;
+
+int sr_init(sock_reader *r, int fd, size_t size)
+{
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    r->size = size > 0 ? size : SOCK_STREAM_BUF;
+    r->buf = malloc(r->size);
+    return r->buf != NULL ? 0 : -1;
+}
+
+void sr_free(sock_reader *r)
+{
+    free(r->buf);
+    r->buf = NULL;
+}
+
+int sw_init(sock_writer *w, int fd, size_t size)
+{
+    memset(w, 0, sizeof(*w));
+    w->fd = fd;
+    w->size = size > 0 ? size : SOCK_STREAM_BUF;
+    w->buf = malloc(w->size);
+    return w->buf != NULL ? 0 : -1;
+}
+
+void sw_free(sock_writer *w)
+{
+    free(w->buf);
+    w->buf = NULL;
+}
+
+// 把缓冲区里的数据全部写出去，出错返回 -1（之后的写入都会被丢弃）
+int sw_flush(sock_writer *w)
+{
+    size_t done = 0;
+    while (done < w->len && !w->error)
+    {
+        ssize_t n = write(w->fd, w->buf + done, w->len - done);
+        w->writes++;
+        if (n > 0)
+            done += n;
+        else if (n == -1 && errno == EINTR)
+            continue;
+        else
+            w->error = 1;
+    }
+    w->len = 0;
+    return w->error ? -1 : 0;
+}
+
+// 追加 len 字节，缓冲区满了才真正写出去；比缓冲区还大的数据直接写
+int sw_write(sock_writer *w, const void *data, size_t len)
+{
+    if (w->len + len > w->size && sw_flush(w) == -1)
+        return -1;
+    if (len > w->size)
+    {
+        size_t done = 0;
+        while (done < len)
+        {
+            ssize_t n = write(w->fd, (const char *)data + done, len - done);
+            w->writes++;
+            if (n > 0)
+                done += n;
+            else if (!(n == -1 && errno == EINTR))
+                return -1;
+        }
+        return 0;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+    return 0;
+}
+
+/**
+ * 从缓冲区里取下一行（包含结尾的 '\n'），不读套接字。*len 为行的长度，没有完整的行时返回 NULL。
+ * 返回的指针指向内部缓冲区，下一次调用 sr_fill 之后就失效了。
+ */
+char *sr_next_line(sock_reader *r, size_t *len)
+{
+    char *nl = memchr(r->buf + r->scan, '\n', r->end - r->scan);
+    if (nl == NULL)
+    {
+        r->scan = r->end;
+        return NULL;
+    }
+    char *line = r->buf + r->start;
+    *len = nl + 1 - line;
+    r->start = r->scan = nl + 1 - r->buf;
+    return line;
+}
+
+/**
+ * 再从套接字读一次，把剩下的半行挪到缓冲区开头腾出空间。
+ * 返回读到的字节数，0 表示对端关闭，-1 表示出错。
+ */
+ssize_t sr_fill(sock_reader *r)
+{
+    if (r->start > 0)
+    {
+        memmove(r->buf, r->buf + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->scan -= r->start;
+        r->start = 0;
+    }
+    ssize_t n;
+    do
+    {
+        n = read(r->fd, r->buf + r->end, r->size - r->end);
+        r->reads++;
+    } while (n == -1 && errno == EINTR);
+    if (n > 0)
+        r->end += n;
+    else if (n == 0)
+        r->eof = 1;
+    return n;
+}
+
+/**
+ * 读下一行，缓冲区里没有完整的行时先把 w 里攒着的回复刷出去（w 可以为 NULL），再去 read。
+ * 一行比整个缓冲区还长时，先把缓冲区满的这一段当作一行返回（和 fgets 遇到长行时一样）；
+ * 对端关闭时最后不带换行符的半行也会返回。没有更多数据时返回 NULL。
+ */
+char *sr_read_line(sock_reader *r, size_t *len, sock_writer *w)
+{
+    while (1)
+    {
+        char *line = sr_next_line(r, len);
+        if (line != NULL)
+            return line;
+
+        if (r->start == 0 && r->end == r->size) // 缓冲区满了也没有换行符
+        {
+            *len = r->end;
+            r->start = r->scan = r->end;
+            return r->buf;
+        }
+        if (r->eof)
+        {
+            if (r->start == r->end)
+                return NULL;
+            *len = r->end - r->start;
+            line = r->buf + r->start;
+            r->start = r->scan = r->end;
+            return line;
+        }
+        if (w != NULL && w->len > 0 && sw_flush(w) == -1)
+            return NULL;
+        if (sr_fill(r) == -1)
+            return NULL;
+    }
+}
+
+#endif /* sock_stream.h */
@@ -0,0 +1,221 @@
+#ifndef _UNIX_SOCK_H
+#define _UNIX_SOCK_H 1
+
+/**
+ * UNIX 域（AF_UNIX / PF_LOCAL）流套接字的辅助函数。
+ *
+ * 客户端和服务端在同一台机器上时，走回环的 TCP 仍然要经过完整的协议栈（分段、校验和、ACK、拥塞控制……），
+ * UNIX 域套接字直接把数据从发送方的缓冲区挂到接收方的队列上，延迟和 CPU 开销都小得多，协议照旧是字节流。
+ *
+ * 为了不给每个服务端增加参数，约定监听 TCP 端口 port 的服务端同时监听 UNIX_SOCK_DIR/netsock-<port>.sock，
+ * 客户端把服务端地址写成 "unix" 就会连到这个路径：
+ *   ./epoll_server 9190
+ *   ../90-benchmark/pingpong_bench unix 9190
+ *
+ * 另外提供 send_fd / recv_fd（一次多个 fd 用 send_fds / recv_fds），通过 SCM_RIGHTS 辅助消息把打开的文件描述符传给另一个进程，
+ * 接收方得到的是指向同一个打开文件（同一个 socket）的新 fd，可以用来在进程之间转交连接。
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifndef UNIX_SOCK_DIR
+#define UNIX_SOCK_DIR "/tmp"
+#endif
+
+// 端口 port 对应的 UNIX 域套接字路径
+void unix_sock_path(char *path, size_t len, int port)
+{
+    snprintf(path, len, "%s/netsock-%d.sock", UNIX_SOCK_DIR, port);
+}
+
+/**
+ * 在 path 上监听，返回监听套接字，失败返回 -1。
+ * 路径上残留的旧套接字文件（上次的进程没有清理）会先删掉，
+ * 所以要在 TCP 端口 bind 成功之后再调用，避免删掉另一个正在运行的服务端的文件。
+ */
+int unix_listen(const char *path, int backlog)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+
+    int sock = socket(PF_LOCAL, SOCK_STREAM, 0);
+    if (sock == -1)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_LOCAL;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(sock, backlog) == -1)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// 按端口约定的路径监听
+int unix_listen_port(int port, int backlog)
+{
+    char path[108];
+    unix_sock_path(path, sizeof(path), port);
+    return unix_listen(path, backlog);
+}
+
+int unix_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+
+    int sock = socket(PF_LOCAL, SOCK_STREAM, 0);
+    if (sock == -1)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_LOCAL;
+    strcpy(addr.sun_path, path);
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// host 为 "unix" 时连接端口对应的 UNIX 域套接字，否则按 IPv4 地址连接 TCP
+int stream_connect(const char *host, int port)
+{
+    if (strcmp(host, "unix") == 0)
+    {
+        char path[108];
+        unix_sock_path(path, sizeof(path), port);
+        return unix_connect(path);
+    }
+
+    struct sockaddr_in serv_addr;
+    int sock = socket(PF_INET, SOCK_STREAM, 0);
+    if (sock == -1)
+        return -1;
+
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = inet_addr(host);
+    serv_addr.sin_port = htons(port);
+    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// 一条消息最多携带的 fd 个数
+#define UNIX_SOCK_MAX_FDS 8
+
+/**
+ * 通过 UNIX 域套接字 sock 把 nfds 个 fd 发给对端，同时附带 len 字节的普通数据。
+ * 辅助消息必须跟着至少 1 字节的普通数据一起发送，len 为 0 时补发 1 字节。
+ * 成功返回发送的普通数据字节数，失败返回 -1。发送后本进程的 fd 仍然有效，不用时要自己 close。
+ */
+ssize_t send_fds(int sock, const int *fds, int nfds, const void *data, size_t len)
+{
+    char dummy = 0;
+    struct iovec iov;
+    struct msghdr msg;
+    union
+    {
+        struct cmsghdr align; // 保证控制缓冲区按 cmsghdr 对齐
+        char buf[CMSG_SPACE(sizeof(int) * UNIX_SOCK_MAX_FDS)];
+    } control;
+
+    if (nfds <= 0 || nfds > UNIX_SOCK_MAX_FDS)
+        return -1;
+
+    iov.iov_base = len > 0 ? (void *)data : &dummy;
+    iov.iov_len = len > 0 ? len : 1;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+    memcpy(CMSG_DATA(cm), fds, sizeof(int) * nfds);
+
+    return sendmsg(sock, &msg, MSG_NOSIGNAL);
+}
+
+ssize_t send_fd(int sock, int fd, const void *data, size_t len)
+{
+    return send_fds(sock, &fd, 1, data, len);
+}
+
+/**
+ * 接收 send_fds 发来的 fd 和普通数据，最多接收 max_fds 个，*nfds 为实际收到的个数（这条消息没有带 fd 时为 0）。
+ * 返回收到的普通数据字节数，0 表示对端关闭，-1 表示出错。
+ * 收到的 fd 带 close-on-exec 标志。
+ */
+ssize_t recv_fds(int sock, int *fds, int max_fds, int *nfds, void *data, size_t len)
+{
+    char dummy;
+    struct iovec iov;
+    struct msghdr msg;
+    union
+    {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * UNIX_SOCK_MAX_FDS)];
+    } control;
+
+    iov.iov_base = len > 0 ? data : &dummy;
+    iov.iov_len = len > 0 ? len : 1;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    *nfds = 0;
+    ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (n <= 0)
+        return n;
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    if (cm == NULL || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+        return n;
+    int got = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    int *received = (int *)CMSG_DATA(cm);
+    for (int i = 0; i < got; i++)
+    {
+        // 多出来的 fd 已经装进了本进程，不关掉就泄漏了
+        if (i < max_fds)
+            memcpy(&fds[i], &received[i], sizeof(int));
+        else
+            close(received[i]);
+    }
+    *nfds = got < max_fds ? got : max_fds;
+    return n;
+}
+
+// 只接收一个 fd，*fd 为收到的描述符（这条消息没有带 fd 时为 -1）
+ssize_t recv_fd(int sock, int *fd, void *data, size_t len)
+{
+    int nfds;
+    ssize_t n = recv_fds(sock, fd, 1, &nfds, data, len);
+    if (nfds == 0)
+        *fd = -1;
+    return n;
+}
+
+#endif /* unix_sock.h */
@@ -0,0 +1,271 @@
+#ifndef _XFER_PARALLEL_H
+#define _XFER_PARALLEL_H 1
+
+/**
+ * 多连接并行下载一个文件，支持断点续传（协议见 file_xfer.h，用法见 21-tcp-half-close/file-client.c）。
+ *
+ * 单个 TCP 连接的吞吐受拥塞窗口 / 往返时间、路径上每条流的限速、单核处理能力等限制，
+ * 长肥管道上一条连接往往跑不满带宽；而且一条连接遇到丢包重传变慢时，整个文件都得等它。做法：
+ * - 把文件切成固定大小的段（segment），段数是连接数的好几倍；
+ * - 开 streams 个线程，每个线程一个连接，从共享的段列表里一段接一段地取，收到的数据用 pwrite 写到输出文件的对应位置。
+ *   快的连接自然多干活，慢的连接最多拖住它手里的那一段，而不是按连接数平分文件、最后等最慢的那一份；
+ * - 连接断开或者某块校验失败时，重连后从这一段已经校验通过的位置接着要（xfer_fetch 返回的 stats.bytes），
+ *   连续失败 XFER_MAX_RETRIES 次才放弃；
+ * - 每完成一段就往进度文件（输出文件名加 .xfer）追加一行段号，进程被杀掉后重新运行，已完成的段直接跳过，
+ *   全部完成后删除进度文件。只保证进程退出、连接断开后能续传，不保证掉电：写进度前没有 fsync 输出文件。
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "file_xfer.h"
+#include "unix_sock.h"
+
+#define XFER_MAX_STREAMS 64
+// 一段没有任何进展的连续失败次数上限，每次重试前等 100ms * 次数
+#define XFER_MAX_RETRIES 5
+#define XFER_MIN_SEGMENT (1 << 20)
+#define XFER_MAX_SEGMENT (64 << 20)
+
+// 段的状态
+#define XFER_SEG_TODO 0
+#define XFER_SEG_BUSY 1
+#define XFER_SEG_DONE 2
+
+typedef struct
+{
+    char host[64];
+    int port;
+    uint32_t flags; // 请求时带上的 XFER_FLAG_*，比如 XFER_FLAG_LZ
+    int out_fd;
+    int progress_fd;
+    uint64_t file_size;
+    uint64_t seg_size;
+    int nseg;
+    unsigned char *seg_state;
+    int next; // 从这里开始找还没做的段
+    int error; // 某个线程放弃时记下的错误，其他线程看到后也停下
+    pthread_mutex_t lock;
+    // 统计
+    int resumed;         // 从进度文件里恢复的已完成段数
+    uint64_t bytes;      // 这次运行实际收到的字节数（解压后）
+    uint64_t wire_bytes; // 线上传输的字节数
+    uint64_t crc_ns;
+    uint64_t codec_ns;
+    int reconnects;
+} xfer_job;
+
+// 段 seg 的字节数，最后一段可能不满
+uint64_t xfer_seg_len(xfer_job *job, int seg)
+{
+    uint64_t off = (uint64_t)seg * job->seg_size;
+    return job->file_size - off < job->seg_size ? job->file_size - off : job->seg_size;
+}
+
+/**
+ * 打开进度文件：第一行是 "xfer <文件大小> <段大小>"，之后每行一个已完成的段号。
+ * 文件大小和这次的对不上（服务端的文件变了）或者输出文件不完整时，从头开始。
+ */
+int xfer_progress_open(xfer_job *job, const char *path, uint64_t default_seg_size)
+{
+    char line[64];
+    struct stat st;
+    uint64_t size = 0, seg_size = 0;
+    FILE *fp = fopen(path, "r");
+    int valid = fp != NULL && fgets(line, sizeof(line), fp) != NULL &&
+                sscanf(line, "xfer %lu %lu", &size, &seg_size) == 2 && size == job->file_size &&
+                seg_size >= XFER_MIN_SEGMENT && fstat(job->out_fd, &st) == 0 && (uint64_t)st.st_size == size;
+
+    job->seg_size = valid ? seg_size : default_seg_size;
+    job->nseg = job->file_size == 0 ? 0 : (job->file_size + job->seg_size - 1) / job->seg_size;
+    job->seg_state = calloc(job->nseg > 0 ? job->nseg : 1, 1);
+    if (valid)
+    {
+        int seg;
+        while (fgets(line, sizeof(line), fp) != NULL)
+            if (sscanf(line, "%d", &seg) == 1 && seg >= 0 && seg < job->nseg && job->seg_state[seg] != XFER_SEG_DONE)
+            {
+                job->seg_state[seg] = XFER_SEG_DONE;
+                job->resumed++;
+            }
+    }
+    if (fp != NULL)
+        fclose(fp);
+
+    job->progress_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | (valid ? 0 : O_TRUNC), 0644);
+    if (job->progress_fd == -1)
+        return -1;
+    if (!valid)
+    {
+        dprintf(job->progress_fd, "xfer %lu %lu\n", job->file_size, job->seg_size);
+        if (ftruncate(job->out_fd, job->file_size) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+// 取下一个还没做的段，没有了返回 -1
+int xfer_take_segment(xfer_job *job)
+{
+    int seg = -1;
+    pthread_mutex_lock(&job->lock);
+    while (job->error == 0 && job->next < job->nseg)
+    {
+        int i = job->next++;
+        if (job->seg_state[i] == XFER_SEG_TODO)
+        {
+            job->seg_state[i] = XFER_SEG_BUSY;
+            seg = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&job->lock);
+    return seg;
+}
+
+void xfer_finish_segment(xfer_job *job, int seg, int ret)
+{
+    pthread_mutex_lock(&job->lock);
+    if (ret == 0)
+    {
+        job->seg_state[seg] = XFER_SEG_DONE;
+        // 数据已经用 pwrite 写进输出文件之后才记进度，进程在这两步之间被杀掉只会让这一段重传
+        dprintf(job->progress_fd, "%d\n", seg);
+    }
+    else
+    {
+        job->seg_state[seg] = XFER_SEG_TODO;
+        if (job->error == 0)
+            job->error = ret;
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+void *xfer_worker(void *arg)
+{
+    xfer_job *job = arg;
+    int sock = -1, seg;
+    uint64_t bytes = 0, wire_bytes = 0, crc_ns = 0, codec_ns = 0;
+    int reconnects = 0;
+
+    while ((seg = xfer_take_segment(job)) != -1)
+    {
+        uint64_t off = (uint64_t)seg * job->seg_size, len = xfer_seg_len(job, seg), got = 0;
+        int failures = 0, ret = 0;
+        while (got < len)
+        {
+            if (sock == -1)
+                sock = stream_connect(job->host, job->port);
+            if (sock == -1)
+                ret = XFER_ERR_IO;
+            else
+            {
+                xfer_stats stats;
+                ret = xfer_fetch(sock, job->out_fd, off + got, len - got, job->flags, NULL, &stats);
+                got += stats.bytes;
+                bytes += stats.bytes;
+                wire_bytes += stats.wire_bytes;
+                crc_ns += stats.crc_ns;
+                codec_ns += stats.codec_ns;
+                // 成功，或者服务端的文件变短了（重试没有意义）
+                if (ret == 0 || ret == XFER_ERR_RANGE)
+                    break;
+                if (stats.bytes > 0) // 有进展就重新计数
+                    failures = 0;
+                close(sock);
+                sock = -1;
+            }
+            if (++failures > XFER_MAX_RETRIES)
+                break;
+            reconnects++;
+            usleep(100000 * failures);
+        }
+        xfer_finish_segment(job, seg, got == len ? 0 : ret != 0 ? ret : XFER_ERR_PROTO);
+    }
+    if (sock != -1)
+        close(sock);
+
+    pthread_mutex_lock(&job->lock);
+    job->bytes += bytes;
+    job->wire_bytes += wire_bytes;
+    job->crc_ns += crc_ns;
+    job->codec_ns += codec_ns;
+    job->reconnects += reconnects;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+/**
+ * 用 streams 个连接把服务端的文件下载到 path，返回 0 或 XFER_ERR_*。
+ * seg_size 为 0 时按文件大小和连接数自动选择（每个连接平均 8 段，限制在 1MB 到 64MB 之间）；
+ * 续传时沿用进度文件里的段大小。flags 带 XFER_FLAG_LZ 时要求服务端压缩传输。job 里留有统计信息，调用方用完后调用 xfer_job_free。
+ */
+int xfer_download(xfer_job *job, const char *host, int port, const char *path, int streams, uint64_t seg_size,
+                  uint32_t flags)
+{
+    char progress_path[4096];
+    xfer_header hdr;
+    pthread_t tids[XFER_MAX_STREAMS];
+
+    memset(job, 0, sizeof(*job));
+    job->out_fd = job->progress_fd = -1;
+    if (streams < 1 || streams > XFER_MAX_STREAMS || strlen(host) >= sizeof(job->host))
+        return XFER_ERR_PROTO;
+    strcpy(job->host, host);
+    job->port = port;
+    job->flags = flags;
+    pthread_mutex_init(&job->lock, NULL);
+
+    // 先用一个连接问文件大小
+    int sock = stream_connect(host, port);
+    if (sock == -1)
+        return XFER_ERR_IO;
+    int ret = xfer_stat(sock, &hdr);
+    close(sock);
+    if (ret < 0)
+        return ret;
+    job->file_size = hdr.file_size;
+
+    if (seg_size == 0)
+    {
+        seg_size = hdr.file_size / ((uint64_t)streams * 8);
+        seg_size = seg_size < XFER_MIN_SEGMENT ? XFER_MIN_SEGMENT : seg_size > XFER_MAX_SEGMENT ? XFER_MAX_SEGMENT : seg_size;
+    }
+    job->out_fd = open(path, O_WRONLY | O_CREAT, 0644);
+    snprintf(progress_path, sizeof(progress_path), "%s.xfer", path);
+    if (job->out_fd == -1 || xfer_progress_open(job, progress_path, seg_size) == -1)
+        return XFER_ERR_IO;
+
+    // 段比连接少时多开的连接没事可做
+    int remaining = job->nseg - job->resumed;
+    if (streams > remaining)
+        streams = remaining > 0 ? remaining : 1;
+    for (int i = 0; i < streams; i++)
+        pthread_create(&tids[i], NULL, xfer_worker, job);
+    for (int i = 0; i < streams; i++)
+        pthread_join(tids[i], NULL);
+
+    if (job->error != 0)
+        return job->error;
+    unlink(progress_path);
+    return 0;
+}
+
+void xfer_job_free(xfer_job *job)
+{
+    if (job->out_fd != -1)
+        close(job->out_fd);
+    if (job->progress_fd != -1)
+        close(job->progress_fd);
+    free(job->seg_state);
+    job->seg_state = NULL;
+    pthread_mutex_destroy(&job->lock);
+}
+
+#endif /* xfer_parallel.h */
@@ -0,0 +1,238 @@
+#ifndef _ZEROCOPY_H
+#define _ZEROCOPY_H 1
+
+/**
+ * MSG_ZEROCOPY 发送路径（Linux 4.14+，TCP）。
+ *
+ * 普通的 write/send 会把用户数据复制进内核的 skb，大块数据时这次复制是主要开销。
+ * 对套接字打开 SO_ZEROCOPY 后，send(..., MSG_ZEROCOPY) 只把用户页钉住（pin）直接挂到 skb 上，
+ * 代价是：send 返回后缓冲区还不能改也不能释放，要等内核在错误队列（MSG_ERRQUEUE）里发来完成通知。
+ * - 内核给同一个套接字上每次成功的 MSG_ZEROCOPY 发送编一个从 0 开始的序号，
+ *   完成通知是一个区间 [ee_info, ee_data]，一条通知可以确认连续的多次发送；
+ * - 钉页、建立映射、处理通知都有固定成本，小块数据反而比复制更慢，所以按大小自动选择，
+ *   只有 >= threshold 的发送才走零拷贝（内核文档给出的经验值是 10KB 左右）；
+ * - 数据最终没能零拷贝（比如走回环或 veth 到本机套接字，接收方要的是普通页，内核会在那里补一次复制），
+ *   通知里带 SO_EE_CODE_ZEROCOPY_COPIED，这时零拷贝只是白白多了开销，zc_reap 发现这种情况占多数时会自动关掉它。
+ *
+ * 这里提供两个部分：
+ * - zc_pool：固定大小缓冲区的池子，零拷贝发送的缓冲区只有在收到完成通知后才还回池子；
+ * - zc_queue：每个连接一份，按序号记录在途的发送，处理完成通知并归还缓冲区。
+ *
+ *   zc_enable(&q, fd);
+ *   char *buf = zc_pool_get(&pool);  ... 填数据 ...
+ *   n = zc_send(&q, fd, buf + off, len - off, threshold);   // 可能部分发送，继续发剩下的
+ *   zc_release(&q, &pool, buf);                             // buf 全部发出后调用
+ *   ... 套接字上出现 POLLERR（MUX_ERROR）时：zc_reap(&q, fd, &pool);
+ *   ... 关闭连接时：zc_drain(&q, fd, &pool) 返回 0 才能 close(fd)，否则 shutdown 之后接着 zc_reap，直到它返回 0
+ *
+ * 缓冲区还被内核引用着时关闭 fd，完成通知就再也收不到了，这些缓冲区只能永久放弃；
+ * 客户端在传输中途断开就能让 pool 少掉一批，所以关闭前要排空。
+ * 每个连接挂在在途发送上的缓冲区最多 ZC_MAX_HELD 个，再多就退回普通发送（发完立即归还），
+ * 少数几个连接不管怎么断开、停着不读，都占不满整个 pool。
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+// 每个连接最多在途的零拷贝发送次数，满了之后退回普通发送
+#define ZC_INFLIGHT 64
+// 内核报告 “仍然复制了” 的次数达到这个值，就认为这条路径上零拷贝无效，对这个连接关掉它
+#define ZC_COPIED_LIMIT 32
+// 每个连接最多占着多少个等待完成通知的 pool 缓冲区
+#ifndef ZC_MAX_HELD
+#define ZC_MAX_HELD 16
+#endif
+
+typedef struct
+{
+    char *mem;
+    int buf_size;
+    int count;
+    int *free_list; // 空闲缓冲区的下标，当作栈使用
+    int free_cnt;
+} zc_pool;
+
+typedef struct
+{
+    uint32_t seq;  // 内核给这次发送的序号
+    uint8_t done;  // 已收到完成通知
+    char *buf;     // 非空时，这次发送完成后把 buf 还给 pool
+} zc_entry;
+
+typedef struct
+{
+    zc_entry ring[ZC_INFLIGHT];
+    uint32_t head;     // 最早的在途发送
+    uint32_t tail;
+    uint32_t next_seq; // 下一次零拷贝发送的序号，和内核的计数保持一致
+    int enabled;
+    int unreleased;    // 上次 zc_release 之后有过零拷贝发送
+    int held;          // 挂在在途发送上、还没还给 pool 的缓冲区个数
+    int fallback;      // 内核总是复制时自动关闭零拷贝，默认打开
+    uint64_t zc_sends;   // 走零拷贝的发送次数
+    uint64_t copy_sends; // 因为太小或在途太多而走普通复制的次数
+    uint64_t copied;     // 内核报告最终还是复制了的发送次数，超过一半时关闭零拷贝
+} zc_queue;
+
+int zc_pool_init(zc_pool *pool, int buf_size, int count)
+{
+    pool->mem = aligned_alloc(4096, (size_t)buf_size * count);
+    pool->free_list = malloc(sizeof(int) * count);
+    if (pool->mem == NULL || pool->free_list == NULL)
+        return -1;
+    pool->buf_size = buf_size;
+    pool->count = count;
+    for (int i = 0; i < count; i++)
+        pool->free_list[i] = count - 1 - i;
+    pool->free_cnt = count;
+    return 0;
+}
+
+// 池子空了返回 NULL，说明在途的数据太多，调用方应当等完成通知
+char *zc_pool_get(zc_pool *pool)
+{
+    if (pool->free_cnt == 0)
+        return NULL;
+    return pool->mem + (size_t)pool->free_list[--pool->free_cnt] * pool->buf_size;
+}
+
+void zc_pool_put(zc_pool *pool, char *buf)
+{
+    pool->free_list[pool->free_cnt++] = (buf - pool->mem) / pool->buf_size;
+}
+
+// 对套接字打开零拷贝，内核不支持时返回 -1，之后的 zc_send 都走普通发送
+int zc_enable(zc_queue *q, int fd)
+{
+    int option = 1;
+    memset(q, 0, sizeof(*q));
+    q->enabled = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &option, sizeof(option)) == 0;
+    q->fallback = 1;
+    return q->enabled ? 0 : -1;
+}
+
+uint32_t zc_inflight(const zc_queue *q)
+{
+    return q->tail - q->head;
+}
+
+// 发送 buf 中的 len 字节，len >= threshold 时尝试零拷贝，返回值和 send 相同
+ssize_t zc_send(zc_queue *q, int fd, const char *buf, size_t len, size_t threshold)
+{
+    if (!q->enabled || len < threshold || zc_inflight(q) == ZC_INFLIGHT || q->held >= ZC_MAX_HELD)
+    {
+        q->copy_sends++;
+        return send(fd, buf, len, MSG_NOSIGNAL);
+    }
+
+    ssize_t n = send(fd, buf, len, MSG_ZEROCOPY | MSG_NOSIGNAL);
+    if (n <= 0)
+        return n; // 没有数据被接收时内核不会消耗序号
+    q->zc_sends++;
+
+    zc_entry *e = &q->ring[q->tail++ % ZC_INFLIGHT];
+    e->seq = q->next_seq++;
+    e->done = 0;
+    e->buf = NULL;
+    q->unreleased = 1;
+    return n;
+}
+
+/**
+ * buf 的内容已经全部交给 send，不再需要了。
+ * buf 上有零拷贝发送还在途时，把它挂到最近一次零拷贝发送上（那一次一定属于 buf，并且最后完成），
+ * 等完成通知时再还给 pool；否则立即归还。
+ */
+void zc_release(zc_queue *q, zc_pool *pool, char *buf)
+{
+    if (q->unreleased && zc_inflight(q) > 0)
+    {
+        q->ring[(q->tail - 1) % ZC_INFLIGHT].buf = buf;
+        q->held++;
+    }
+    else
+        zc_pool_put(pool, buf);
+    q->unreleased = 0;
+}
+
+/**
+ * 读取错误队列里的完成通知，把已完成的发送对应的缓冲区还给 pool。
+ * 返回归还的缓冲区个数。一次 recvmsg 只取一条通知，循环直到 EAGAIN。
+ */
+int zc_reap(zc_queue *q, int fd, zc_pool *pool)
+{
+    int released = 0;
+
+    // 没有在途的零拷贝发送时错误队列里不会有通知，不用再发起系统调用
+    while (q->head != q->tail)
+    {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        // 通知本身不带数据，recvmsg 返回 0，要看有没有控制消息来判断是否取到了通知
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1 || msg.msg_controllen == 0)
+            break;
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            struct sock_extended_err *ee = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+
+            // [lo, hi] 区间内的发送都已完成，序号是 32 位回绕计数，用差值比较
+            uint32_t lo = ee->ee_info, hi = ee->ee_data;
+            for (uint32_t i = q->head; i != q->tail; i++)
+            {
+                zc_entry *e = &q->ring[i % ZC_INFLIGHT];
+                if ((int32_t)(e->seq - lo) >= 0 && (int32_t)(hi - e->seq) >= 0)
+                    e->done = 1;
+            }
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                q->copied += hi - lo + 1;
+                if (q->fallback && q->copied >= ZC_COPIED_LIMIT && q->copied * 2 > q->zc_sends)
+                    q->enabled = 0;
+            }
+        }
+    }
+
+    // 只从头部按顺序回收，保证部分发送时 buf 的前几段一定比最后一段先完成
+    while (q->head != q->tail && q->ring[q->head % ZC_INFLIGHT].done)
+    {
+        zc_entry *e = &q->ring[q->head++ % ZC_INFLIGHT];
+        if (e->buf != NULL)
+        {
+            zc_pool_put(pool, e->buf);
+            q->held--;
+            released++;
+        }
+    }
+    return released;
+}
+
+/**
+ * 连接关闭前调用，回收已经完成的发送，返回还被内核引用着的缓冲区个数。
+ * 对端正常读完所有数据后关闭连接时，完成通知通常都已经到了，返回 0，可以直接 close；
+ * 否则 fd 要先留着（shutdown 掉，不再读写），等完成通知陆续到达、zc_reap 把缓冲区都还回来之后再 close。
+ */
+int zc_drain(zc_queue *q, int fd, zc_pool *pool)
+{
+    zc_reap(q, fd, pool);
+    return q->held;
+}
+
+#endif /* zerocopy.h */
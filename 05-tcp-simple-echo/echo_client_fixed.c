@@ -2,6 +2,9 @@
  * 修正上一个版本的问题
  * 由于每次从 sock 读数据时，都提前知道数据长度，所以可以很简单的修复问题
  * 但是在更多情况下是无法预先知道要接收数据的长度的，（基于TCP）此时就需要在应用层协议定义数据通讯的格式和规则。
+ *
+ * 服务端地址可以写多个（IPv4、IPv6、主机名都行，逗号分隔），用 race_connect 并行连接，哪个先连上用哪个：
+ *   ./echo_client_fixed localhost,127.0.0.2:9191 9190
  */
 
 #include <string.h>
@@ -9,37 +12,28 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include "../00-lib/error.h"
+#include "../00-lib/race_connect.h"
 
 #define BUF_SIZE 1024
 
 int main(int argc, char *argv[])
 {
     int sock;
-    struct sockaddr_in serv_addr;
     char message[BUF_SIZE];
     int str_len, recv_len, recv_cnt;
 
     if (argc != 3)
     {
-        printf("Usage: %s <server IP> <server port>\n", argv[0]);
+        printf("Usage: %s <server address[,address...]> <server port>\n", argv[0]);
         exit(1);
     }
 
-    sock = socket(PF_INET, SOCK_STREAM, 0);
+    char winner[64];
+    sock = race_connect(argv[1], atoi(argv[2]), 0, 0, winner, sizeof(winner));
     if (sock == -1)
-    {
-        error_handling("socket() error");
-    }
-
-    memset(&serv_addr, 0, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_addr.s_addr = inet_addr(argv[1]);
-    serv_addr.sin_port = htons(atoi(argv[2]));
-
-    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
         error_handling("connect() error");
     else
-        puts("Connected.............");
+        printf("Connected to %s.............\n", winner);
 
     while (1)
     {
@@ -1,6 +1,9 @@
 /**
  * 计算器客服端
  * 传输的数据格式要根据服务器端定义的来发送和接收。
+ *
+ * 可以连续计算多次，连接从连接池（00-lib/conn_pool.h）里取，算完放回去，下一次计算直接复用，不用重新握手。
+ * 服务端重启过的话，池子里的旧连接在取出时的健康检查里就会被发现并换成新连接。
  */
 
 #include <string.h>
@@ -8,6 +11,7 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include "../00-lib/error.h"
+#include "../00-lib/conn_pool.h"
 
 #define BUF_SIZE 1024
 #define RLT_SIZE 4
@@ -16,7 +20,7 @@
 int main(int argc, char *argv[])
 {
     int sock;
-    struct sockaddr_in serv_addr;
+    conn_pool pool;
     char opmsg[BUF_SIZE];
     int result, opnd_cnt;
 
@@ -26,40 +30,51 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    sock = socket(PF_INET, SOCK_STREAM, 0);
-    if (sock == -1)
-        error_handling("socket() error");
-
-    memset(&serv_addr, 0, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_addr.s_addr = inet_addr(argv[1]);
-    serv_addr.sin_port = htons(atoi(argv[2]));
-
-    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
+    // 交互式客户端同时只有一个请求，池子里一个连接就够了，先连好
+    if (pool_init(&pool, argv[1], atoi(argv[2]), 1, 1, 60000) == -1)
+        error_handling("pool_init() error");
+    if (pool.total == 0)
         error_handling("connect() error");
     else
         puts("Connected.............");
 
-    fputs("Operand count: ", stdout);
-    scanf("%d", &opnd_cnt);
-    opmsg[0] = (char)opnd_cnt;
-
-    for (int i = 0; i < opnd_cnt; i++)
+    while (1)
     {
-        printf("Operand %d: ", i + 1);
-        scanf("%d", (int *)&opmsg[i * OPSZ + 1]);
-    }
+        fputs("Operand count (0 to quit): ", stdout);
+        if (scanf("%d", &opnd_cnt) != 1 || opnd_cnt <= 0)
+            break;
+        if (opnd_cnt > (BUF_SIZE - 2) / OPSZ || opnd_cnt > 255)
+        {
+            puts("Too many operands");
+            continue;
+        }
+        opmsg[0] = (char)opnd_cnt;
+
+        for (int i = 0; i < opnd_cnt; i++)
+        {
+            printf("Operand %d: ", i + 1);
+            scanf("%d", (int *)&opmsg[i * OPSZ + 1]);
+        }
 
-    // 下面要输入字符，先嗲用 fgetc 函数删除缓冲中的 \n 字符
-    fgetc(stdin);
-    fputs("Operator: ", stdout);
-    scanf("%c", &opmsg[opnd_cnt * OPSZ + 1]);
+        // 下面要输入字符，先嗲用 fgetc 函数删除缓冲中的 \n 字符
+        fgetc(stdin);
+        fputs("Operator: ", stdout);
+        scanf("%c", &opmsg[opnd_cnt * OPSZ + 1]);
 
-    write(sock, opmsg, opnd_cnt * OPSZ + 2);
-    read(sock, &result, RLT_SIZE);
-    printf("Operation result: %d\n", result);
+        sock = pool_get(&pool);
+        if (sock == -1)
+            error_handling("connect() error");
+        int len = opnd_cnt * OPSZ + 2;
+        int ok = write(sock, opmsg, len) == len && read(sock, &result, RLT_SIZE) == RLT_SIZE;
+        // 出错的连接不放回池子
+        pool_put(&pool, sock, ok);
+        if (ok)
+            printf("Operation result: %d\n", result);
+        else
+            puts("Request failed, server closed connection?");
+    }
 
-    // 调用 close 函数会向相应套接字发送 EOF，即意味着中断连接。
-    close(sock);
+    // 关闭池子里的连接，会向服务端发送 EOF，即意味着中断连接。
+    pool_destroy(&pool);
     return 0;
 }
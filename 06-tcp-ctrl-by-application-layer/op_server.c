@@ -7,30 +7,48 @@
  *    2> n个整数，每个整数占用4字节
  *    3> 1字节，字符，运算符，支持：+、-、*
  * - 服务器运算结果用 4字节 整数返回给客服端
- * - 客户端接收到运算结果后关闭连接。
+ * - 客户端可以在同一个连接上接着发下一个请求（keep-alive），不用了再关闭连接。
+ *   早先的版本每算完一个结果就关闭连接，每个请求都要重新握手，先关闭的一方还会留下一个 TIME_WAIT 套接字（见 22-time-wait），
+ *   客户端配合连接池（00-lib/conn_pool.h）复用连接，压测见 90-benchmark/pool_bench.c。
+ *
+ * 一个连接上的请求是一个接一个处理的，多个连接之间用 poll 轮流服务。
+ * 客户端套接字是非阻塞的，每个连接有自己的请求缓冲区：poll 报告可读后有多少读多少，
+ * 凑齐一个完整的请求才计算，不完整的留在缓冲区里等下次可读。
+ * 不能在一个连接上阻塞读完整个请求，只发了半个请求就停下的客户端会卡住所有其他连接。
  */
 
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/poll.h>
 #include "../00-lib/error.h"
 
-#define BUF_SIZE 1024
 #define OPSZ 4
+#define MAX_OPNDS 255
+#define REQ_MAX (1 + MAX_OPNDS * OPSZ + 1) // 最长的请求：个数 + 255 个整数 + 运算符
+#define MAX_CLNT 256
+
+// 一个连接上还没凑齐的请求
+typedef struct
+{
+    unsigned char data[REQ_MAX];
+    int len;
+} req_buf;
 
 int calculate(int opnum, int opnds[], char operator);
+int serve_client(int clnt_sock, req_buf *req);
 
 int main(int argc, char *argv[])
 {
     int serv_sock, clnt_sock;
     struct sockaddr_in serv_addr, clnt_addr;
     socklen_t clnt_addr_size;
-
-    char opinfo[BUF_SIZE];
-
-    int result, opnd_cnt;
-    char operator;
+    struct pollfd fds[MAX_CLNT + 1];
+    static req_buf reqs[MAX_CLNT + 1]; // 和 fds 下标一一对应
+    int nfds = 0;
 
     if (argc != 2)
     {
@@ -42,6 +60,10 @@ int main(int argc, char *argv[])
     if (serv_sock == -1)
         error_handling("socket() error");
 
+    // 打开 SO_REUSEADDR
+    int option = 1;
+    setsockopt(serv_sock, SOL_SOCKET, SO_REUSEADDR, (void *)&option, sizeof(option));
+
     memset(&serv_addr, 0, sizeof(serv_addr));
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -50,37 +72,88 @@ int main(int argc, char *argv[])
     if (bind(serv_sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
         error_handling("bind() error");
 
-    if (listen(serv_sock, 5) == -1)
+    if (listen(serv_sock, 128) == -1)
         error_handling("listen error");
 
-    clnt_addr_size = sizeof(clnt_addr);
-    int str_len;
-    for (int i = 0; i < 5; i++)
+    fds[nfds].fd = serv_sock;
+    fds[nfds++].events = POLLIN;
+
+    while (1)
     {
-        clnt_sock = accept(serv_sock, (struct sockaddr *)&clnt_addr, &clnt_addr_size);
-        if (clnt_sock == -1)
-            error_handling("accept() eeror");
-        else
-            printf("Connected client %d\n", i + 1);
-
-        opnd_cnt = 0;
-        read(clnt_sock, &opnd_cnt, 1);
-        for (int i = 0; i < opnd_cnt; i++)
+        if (poll(fds, nfds, -1) == -1)
+            error_handling("poll() error");
+
+        // 倒着遍历，关闭连接时把最后一个挪过来不会漏掉
+        for (int i = nfds - 1; i > 0; i--)
         {
-            read(clnt_sock, (int *)&opinfo[i * OPSZ], OPSZ);
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            if (serve_client(fds[i].fd, &reqs[i]) == -1)
+            {
+                close(fds[i].fd);
+                fds[i] = fds[--nfds];
+                reqs[i] = reqs[nfds];
+            }
         }
-        read(clnt_sock, &operator, 1);
 
-        result = calculate(opnd_cnt, (int *)opinfo, operator);
-        write(clnt_sock, &result, sizeof(result));
-
-        close(clnt_sock);
+        if (fds[0].revents & POLLIN)
+        {
+            clnt_addr_size = sizeof(clnt_addr);
+            clnt_sock = accept(serv_sock, (struct sockaddr *)&clnt_addr, &clnt_addr_size);
+            if (clnt_sock == -1)
+                continue;
+            if (nfds > MAX_CLNT)
+            {
+                close(clnt_sock);
+                continue;
+            }
+            fcntl(clnt_sock, F_SETFL, fcntl(clnt_sock, F_GETFL, 0) | O_NONBLOCK);
+            reqs[nfds].len = 0;
+            fds[nfds].fd = clnt_sock;
+            fds[nfds++].events = POLLIN;
+        }
     }
 
     close(serv_sock);
     return 0;
 }
 
+/**
+ * 连接可读时调用：读出这次能读到的数据，缓冲区里每凑齐一个请求就计算并回复，
+ * 剩下不完整的部分留到下次。连接关闭、出错或请求格式不对时返回 -1。
+ */
+int serve_client(int clnt_sock, req_buf *req)
+{
+    int n = read(clnt_sock, req->data + req->len, REQ_MAX - req->len);
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+    if (n <= 0)
+        return -1;
+    req->len += n;
+
+    int pos = 0;
+    while (pos < req->len)
+    {
+        int opnd_cnt = req->data[pos];
+        int size = 1 + opnd_cnt * OPSZ + 1;
+        if (opnd_cnt == 0)
+            return -1;
+        if (req->len - pos < size)
+            break;
+
+        int opnds[MAX_OPNDS];
+        memcpy(opnds, req->data + pos + 1, opnd_cnt * OPSZ);
+        int result = calculate(opnd_cnt, opnds, req->data[pos + size - 1]);
+        // 回复只有 4 字节，发送缓冲区满说明客户端一直不读结果，当作出错断开，不能在这里阻塞
+        if (write(clnt_sock, &result, sizeof(result)) != sizeof(result))
+            return -1;
+        pos += size;
+    }
+    memmove(req->data, req->data + pos, req->len - pos);
+    req->len -= pos;
+    return 0;
+}
+
 int calculate(int opnum, int opnds[], char operator)
 {
     int result = opnds[0];
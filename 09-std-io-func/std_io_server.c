@@ -8,6 +8,8 @@
  * - 不容易进行双向通信
  * - 切换读写状态时需要调用 fflush 函数
  * - 需要以 FILE 结构体指针的形式操作
+ * - 回声服务每一行都要 fflush 一次，短行时一行一次 write 系统调用，
+ *   按行读写的专用缓冲层见 00-lib/sock_stream.h 和 stream_io_server.c，压测用 90-benchmark/line_bench.c
  *
  * 从 fd 转 FILE* 的函数
  * - FILE * fdopen(int fd, const char *mode);
@@ -72,9 +74,9 @@ int main(int argc, char *argv[])
         readfp = fdopen(clnt_sock, "r");
         writefp = fdopen(clnt_sock, "w");
 
-        while (!feof(readfp))
+        // 不能用 while (!feof(readfp)) 判断：EOF 是在 fgets 失败之后才置上的，那样最后一行会被多回显一次
+        while (fgets(message, BUF_SIZE, readfp) != NULL)
         {
-            fgets(message, BUF_SIZE, readfp);
             fputs(message, writefp);
             // 由于 std io 内部提供了缓冲，如果不调用 fflush 则无法保证立即把数据传出去。
             fflush(writefp);
@@ -11,16 +11,41 @@
  * - 由于本方关闭了输出流，所以会发出 EOF 信号
  * - 对方收到 EOF 信号后，判断对方写完了，此时，对方发送反馈信息给到本方，对方关闭连接
  * - 对方的输出对应本方的输入，由于输入通道还开着，本方就能收到收到反馈信息，本方关闭连接
+ *
+ * 靠 EOF 判断文件结束有两个问题：客户端事先不知道文件多大，中途断线和正常结束都是 EOF，分不清；
+ * 收到的数据对不对也无从验证。给出文件名时改用分块传输模式（协议见 00-lib/file_xfer.h）：
+ * 先发文件头（文件大小、块大小），再逐块发送，每块带 CRC32C 校验（00-lib/crc32c.h，用 SSE4.2 / ARMv8 CRC 指令），
+ * 每个连接一个线程，一个连接上可以依次请求多段，客户端也要给出输出文件名，可以开多个连接并行下载（见 file-client.c）：
+ *   ./file-server 9190 big.dat 256 &
+ *   ./file-client 127.0.0.1 9190 received.dat 4
+ * 客户端可以要求逐块压缩传输（file-client 最后加 lz），服务端在另一个线程里压缩，和发送重叠。
+ * 最后一个参数给每个连接限速（MB/s，用 SO_MAX_PACING_RATE，TCP 自己做 pacing），
+ * 模拟单条流跑不满带宽的链路（长肥管道上受窗口限制、路径上按流限速），用来比较不同连接数下的吞吐。
  */
 
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include "../00-lib/error.h"
+#include "../00-lib/file_xfer.h"
 
 #define BUF_SIZE 30
 
+typedef struct
+{
+    int sock;
+    int file_fd;
+    uint64_t file_size;
+    uint32_t chunk_size;
+} framed_conn;
+
+void serve_framed(int serv_sock, const char *path, uint32_t chunk_size, uint32_t pacing_rate);
+void *framed_conn_run(void *arg);
+
 int main(int argc, char *argv[])
 {
     int serv_sock, clnt_sock;
@@ -33,18 +58,20 @@ int main(int argc, char *argv[])
     char buf[BUF_SIZE];
     int read_cnt;
 
-    if (argc != 2)
+    if (argc < 2 || argc > 5)
     {
-        printf("Usage: %s <port>\n", argv[0]);
+        printf("Usage: %s <port> [file [chunk KB [MB/s per connection]]]\n", argv[0]);
         exit(1);
     }
 
-    fp = fopen("file-server.c", "rb");
-
     serv_sock = socket(PF_INET, SOCK_STREAM, 0);
     if (serv_sock == -1)
         error_handling("socket() error");
 
+    // 分块传输模式下服务端重启后客户端会重连续传，不能因为 TIME_WAIT 而绑定失败
+    int option = 1;
+    setsockopt(serv_sock, SOL_SOCKET, SO_REUSEADDR, (void *)&option, sizeof(option));
+
     memset(&serv_addr, 0, sizeof(serv_addr));
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -53,9 +80,18 @@ int main(int argc, char *argv[])
     if (bind(serv_sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
         error_handling("bind() error");
 
-    if (listen(serv_sock, 5) == -1)
+    if (listen(serv_sock, 64) == -1)
         error_handling("listen error");
 
+    if (argc >= 3)
+    {
+        serve_framed(serv_sock, argv[2], argc >= 4 ? atoi(argv[3]) * 1024 : XFER_DEFAULT_CHUNK,
+                     argc == 5 ? atoi(argv[4]) * 1000000 : 0);
+        return 0;
+    }
+
+    fp = fopen("file-server.c", "rb");
+
     clnt_addr_size = sizeof(clnt_addr);
     int str_len;
 
@@ -81,4 +117,60 @@ int main(int argc, char *argv[])
     close(clnt_sock);
     close(serv_sock);
     return 0;
-}
\ No newline at end of file
+}
+// 分块传输模式：每个连接一个线程，rate 非 0 时给每个连接限速（字节/秒）
+void serve_framed(int serv_sock, const char *path, uint32_t chunk_size, uint32_t pacing_rate)
+{
+    struct stat st;
+    int file_fd = open(path, O_RDONLY);
+    if (file_fd == -1 || fstat(file_fd, &st) == -1)
+        error_handling("open() error");
+    crc32c_init();
+    printf("serving %s (%lld bytes), chunk %u KB, crc32c: %s\n",
+           path, (long long)st.st_size, chunk_size / 1024, crc32c_impl_name);
+
+    while (1)
+    {
+        int clnt_sock = accept(serv_sock, NULL, NULL);
+        if (clnt_sock == -1)
+            continue;
+        if (pacing_rate > 0)
+            setsockopt(clnt_sock, SOL_SOCKET, SO_MAX_PACING_RATE, &pacing_rate, sizeof(pacing_rate));
+
+        framed_conn *conn = malloc(sizeof(framed_conn));
+        conn->sock = clnt_sock;
+        conn->file_fd = file_fd;
+        conn->file_size = st.st_size;
+        conn->chunk_size = chunk_size;
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, framed_conn_run, conn) != 0)
+        {
+            close(clnt_sock);
+            free(conn);
+            continue;
+        }
+        pthread_detach(tid);
+    }
+}
+
+// 一个连接上依次处理范围请求，直到客户端关闭连接
+void *framed_conn_run(void *arg)
+{
+    framed_conn *conn = arg;
+    xfer_stats stats = {0};
+    int ret, requests = 0;
+    uint64_t start = xfer_now_ns();
+    while ((ret = xfer_serve(conn->sock, conn->file_fd, conn->file_size, conn->chunk_size, &stats)) == 0)
+        requests++;
+    double sec = (xfer_now_ns() - start) / 1e9;
+    // 客户端取完最后一段后关闭连接，这时 xfer_serve 读请求读到 EOF，不算出错
+    printf("connection done: %d requests, %lu bytes in %lu chunks, %.1f MB/s, crc %.1f ms%s%s\n",
+           requests, stats.bytes, stats.chunks, stats.bytes / sec / 1e6, stats.crc_ns / 1e6,
+           ret == XFER_ERR_IO ? "" : ", ", ret == XFER_ERR_IO ? "" : xfer_strerror(ret));
+    if (stats.wire_bytes < stats.bytes) // 客户端要求了压缩
+        printf("  lz: wire %lu bytes, ratio %.2f, compress %.0f MB/s\n", stats.wire_bytes,
+               (double)stats.bytes / stats.wire_bytes, stats.codec_ns > 0 ? stats.bytes / (stats.codec_ns / 1e3) : 0.0);
+    close(conn->sock);
+    free(conn);
+    return NULL;
+}
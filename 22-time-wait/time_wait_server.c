@@ -39,6 +39,8 @@
  * - 第一是内存资源占用，这个目前看来不是太严重，基本可以忽略。
  * - 第二是对端口资源的占用，一个 TCP 连接至少消耗一个本地端口。要知道，端口资源也是有限的，一般可以开启的端口为 32768～61000 ，
  *    也可以通过net.ipv4.ip_local_port_range指定，如果 TIME_WAIT 状态过多，会导致无法创建新连接。
+ * 可以用 90-benchmark/churn_bench 实际测一下：不停地建立、关闭短连接，每秒输出连接数、失败次数和 TIME_WAIT 的个数，
+ * 也可以对比几种缓解办法（IP_BIND_ADDRESS_NO_PORT、轮换 127.0.0.0/8 里的源地址、SO_LINGER 直接发 RST）。
 */
 
 /**
@@ -0,0 +1,346 @@
+/**
+ * 由一个 acceptor 进程统一 accept，再把连接通过 UNIX 域套接字（SCM_RIGHTS）交给固定的几个 worker 进程：
+ * - mp_server.c 每个连接 fork 一个子进程，父进程没法决定谁来服务这个客户端；
+ * - prefork_server.c 让 worker 们抢同一个监听套接字，SO_REUSEPORT 则按四元组哈希分配，
+ *   两者都不看 worker 当前有多忙，长连接多的 worker 会一直被分到新连接；
+ * - 这里 acceptor 每次都把新连接交给当前负载最小的 worker，负载来自共享内存统计段（00-lib/shm_stats.h）：
+ *     负载 = 正在服务的连接数（active） + 已经发出、worker 还没收到的连接数
+ *   后一项是 acceptor 自己记的发送次数减去 worker 的累计连接数，避免一批连接同时到来时全部压给同一个 worker。
+ *
+ * 每个 worker 用 epoll 同时服务多个连接，和 acceptor 之间各有一对 socketpair，
+ * 收到的 fd 和 acceptor 里的是同一个套接字，acceptor 发送完就关闭自己的那份。
+ * worker 退出后 acceptor 在原槽位上重新拉起一个。统计同样可以用 stats_reader 查看：
+ *   ./handoff_server 9190 4 /echo_stats
+ *   ./stats_reader /echo_stats 1
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include "../00-lib/error.h"
+#include "../00-lib/shm_stats.h"
+#include "../00-lib/unix_sock.h"
+
+#define BUF_SIZE 1024
+#define EPOLL_SIZE 64
+#define DEFAULT_WORKERS 4
+#define DEFAULT_SHM_NAME "/echo_stats"
+
+typedef struct
+{
+    int channel;     // 和 worker 之间的 UNIX 域套接字（SOCK_SEQPACKET，保留消息边界），acceptor 这一端，非阻塞
+    uint64_t handed; // 已经交给这个 worker 的连接数
+    int skip;        // 这一次分配中发送失败过，暂时不选它
+} worker_slot;
+
+static volatile sig_atomic_t child_exited;
+
+void on_sigchld(int sig);
+int spawn_worker(shm_stats *stats, worker_slot *slots, int idx, int nworkers, int *listen_socks, int nlisten);
+void worker_run(int channel, worker_stats *ws);
+int pick_worker(shm_stats *stats, worker_slot *slots, int nworkers);
+void hand_off(shm_stats *stats, worker_slot *slots, int nworkers, int clnt_sock);
+
+int main(int argc, char *argv[])
+{
+    int serv_sock;
+    struct sockaddr_in serv_addr;
+    int nworkers = DEFAULT_WORKERS;
+    const char *shm_name = DEFAULT_SHM_NAME;
+
+    if (argc < 2 || argc > 4)
+    {
+        printf("Usage: %s <port> [workers] [shm name]\n", argv[0]);
+        exit(1);
+    }
+    if (argc >= 3)
+        nworkers = atoi(argv[2]);
+    if (argc == 4)
+        shm_name = argv[3];
+
+    shm_stats *stats = shm_stats_create(shm_name, nworkers);
+    if (stats == NULL)
+        error_handling("shm_stats_create() error");
+
+    serv_sock = socket(PF_INET, SOCK_STREAM, 0);
+    if (serv_sock == -1)
+        error_handling("socket() error");
+
+    // 打开 SO_REUSEADDR
+    int option = 1;
+    int optlen = sizeof(option);
+    setsockopt(serv_sock, SOL_SOCKET, SO_REUSEADDR, (void *)&option, optlen);
+
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    serv_addr.sin_port = htons(atoi(argv[1]));
+
+    if (bind(serv_sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
+        error_handling("bind() error");
+
+    // acceptor 一个进程要接所有的连接，队列留大一点，它被调度出去的时候新连接不会被丢掉
+    if (listen(serv_sock, 1024) == -1)
+        error_handling("listen error");
+
+    // 同样的服务也放在 UNIX 域套接字上（见 00-lib/unix_sock.h）
+    struct pollfd listeners[2];
+    int nlisten = 0;
+    listeners[nlisten].fd = serv_sock;
+    listeners[nlisten++].events = POLLIN;
+    int unix_sock = unix_listen_port(atoi(argv[1]), 1024);
+    if (unix_sock == -1)
+        perror("unix_listen() error");
+    else
+    {
+        listeners[nlisten].fd = unix_sock;
+        listeners[nlisten++].events = POLLIN;
+    }
+    int listen_socks[2] = {serv_sock, unix_sock};
+
+    // worker 退出时 poll 会被打断，由主循环回收并重新拉起。
+    // SIGCHLD 平时屏蔽，只在 ppoll 里放开：检查 child_exited 和进入 poll 之间到达的信号会留到 ppoll 时递送，
+    // 否则 poll 会一直阻塞到下一个连接到来，退出的 worker 这段时间都不会被拉起
+    struct sigaction act;
+    act.sa_handler = on_sigchld;
+    sigemptyset(&act.sa_mask);
+    act.sa_flags = 0;
+    sigaction(SIGCHLD, &act, 0);
+    sigset_t chld_mask, poll_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &poll_mask);
+    sigdelset(&poll_mask, SIGCHLD);
+    // worker 已经退出时 send_fd 会收到 EPIPE，不能让 SIGPIPE 杀掉 acceptor
+    signal(SIGPIPE, SIG_IGN);
+
+    worker_slot *slots = calloc(nworkers, sizeof(worker_slot));
+    for (int i = 0; i < nworkers; i++)
+        if (spawn_worker(stats, slots, i, nworkers, listen_socks, nlisten) == -1)
+            error_handling("spawn_worker() error");
+
+    printf("%d workers started, stats in shm %s\n", nworkers, shm_name);
+
+    while (1)
+    {
+        if (child_exited)
+        {
+            child_exited = 0;
+            pid_t pid;
+            while ((pid = waitpid(-1, NULL, WNOHANG)) > 0)
+            {
+                for (int i = 0; i < nworkers; i++)
+                {
+                    if (stats->slots[i].pid != pid)
+                        continue;
+                    printf("worker %d (pid %d) exited, respawning\n", i, pid);
+                    spawn_worker(stats, slots, i, nworkers, listen_socks, nlisten);
+                    break;
+                }
+            }
+        }
+
+        if (ppoll(listeners, nlisten, NULL, &poll_mask) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (int l = 0; l < nlisten; l++)
+        {
+            if (!(listeners[l].revents & POLLIN))
+                continue;
+            int clnt_sock = accept(listeners[l].fd, NULL, NULL);
+            if (clnt_sock == -1)
+                continue;
+            hand_off(stats, slots, nworkers, clnt_sock);
+            // worker 收到的是同一个套接字的新 fd，acceptor 这份可以关了
+            close(clnt_sock);
+        }
+    }
+
+    close(serv_sock);
+    shm_unlink(shm_name);
+    return 0;
+}
+
+void on_sigchld(int sig)
+{
+    (void)sig;
+    child_exited = 1;
+}
+
+int pick_worker(shm_stats *stats, worker_slot *slots, int nworkers)
+{
+    int best = 0;
+    uint64_t best_load = UINT64_MAX;
+    for (int i = 0; i < nworkers; i++)
+    {
+        if (slots[i].skip)
+            continue;
+        worker_stats *ws = &stats->slots[i];
+        // 发出去但 worker 还没收到的连接也算进负载
+        uint64_t in_flight = slots[i].handed - stats_read(&ws->connections);
+        uint64_t load = stats_read(&ws->active) + in_flight;
+        if (load < best_load)
+        {
+            best = i;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+/**
+ * 把连接交给负载最小的 worker。
+ * 通道是非阻塞的：SOCK_SEQPACKET 的接收队列只能排 net.unix.max_dgram_qlen（默认 10）条消息，
+ * worker 来不及取时发送返回 EAGAIN，这时换下一个负载最小的；worker 刚好退出时发送也会失败，同样跳过。
+ * 所有 worker 都满了，就等负载最小的那个的通道可写，最多等 100ms，还是不行就放弃这个连接。
+ */
+void hand_off(shm_stats *stats, worker_slot *slots, int nworkers, int clnt_sock)
+{
+    int sent = 0;
+    for (int tries = 0; tries < nworkers && !sent; tries++)
+    {
+        int w = pick_worker(stats, slots, nworkers);
+        if (send_fd(slots[w].channel, clnt_sock, NULL, 0) != -1)
+        {
+            slots[w].handed++;
+            sent = 1;
+        }
+        else
+            slots[w].skip = 1;
+    }
+    for (int i = 0; i < nworkers; i++)
+        slots[i].skip = 0;
+    if (sent)
+        return;
+
+    int w = pick_worker(stats, slots, nworkers);
+    struct pollfd pfd = {slots[w].channel, POLLOUT, 0};
+    if (poll(&pfd, 1, 100) == 1 && send_fd(slots[w].channel, clnt_sock, NULL, 0) != -1)
+        slots[w].handed++;
+}
+
+// 在槽位 idx 上（重新）创建一个 worker 和它的通道
+int spawn_worker(shm_stats *stats, worker_slot *slots, int idx, int nworkers, int *listen_socks, int nlisten)
+{
+    int sv[2];
+    worker_stats *ws = &stats->slots[idx];
+
+    if (slots[idx].channel > 0)
+        close(slots[idx].channel);
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1)
+        return -1;
+
+    // 异常退出的 worker 可能还没来得及把 active 减回去，还在通道里的连接也已经丢了
+    __atomic_store_n(&ws->active, 0, __ATOMIC_RELAXED);
+    slots[idx].handed = stats_read(&ws->connections);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // worker 不需要监听套接字，也不需要其他 worker 的通道
+        for (int l = 0; l < nlisten; l++)
+            close(listen_socks[l]);
+        for (int i = 0; i < nworkers; i++)
+            if (i != idx && slots[i].channel > 0)
+                close(slots[i].channel);
+        close(sv[0]);
+        signal(SIGCHLD, SIG_DFL);
+        sigset_t chld_mask;
+        sigemptyset(&chld_mask);
+        sigaddset(&chld_mask, SIGCHLD);
+        sigprocmask(SIG_UNBLOCK, &chld_mask, NULL);
+        worker_run(sv[1], ws);
+        exit(0);
+    }
+    close(sv[1]);
+    if (pid == -1)
+    {
+        close(sv[0]);
+        slots[idx].channel = 0;
+        return -1;
+    }
+    ws->pid = pid;
+    slots[idx].channel = sv[0];
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL, 0) | O_NONBLOCK);
+    return 0;
+}
+
+void worker_run(int channel, worker_stats *ws)
+{
+    struct epoll_event events[EPOLL_SIZE];
+    struct epoll_event event;
+    char buf[BUF_SIZE];
+
+    int epfd = epoll_create(EPOLL_SIZE);
+    event.events = EPOLLIN;
+    event.data.fd = channel;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, channel, &event);
+
+    while (1)
+    {
+        int n = epoll_wait(epfd, events, EPOLL_SIZE, -1);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == channel) // acceptor 交过来的新连接
+            {
+                int clnt_sock;
+                char dummy;
+                if (recv_fd(channel, &clnt_sock, &dummy, 1) <= 0)
+                    return; // acceptor 退出了
+                if (clnt_sock == -1)
+                    continue;
+
+                event.events = EPOLLIN;
+                event.data.fd = clnt_sock;
+                epoll_ctl(epfd, EPOLL_CTL_ADD, clnt_sock, &event);
+                stats_add(&ws->connections, 1);
+                stats_add(&ws->active, 1);
+            }
+            else
+            {
+                int str_len = read(fd, buf, BUF_SIZE);
+                if (str_len <= 0) // close request
+                {
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+                    close(fd);
+                    stats_sub(&ws->active, 1);
+                    continue;
+                }
+
+                // 延迟统计的是服务端处理一次请求的时间：从读到数据到回写完成
+                uint64_t start = stats_now_ns();
+                int write_len = write(fd, buf, str_len);
+
+                stats_add(&ws->requests, 1);
+                stats_add(&ws->bytes_in, str_len);
+                if (write_len > 0)
+                    stats_add(&ws->bytes_out, write_len);
+                stats_record_latency(ws, stats_now_ns() - start);
+            }
+        }
+    }
+}
+
+// 客户端可以用 05/echo_client.c
@@ -0,0 +1,155 @@
+/**
+ * 预先 fork 的 echo 服务端（prefork），并把统计数据放在共享内存里：
+ * - 父进程创建监听套接字后一次性 fork 出 N 个 worker，worker 们在同一个监听套接字上各自 accept；
+ * - mp_server.c 里每个子进程的计数器随着子进程退出就没了，也没有全局视图，
+ *   这里每个 worker 把连接数、字节数、请求数和延迟直方图写进共享内存中属于自己的槽位（见 00-lib/shm_stats.h）；
+ * - 父进程只负责在 worker 退出时在原槽位上重新拉起一个，槽位里的累计值不会丢。
+ *
+ * 观察运行中的服务不需要 attach 调试器，用同目录下的 stats_reader 读共享内存即可：
+ *   ./prefork_server 9190 4 /echo_stats
+ *   ./stats_reader /echo_stats 1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "../00-lib/error.h"
+#include "../00-lib/shm_stats.h"
+
+#define BUF_SIZE 1024
+#define DEFAULT_WORKERS 4
+#define DEFAULT_SHM_NAME "/echo_stats"
+
+pid_t spawn_worker(int serv_sock, worker_stats *ws);
+void worker_run(int serv_sock, worker_stats *ws);
+
+int main(int argc, char *argv[])
+{
+    int serv_sock;
+    struct sockaddr_in serv_addr;
+    int nworkers = DEFAULT_WORKERS;
+    const char *shm_name = DEFAULT_SHM_NAME;
+
+    if (argc < 2 || argc > 4)
+    {
+        printf("Usage: %s <port> [workers] [shm name]\n", argv[0]);
+        exit(1);
+    }
+    if (argc >= 3)
+        nworkers = atoi(argv[2]);
+    if (argc == 4)
+        shm_name = argv[3];
+
+    shm_stats *stats = shm_stats_create(shm_name, nworkers);
+    if (stats == NULL)
+        error_handling("shm_stats_create() error");
+
+    serv_sock = socket(PF_INET, SOCK_STREAM, 0);
+    if (serv_sock == -1)
+        error_handling("socket() error");
+
+    // 打开 SO_REUSEADDR
+    int option = 1;
+    int optlen = sizeof(option);
+    setsockopt(serv_sock, SOL_SOCKET, SO_REUSEADDR, (void *)&option, optlen);
+
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    serv_addr.sin_port = htons(atoi(argv[1]));
+
+    if (bind(serv_sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
+        error_handling("bind() error");
+
+    if (listen(serv_sock, 128) == -1)
+        error_handling("listen error");
+
+    for (int i = 0; i < nworkers; i++)
+        if (spawn_worker(serv_sock, &stats->slots[i]) == -1)
+            error_handling("fork() error");
+
+    printf("%d workers started, stats in shm %s\n", nworkers, shm_name);
+
+    /**
+     * 父进程阻塞在 wait 上回收子进程，不需要像 mp_server.c 那样注册 SIGCHLD 处理函数。
+     * 哪个 worker 退出了，就在它原来的槽位上重新 fork 一个。
+     */
+    while (1)
+    {
+        int status;
+        pid_t pid = wait(&status);
+        if (pid == -1)
+            break;
+
+        for (int i = 0; i < nworkers; i++)
+        {
+            worker_stats *ws = &stats->slots[i];
+            if (ws->pid != pid)
+                continue;
+            // 子进程异常退出时可能还没来得及把 active 减回去
+            __atomic_store_n(&ws->active, 0, __ATOMIC_RELAXED);
+            printf("worker %d (pid %d) exited, respawning\n", i, pid);
+            spawn_worker(serv_sock, ws);
+            break;
+        }
+    }
+
+    close(serv_sock);
+    shm_unlink(shm_name);
+    return 0;
+}
+
+pid_t spawn_worker(int serv_sock, worker_stats *ws)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        worker_run(serv_sock, ws);
+        exit(0);
+    }
+    if (pid > 0)
+        ws->pid = pid;
+    return pid;
+}
+
+void worker_run(int serv_sock, worker_stats *ws)
+{
+    struct sockaddr_in clnt_addr;
+    socklen_t clnt_addr_size;
+    char buf[BUF_SIZE];
+    int clnt_sock, str_len;
+
+    while (1)
+    {
+        clnt_addr_size = sizeof(clnt_addr);
+        clnt_sock = accept(serv_sock, (struct sockaddr *)&clnt_addr, &clnt_addr_size);
+        if (clnt_sock == -1)
+            continue;
+
+        stats_add(&ws->connections, 1);
+        stats_add(&ws->active, 1);
+
+        while ((str_len = read(clnt_sock, buf, BUF_SIZE)) > 0)
+        {
+            // 延迟统计的是服务端处理一次请求的时间：从读到数据到回写完成
+            uint64_t start = stats_now_ns();
+            int write_len = write(clnt_sock, buf, str_len);
+
+            stats_add(&ws->requests, 1);
+            stats_add(&ws->bytes_in, str_len);
+            if (write_len > 0)
+                stats_add(&ws->bytes_out, write_len);
+            stats_record_latency(ws, stats_now_ns() - start);
+        }
+
+        close(clnt_sock);
+        stats_sub(&ws->active, 1);
+    }
+}
+
+// 客户端可以用 05/echo_client.c
@@ -0,0 +1,135 @@
+/**
+ * 读取 prefork_server 的共享内存统计段，按固定间隔采样并打印速率。
+ * - 只读映射，不会影响服务端，也不需要 attach 到任何一个 worker 进程；
+ * - 每次采样和上一次做差，得到每秒连接数、请求数、吞吐，以及这个区间内的延迟分位数。
+ *
+ * 用法：./stats_reader /echo_stats 1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../00-lib/error.h"
+#include "../00-lib/shm_stats.h"
+
+#define DEFAULT_SHM_NAME "/echo_stats"
+
+typedef struct
+{
+    uint64_t connections;
+    uint64_t requests;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t latency[SHM_STATS_LAT_BUCKETS];
+} stats_sample;
+
+void take_sample(const worker_stats *ws, stats_sample *s);
+uint64_t percentile_us(const uint64_t *buckets, double p);
+
+int main(int argc, char *argv[])
+{
+    const char *shm_name = DEFAULT_SHM_NAME;
+    int interval = 1;
+
+    if (argc > 3)
+    {
+        printf("Usage: %s [shm name] [interval sec]\n", argv[0]);
+        exit(1);
+    }
+    if (argc >= 2)
+        shm_name = argv[1];
+    if (argc == 3)
+        interval = atoi(argv[2]) > 0 ? atoi(argv[2]) : 1;
+
+    const shm_stats *st = shm_stats_open(shm_name);
+    if (st == NULL)
+        error_handling("shm_stats_open() error, is the server running?");
+
+    int n = st->nworkers;
+    stats_sample *prev = calloc(n, sizeof(stats_sample));
+    stats_sample *cur = calloc(n, sizeof(stats_sample));
+    for (int i = 0; i < n; i++)
+        take_sample(&st->slots[i], &prev[i]);
+    uint64_t prev_ns = stats_now_ns();
+
+    while (1)
+    {
+        sleep(interval);
+        uint64_t now_ns = stats_now_ns();
+        double secs = (now_ns - prev_ns) / 1e9;
+
+        stats_sample total;
+        uint64_t total_active = 0;
+        memset(&total, 0, sizeof(total));
+
+        printf("%-6s %-8s %8s %10s %10s %10s %10s %8s %8s\n",
+               "worker", "pid", "active", "conn/s", "req/s", "in MB/s", "out MB/s", "p50 us", "p99 us");
+        for (int i = 0; i < n; i++)
+        {
+            const worker_stats *ws = &st->slots[i];
+            stats_sample d;
+            take_sample(ws, &cur[i]);
+            d.connections = cur[i].connections - prev[i].connections;
+            d.requests = cur[i].requests - prev[i].requests;
+            d.bytes_in = cur[i].bytes_in - prev[i].bytes_in;
+            d.bytes_out = cur[i].bytes_out - prev[i].bytes_out;
+            for (int b = 0; b < SHM_STATS_LAT_BUCKETS; b++)
+            {
+                d.latency[b] = cur[i].latency[b] - prev[i].latency[b];
+                total.latency[b] += d.latency[b];
+            }
+            total.connections += d.connections;
+            total.requests += d.requests;
+            total.bytes_in += d.bytes_in;
+            total.bytes_out += d.bytes_out;
+            uint64_t active = stats_read(&ws->active);
+            total_active += active;
+
+            printf("%-6d %-8d %8lu %10.0f %10.0f %10.2f %10.2f %8lu %8lu\n",
+                   i, ws->pid, active,
+                   d.connections / secs, d.requests / secs,
+                   d.bytes_in / secs / 1e6, d.bytes_out / secs / 1e6,
+                   percentile_us(d.latency, 0.50), percentile_us(d.latency, 0.99));
+            prev[i] = cur[i];
+        }
+        printf("%-6s %-8s %8lu %10.0f %10.0f %10.2f %10.2f %8lu %8lu\n\n",
+               "total", "-", total_active,
+               total.connections / secs, total.requests / secs,
+               total.bytes_in / secs / 1e6, total.bytes_out / secs / 1e6,
+               percentile_us(total.latency, 0.50), percentile_us(total.latency, 0.99));
+        fflush(stdout);
+        prev_ns = now_ns;
+    }
+
+    return 0;
+}
+
+void take_sample(const worker_stats *ws, stats_sample *s)
+{
+    s->connections = stats_read(&ws->connections);
+    s->requests = stats_read(&ws->requests);
+    s->bytes_in = stats_read(&ws->bytes_in);
+    s->bytes_out = stats_read(&ws->bytes_out);
+    for (int b = 0; b < SHM_STATS_LAT_BUCKETS; b++)
+        s->latency[b] = stats_read(&ws->latency[b]);
+}
+
+// 返回分位数所在桶的上界，没有样本时返回 0
+uint64_t percentile_us(const uint64_t *buckets, double p)
+{
+    uint64_t total = 0, seen = 0;
+    for (int b = 0; b < SHM_STATS_LAT_BUCKETS; b++)
+        total += buckets[b];
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(total * p);
+    for (int b = 0; b < SHM_STATS_LAT_BUCKETS; b++)
+    {
+        seen += buckets[b];
+        if (seen > rank)
+            return stats_bucket_upper_us(b);
+    }
+    return stats_bucket_upper_us(SHM_STATS_LAT_BUCKETS - 1);
+}
@@ -0,0 +1,165 @@
+/**
+ * 突破 FD_SETSIZE 限制的 select echo 服务端。
+ *
+ * select_server.c 有两个问题：
+ * - fd_set 是固定 1024 位的，fd 超过 1023 以后 FD_SET 会写越界；
+ * - 每次 select 返回后都要用 FD_ISSET 从 0 到 fd_max 逐个测试，哪怕只有一个 fd 就绪。
+ *
+ * 这里改用 00-lib/fd_bitmap.h 里可以动态扩容的位图（内核只看 nfds，不关心 fd_set 有多大），
+ * 返回后按 64 位一个字扫描，用 ctz 指令直接定位到置位的 bit，而且处理完 select 返回的就绪数量就停止扫描。
+ * select 每次调用仍要把整个位图拷贝进内核，这是它本身的代价，但至少连接数超过 1024 时还能继续工作。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <errno.h>
+#include "../00-lib/error.h"
+#include "../00-lib/loop_stats.h"
+#include "../00-lib/fd_bitmap.h"
+#include "../00-lib/unix_sock.h"
+
+#define BUF_SIZE 100
+
+int main(int argc, char *argv[])
+{
+    int serv_sock, clnt_sock;
+    struct sockaddr_in serv_addr, clnt_addr;
+    socklen_t clnt_addr_size;
+    char buf[BUF_SIZE];
+
+    struct timeval timeout;
+    fd_bitmap reads, cpy_reads;
+    int fd_max, str_len, fd_num;
+
+    if (argc != 2)
+    {
+        printf("Usage: %s <port>\n", argv[0]);
+        exit(1);
+    }
+
+    serv_sock = socket(PF_INET, SOCK_STREAM, 0);
+    if (serv_sock == -1)
+        error_handling("socket() error");
+
+    // 打开 SO_REUSEADDR
+    int option = 1;
+    int optlen = sizeof(option);
+    setsockopt(serv_sock, SOL_SOCKET, SO_REUSEADDR, (void *)&option, optlen);
+
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    serv_addr.sin_port = htons(atoi(argv[1]));
+
+    if (bind(serv_sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
+        error_handling("bind() error");
+
+    if (listen(serv_sock, 128) == -1)
+        error_handling("listen error");
+
+    // 同时在 UNIX 域套接字上提供同样的服务（见 00-lib/unix_sock.h）
+    int unix_sock = unix_listen_port(atoi(argv[1]), 128);
+    if (unix_sock == -1)
+        perror("unix_listen() error");
+
+    // 事件循环的计数器，kill -USR1 <pid> 时输出到 stderr
+    loop_stats *ls = loop_stats_register("select_bitmap");
+
+    if (fd_bitmap_init(&reads, FD_SETSIZE) == -1 || fd_bitmap_init(&cpy_reads, FD_SETSIZE) == -1)
+        error_handling("fd_bitmap_init() error");
+    fd_bitmap_set(&reads, serv_sock);
+    fd_max = serv_sock;
+    if (unix_sock != -1)
+    {
+        fd_bitmap_set(&reads, unix_sock);
+        fd_max = unix_sock;
+    }
+
+    while (1)
+    {
+        // 只拷贝 [0, fd_max] 覆盖到的字，而不是整个位图
+        fd_bitmap_copy(&cpy_reads, &reads, fd_max + 1);
+
+        // 每次都重新设置 timeout，select 返回时会把它改写成剩余时间
+        timeout.tv_sec = 5;
+        timeout.tv_usec = 0;
+
+        if ((fd_num = select(fd_max + 1, fd_bitmap_as_fdset(&cpy_reads), 0, 0, &timeout)) == -1)
+        {
+            if (errno == EINTR) // 被 SIGUSR1 打断
+            {
+                loop_stats_poll();
+                continue;
+            }
+            break; // exception
+        }
+        loop_stats_wakeup(ls, fd_num);
+        loop_stats_poll();
+        if (fd_num == 0) // timeout
+            continue;
+
+        // 这一轮里 fd_max 可能因为 accept 变大，扫描范围用 select 时的值
+        int nfds = fd_max + 1;
+        for (int i = fd_bitmap_next(&cpy_reads, 0, nfds); i >= 0 && fd_num > 0;
+             i = fd_bitmap_next(&cpy_reads, i + 1, nfds))
+        {
+            fd_num--;
+            if (i == serv_sock || i == unix_sock) // connection requets
+            {
+                clnt_addr_size = sizeof(clnt_addr);
+                clnt_sock = accept(i, (struct sockaddr *)&clnt_addr, &clnt_addr_size);
+                LS_INC(ls, syscalls);
+                if (clnt_sock == -1)
+                    continue;
+                // 位图容量不够时扩容，扩容失败只拒绝这一个连接
+                if (fd_bitmap_reserve(&reads, clnt_sock) == -1)
+                {
+                    close(clnt_sock);
+                    continue;
+                }
+                fd_bitmap_set(&reads, clnt_sock);
+                if (fd_max < clnt_sock)
+                    fd_max = clnt_sock;
+                LS_INC(ls, accepts);
+                LS_INC(ls, queue_depth);
+            }
+            else // read message
+            {
+                str_len = read(i, buf, BUF_SIZE);
+                LS_INC(ls, syscalls);
+                if (str_len <= 0) // close request
+                {
+                    fd_bitmap_clr(&reads, i);
+                    close(i);
+                    // 关闭的正好是最大的 fd 时，把 fd_max 往回收缩，下次 select 扫描的范围更小
+                    while (fd_max > serv_sock && !fd_bitmap_isset(&reads, fd_max))
+                        fd_max--;
+                    LS_INC(ls, syscalls);
+                    LS_INC(ls, closes);
+                    LS_DEC(ls, queue_depth);
+                }
+                else
+                {
+                    LS_ADD(ls, bytes_in, str_len);
+                    str_len = write(i, buf, str_len);
+                    LS_INC(ls, syscalls);
+                    if (str_len > 0)
+                        LS_ADD(ls, bytes_out, str_len);
+                }
+            }
+        }
+    }
+
+    close(serv_sock);
+    fd_bitmap_free(&reads);
+    fd_bitmap_free(&cpy_reads);
+    return 0;
+}
+
+// 客户端可以用 05/echo_client.c
@@ -21,7 +21,10 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <errno.h>
 #include "../00-lib/error.h"
+#include "../00-lib/loop_stats.h"
+#include "../00-lib/unix_sock.h"
 
 #define BUF_SIZE 100
 
@@ -62,6 +65,11 @@ int main(int argc, char *argv[])
     if (listen(serv_sock, 5) == -1)
         error_handling("listen error");
 
+    // 同时在 UNIX 域套接字上提供同样的服务，本机客户端可以绕过 TCP/IP 协议栈（见 00-lib/unix_sock.h）
+    int unix_sock = unix_listen_port(atoi(argv[1]), 5);
+    if (unix_sock == -1)
+        perror("unix_listen() error");
+
     /**
      * 操作关注事件的描述符集的函数有：
      * - FD_ZERO(fd_set *fdset)         : 将 fd_set 变量的所有位初始化为0
@@ -69,24 +77,45 @@ int main(int argc, char *argv[])
      * - FD_CLR(int fd, fd_set *fdset)  : 在参数 fdset 指向的变量中取消注册 fd
      * - FD_ISSET(int fd, fd_set *fdset): 测试 参数 fdset 指向的变量中是否注册了 fd
      */
+    // 事件循环的计数器，kill -USR1 <pid> 时输出到 stderr
+    loop_stats *ls = loop_stats_register("select");
+
     FD_ZERO(&reads);
     FD_SET(serv_sock, &reads);
     fd_max = serv_sock;
-
-    // 设置 timeout 时间
-    timeout.tv_sec = 5;
-    timeout.tv_usec = 0;
+    if (unix_sock != -1)
+    {
+        FD_SET(unix_sock, &reads);
+        fd_max = unix_sock;
+    }
 
     while (1)
     {
         // 一次select 操作中，把对 fdset 的操作分开，读取数据用 cpy_reads, 写入新数据用 reads
         cpy_reads = reads;
 
+        /**
+         * 设置 timeout 时间，注意每次调用 select 之前都要重新设置：
+         * Linux 的 select 返回时会把 timeout 改写成剩余的时间，如果只在循环外设置一次，
+         * 第一次超时之后 timeout 就变成 0，select 会退化成不停空转的轮询。
+         */
+        timeout.tv_sec = 5;
+        timeout.tv_usec = 0;
+
         /**
          * 第一个参数是 fd_max + 1，是因为 fd 从 0 开始
          */
         if ((fd_num = select(fd_max + 1, &cpy_reads, 0, 0, &timeout)) == -1)
-            break;       // exception
+        {
+            if (errno == EINTR) // 被 SIGUSR1 打断
+            {
+                loop_stats_poll();
+                continue;
+            }
+            break; // exception
+        }
+        loop_stats_wakeup(ls, fd_num);
+        loop_stats_poll();
         if (fd_num == 0) // timeout
             continue;
 
@@ -94,28 +123,50 @@ int main(int argc, char *argv[])
         {
             if (FD_ISSET(i, &cpy_reads))
             {
-                if (i == serv_sock) // connection requets
+                if (i == serv_sock || i == unix_sock) // connection requets
                 {
                     clnt_addr_size = sizeof(clnt_addr);
-                    clnt_sock = accept(serv_sock, (struct sockaddr *)&clnt_addr, &clnt_addr_size);
+                    clnt_sock = accept(i, (struct sockaddr *)&clnt_addr, &clnt_addr_size);
+                    if (clnt_sock == -1)
+                        continue;
+                    /**
+                     * fd_set 只有 FD_SETSIZE 位，超过的 fd 再 FD_SET 就会写越界，
+                     * 这里只能拒绝这个连接。需要更多连接时用 select_bitmap_server.c。
+                     */
+                    if (clnt_sock >= FD_SETSIZE)
+                    {
+                        close(clnt_sock);
+                        continue;
+                    }
                     // 把新受理的连接请求对应的socket放入关注事件fd集合
                     FD_SET(clnt_sock, &reads);
                     if (fd_max < clnt_sock)
                         fd_max = clnt_sock;
-                    printf("connected client fd: %d\n", clnt_sock);
+                    LS_INC(ls, syscalls);
+                    LS_INC(ls, accepts);
+                    LS_INC(ls, queue_depth);
                 }
                 else // read message
                 {
                     str_len = read(i, buf, BUF_SIZE);
-                    if (str_len == 0) // close request
+                    LS_INC(ls, syscalls);
+                    if (str_len <= 0) // close request
                     {
                         // 把即将要关闭的socket从关注事件fd集合清除
                         FD_CLR(i, &reads);
                         close(i);
-                        printf("closed client fd: %d\n", i);
+                        LS_INC(ls, syscalls);
+                        LS_INC(ls, closes);
+                        LS_DEC(ls, queue_depth);
                     }
                     else
-                        write(i, buf, str_len);
+                    {
+                        LS_ADD(ls, bytes_in, str_len);
+                        str_len = write(i, buf, str_len);
+                        LS_INC(ls, syscalls);
+                        if (str_len > 0)
+                            LS_ADD(ls, bytes_out, str_len);
+                    }
                 }
             }
         }
@@ -47,10 +47,35 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/poll.h>
+#include <errno.h>
 #include "../00-lib/error.h"
+#include "../00-lib/loop_stats.h"
+#include "../00-lib/unix_sock.h"
 
 #define BUF_SIZE 100
-#define POLL_SIZE 128
+#define INIT_POLL_SIZE 128
+
+/**
+ * 紧凑的 pollfd 数组：
+ * - 数组 [0, nfds) 全部是有效的 fd，poll 只需要传 nfds 个元素，而不是固定的 POLL_SIZE 个；
+ * - 关闭连接时不立即挪动数组（否则正在遍历的下标会错乱），只把 fd 置为 -1（poll 会忽略负的 fd），
+ *   并把这个空洞的下标放进 free_list；
+ * - 一轮事件处理完之后再做压缩：用数组末尾的有效元素填补空洞，每个空洞 O(1)；
+ * - 容量不够时按 2 倍扩容，不再因为连接太多而退出整个服务器。
+ */
+typedef struct
+{
+    struct pollfd *fds;
+    int nfds;
+    int capacity;
+    int *free_list; // 本轮产生的空洞下标
+    int free_cnt;
+} poll_set;
+
+int poll_set_init(poll_set *ps, int cap);
+int poll_set_add(poll_set *ps, int fd, short events);
+void poll_set_remove(poll_set *ps, int idx);
+void poll_set_compact(poll_set *ps);
 
 int main(int argc, char *argv[])
 {
@@ -82,75 +107,162 @@ int main(int argc, char *argv[])
     if (bind(serv_sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
         error_handling("bind() error");
 
-    if (listen(serv_sock, 5) == -1)
+    if (listen(serv_sock, 128) == -1)
         error_handling("listen error");
 
+    // 同时在 UNIX 域套接字上提供同样的服务（见 00-lib/unix_sock.h）
+    int unix_sock = unix_listen_port(atoi(argv[1]), 128);
+    if (unix_sock == -1)
+        perror("unix_listen() error");
+
+    // 事件循环的计数器，kill -USR1 <pid> 时输出到 stderr
+    loop_stats *ls = loop_stats_register("poll");
+
     /**
-     * 初始化 pollfd 数组，这个数组的第一个元素是 listen_fd，其余的用来记录将要连接的 connect_fd
+     * 初始化 pollfd 数组，数组的前 nlisten 个元素是监听套接字（TCP 和 UNIX 域），其余的用来记录将要连接的 connect_fd。
+     * 监听套接字不会被移除，紧凑化只会挪动它们后面的元素。
      */
-    struct pollfd event_set[POLL_SIZE];
-    event_set[0].fd = serv_sock;
-    event_set[0].events = POLLRDNORM;
-    // 用 -1 表示这个数组位置还没有被占用
-    for (int i = 1; i < POLL_SIZE; i++)
-    {
-        event_set[i].fd = -1;
-    }
+    poll_set ps;
+    if (poll_set_init(&ps, INIT_POLL_SIZE) == -1)
+        error_handling("poll_set_init() error");
+    poll_set_add(&ps, serv_sock, POLLRDNORM);
+    if (unix_sock != -1)
+        poll_set_add(&ps, unix_sock, POLLRDNORM);
+    int nlisten = ps.nfds;
 
     int ready_num, str_len;
 
     while (1)
     {
-        if ((ready_num = poll(event_set, POLL_SIZE, -1)) < 0)
+        if ((ready_num = poll(ps.fds, ps.nfds, -1)) < 0)
+        {
+            if (errno == EINTR) // 被 SIGUSR1 打断
+            {
+                loop_stats_poll();
+                continue;
+            }
             break; // exception
-printf("poll return: %d\n", ready_num);
-        if (event_set[0].revents & POLLRDNORM) // connection requets
+        }
+        loop_stats_wakeup(ls, ready_num);
+        loop_stats_poll();
+        for (int l = 0; l < nlisten; l++) // connection requets
         {
+            if (!(ps.fds[l].revents & POLLRDNORM))
+                continue;
             clnt_addr_size = sizeof(clnt_addr);
-            clnt_sock = accept(serv_sock, (struct sockaddr *)&clnt_addr, &clnt_addr_size);
-            // 找到一个可以记录该连接套接字的位置
-            int i;
-            for (i = 1; i < POLL_SIZE; i++)
+            clnt_sock = accept(ps.fds[l].fd, (struct sockaddr *)&clnt_addr, &clnt_addr_size);
+            LS_INC(ls, syscalls);
+            if (clnt_sock >= 0)
             {
-                if (event_set[i].fd < 0)
+                // 新连接追加到数组末尾，数组满了就扩容，扩容失败只拒绝这一个连接
+                if (poll_set_add(&ps, clnt_sock, POLLRDNORM) == -1)
+                {
+                    close(clnt_sock);
+                    LS_INC(ls, syscalls);
+                }
+                else
                 {
-                    event_set[i].fd = clnt_sock;
-                    event_set[i].events = POLLRDNORM;
-                    break;
+                    LS_INC(ls, accepts);
+                    LS_INC(ls, queue_depth);
                 }
             }
-            if (i == POLL_SIZE)
-                error_handling("can not hold so many clients");
-            else
-                printf("connected client fd: %d\n", clnt_sock);
 
-            if (--ready_num <= 0) // 如果没有其他事件了
-                continue;
+            ready_num--;
         }
-        for (int i = 1; i < POLL_SIZE && ready_num > 0; i++) // 循环判断每个 poll 是否有事件发生
+        // 循环判断每个 poll 是否有事件发生，已经处理完 poll 返回的就绪数量就停止扫描
+        for (int i = nlisten; i < ps.nfds && ready_num > 0; i++)
         {
-            int socket_fd = event_set[i].fd;
-            if (socket_fd < 0)
+            int socket_fd = ps.fds[i].fd;
+            if (socket_fd < 0 || ps.fds[i].revents == 0)
                 continue;
-            if (event_set[i].revents & (POLLRDNORM | POLLERR))
+            ready_num--;
+
+            if (ps.fds[i].revents & (POLLRDNORM | POLLERR | POLLHUP | POLLNVAL))
             {
                 str_len = read(socket_fd, buf, BUF_SIZE);
-                if (str_len == 0) // close request
+                LS_INC(ls, syscalls);
+                if (str_len <= 0) // close request
                 {
                     close(socket_fd);
-                    event_set[i].fd = -1;
-                    printf("closed client fd: %d\n", socket_fd);
+                    poll_set_remove(&ps, i);
+                    LS_INC(ls, syscalls);
+                    LS_INC(ls, closes);
+                    LS_DEC(ls, queue_depth);
                 }
                 else
-                    write(socket_fd, buf, str_len);
-
-                ready_num--;
+                {
+                    LS_ADD(ls, bytes_in, str_len);
+                    str_len = write(socket_fd, buf, str_len);
+                    LS_INC(ls, syscalls);
+                    if (str_len > 0)
+                        LS_ADD(ls, bytes_out, str_len);
+                }
             }
         }
+        // 本轮的空洞都处理掉，下次传给 poll 的数组是紧凑的
+        poll_set_compact(&ps);
     }
 
     close(serv_sock);
     return 0;
 }
 
+int poll_set_init(poll_set *ps, int cap)
+{
+    ps->fds = malloc(sizeof(struct pollfd) * cap);
+    ps->free_list = malloc(sizeof(int) * cap);
+    if (ps->fds == NULL || ps->free_list == NULL)
+        return -1;
+    ps->nfds = 0;
+    ps->free_cnt = 0;
+    ps->capacity = cap;
+    return 0;
+}
+
+// 追加一个 fd，返回它的下标，内存不足时返回 -1
+int poll_set_add(poll_set *ps, int fd, short events)
+{
+    if (ps->nfds == ps->capacity)
+    {
+        int cap = ps->capacity * 2;
+        struct pollfd *fds = realloc(ps->fds, sizeof(struct pollfd) * cap);
+        if (fds == NULL)
+            return -1;
+        ps->fds = fds;
+        int *free_list = realloc(ps->free_list, sizeof(int) * cap);
+        if (free_list == NULL)
+            return -1;
+        ps->free_list = free_list;
+        ps->capacity = cap;
+    }
+
+    int idx = ps->nfds++;
+    ps->fds[idx].fd = fd;
+    ps->fds[idx].events = events;
+    // 这一轮追加的元素没有经过 poll，不能残留旧的 revents
+    ps->fds[idx].revents = 0;
+    return idx;
+}
+
+// 只标记空洞，真正的挪动留给 poll_set_compact
+void poll_set_remove(poll_set *ps, int idx)
+{
+    ps->fds[idx].fd = -1;
+    ps->fds[idx].revents = 0;
+    ps->free_list[ps->free_cnt++] = idx;
+}
+
+void poll_set_compact(poll_set *ps)
+{
+    while (ps->free_cnt > 0)
+    {
+        int hole = ps->free_list[--ps->free_cnt];
+        // 先去掉末尾的空洞，保证用来填补的元素是有效的
+        while (ps->nfds > 0 && ps->fds[ps->nfds - 1].fd < 0)
+            ps->nfds--;
+        if (hole < ps->nfds)
+            ps->fds[hole] = ps->fds[--ps->nfds];
+    }
+}
+
 // 客户端可以用 05/echo_client.c
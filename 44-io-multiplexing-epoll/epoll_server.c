@@ -7,8 +7,17 @@
  * epoll 模式的优点：
  * - epoll_wait 只返回有变化的fd集合，无需遍历所有fd
  * - 调用 epoll_wait 函数时，无需每次给 OS 传递监视对象集合，而是在需要时针对每个监视对象单独操作
+ *
+ * 可选的低延迟模式（见 00-lib/low_latency.h）：
+ *   ./epoll_server 9190 50 0    // 处理完事件后用 epoll_wait(0) 自旋 50 微秒再阻塞，循环线程绑在 CPU 0 上
+ * 自旋期间来的消息不需要经过唤醒，代价是这段时间 CPU 占满。
+ * 用 90-benchmark/pingpong_bench 对比两种模式的 p99 往返延迟。
+ *
+ * -u 热重启（00-lib/hot_restart.h，用法同 47-multiplexer-backends/mux_server -u）：
+ *   ./epoll_server -u 9190       // 从正在运行的 epoll_server 接过监听套接字，旧进程等已有连接都关闭后退出
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,10 +25,17 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <sys/epoll.h>
+#include <fcntl.h>
+#include <errno.h>
 #include "../00-lib/error.h"
+#include "../00-lib/loop_stats.h"
+#include "../00-lib/low_latency.h"
+#include "../00-lib/unix_sock.h"
+#include "../00-lib/hot_restart.h"
 
 #define BUF_SIZE 100
 #define EPOLL_SIZE 50
+#define RETIRE_TIMEOUT 30 // 热重启交出监听套接字后，最多再服务已有连接这么多秒
 
 int main(int argc, char *argv[])
 {
@@ -32,34 +48,87 @@ int main(int argc, char *argv[])
     struct epoll_event *ep_events;
     struct epoll_event event;
     int epfd, event_cnt;
+    int spin_us = 0, cpu = -1, upgrade = 0;
 
-    if (argc != 2)
+    if (argc >= 2 && strcmp(argv[1], "-u") == 0)
     {
-        printf("Usage: %s <port>\n", argv[0]);
+        upgrade = 1;
+        argv++;
+        argc--;
+    }
+    if (argc < 2 || argc > 4)
+    {
+        printf("Usage: %s [-u] <port> [spin us] [cpu]\n", argv[0]);
         exit(1);
     }
+    if (argc >= 3)
+        spin_us = atoi(argv[2]);
+    if (argc == 4)
+        cpu = atoi(argv[3]);
+
+    int port = atoi(argv[1]);
+    int unix_sock = -1, ctl = -1;
+    if (upgrade)
+    {
+        int fds[2], nfds;
+        ctl = hr_takeover(port, fds, 2, &nfds);
+        if (ctl == -1)
+            fputs("no running instance to take over, starting normally\n", stderr);
+        else
+        {
+            serv_sock = fds[0];
+            unix_sock = nfds > 1 ? fds[1] : -1;
+        }
+    }
 
-    serv_sock = socket(PF_INET, SOCK_STREAM, 0);
-    if (serv_sock == -1)
-        error_handling("socket() error");
+    if (ctl == -1)
+    {
+        serv_sock = socket(PF_INET, SOCK_STREAM, 0);
+        if (serv_sock == -1)
+            error_handling("socket() error");
 
-    // 打开 SO_REUSEADDR
-    int option = 1;
-    int optlen = sizeof(option);
-    setsockopt(serv_sock, SOL_SOCKET, SO_REUSEADDR, (void *)&option, optlen);
+        // 打开 SO_REUSEADDR
+        int option = 1;
+        int optlen = sizeof(option);
+        setsockopt(serv_sock, SOL_SOCKET, SO_REUSEADDR, (void *)&option, optlen);
 
-    memset(&serv_addr, 0, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    serv_addr.sin_port = htons(atoi(argv[1]));
+        memset(&serv_addr, 0, sizeof(serv_addr));
+        serv_addr.sin_family = AF_INET;
+        serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        serv_addr.sin_port = htons(port);
 
-    if (bind(serv_sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
-        error_handling("bind() error");
+        if (bind(serv_sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
+            error_handling("bind() error");
 
-    if (listen(serv_sock, 5) == -1)
-        error_handling("listen error");
+        if (listen(serv_sock, 5) == -1)
+            error_handling("listen error");
+
+        // 同时在 UNIX 域套接字上提供同样的服务（见 00-lib/unix_sock.h）
+        unix_sock = unix_listen_port(port, 5);
+        if (unix_sock == -1)
+            perror("unix_listen() error");
+    }
+    /**
+     * 交接的那一小段时间里新旧两个进程都在监听同一个套接字，epoll_wait 报告可读的连接可能已经被对方 accept 走了，
+     * 阻塞的 accept 会一直卡到下一个连接到来，所以监听套接字设为非阻塞。
+     * O_NONBLOCK 记在内核的文件对象上，两个进程里的 fd 共享同一个设置。
+     */
+    fcntl(serv_sock, F_SETFL, fcntl(serv_sock, F_GETFL, 0) | O_NONBLOCK);
+    if (unix_sock != -1)
+        fcntl(unix_sock, F_SETFL, fcntl(unix_sock, F_GETFL, 0) | O_NONBLOCK);
+
+    if (spin_us > 0)
+    {
+        // 设置在监听套接字上，accept 出来的连接会继承；没有 CAP_NET_ADMIN 时只剩用户态自旋
+        if (ll_set_busy_poll(serv_sock, spin_us) == -1)
+            perror("SO_BUSY_POLL/SO_PREFER_BUSY_POLL not permitted");
+    }
+    if (cpu >= 0 && ll_pin_to_cpu(cpu) == -1)
+        perror("sched_setaffinity() error");
+
+    // 事件循环的计数器，kill -USR1 <pid> 时输出到 stderr
+    loop_stats *ls = loop_stats_register("epoll");
 
-    
     /**
      * epoll 初始化，创建了一个 epoll 实例，原型是：
      * int epoll_create(int size);
@@ -72,6 +141,24 @@ int main(int argc, char *argv[])
     event.events = EPOLLIN;
     event.data.fd = serv_sock;
     epoll_ctl(epfd, EPOLL_CTL_ADD, serv_sock, &event);
+    if (unix_sock != -1)
+    {
+        event.data.fd = unix_sock;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, unix_sock, &event);
+    }
+
+    // 已经在监听套接字上等事件了，这时再让旧进程停止 accept
+    if (ctl != -1 && hr_ready(ctl) == -1)
+        fputs("previous instance did not confirm the handoff\n", stderr);
+    int ctl_sock = hr_listen(port);
+    if (ctl_sock == -1)
+        perror("hr_listen() error");
+    else
+    {
+        event.data.fd = ctl_sock;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, ctl_sock, &event);
+    }
+    uint64_t retire_deadline_ns = 0; // 不为 0 时已经交出监听套接字，等已有连接都关闭
     /**
      * epoll_ctl 第二个参数可选：
      * - EPOLL_CTL_ADD
@@ -87,8 +174,24 @@ int main(int argc, char *argv[])
      * - EPOLLET      : 以边缘触发的方式得到事件通知
     */
 
+    // 最近一次拿到事件的时间，距今不超过自旋预算时用 epoll_wait(0) 轮询，否则阻塞
+    uint64_t spin_ns = (uint64_t)spin_us * 1000;
+    uint64_t last_event_ns = 0;
+
     while (1)
     {
+        // 交出监听套接字之后，queue_depth（当前连接数）降到 0 或者超时就退出，进程退出时剩下的连接随之关闭
+        if (retire_deadline_ns != 0 && (ls->queue_depth == 0 || ll_now_ns() >= retire_deadline_ns))
+        {
+            if (ls->queue_depth > 0)
+                fprintf(stderr, "retire timeout, closing %lu connections\n", ls->queue_depth);
+            break;
+        }
+
+        int timeout = retire_deadline_ns != 0 ? 1000 : -1;
+        if (spin_ns > 0 && ll_now_ns() - last_event_ns < spin_ns)
+            timeout = 0;
+
         /**
          * int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
          * - epfd       : 需要监视的 epoll fd
@@ -97,45 +200,95 @@ int main(int argc, char *argv[])
          * - timeout    : 以毫秒为单位的等待时间，-1 代表一直等待。
          * ==> 返回值 : 成功时返回发生事件的数量，失败时返回 -1。 如果到了timeout时间没有事件发生，返回0
         */
-        event_cnt = epoll_wait(epfd, ep_events, EPOLL_SIZE, -1);
-        printf("epoll_wait got: %d\n", event_cnt);
+        event_cnt = epoll_wait(epfd, ep_events, EPOLL_SIZE, timeout);
         if (event_cnt == -1)
         {
+            // 被 SIGUSR1 打断时，输出计数后继续等待
+            if (errno == EINTR)
+            {
+                loop_stats_poll();
+                continue;
+            }
             puts("epoll_wait() error");
             break;
         }
+        // 原来这里每次唤醒都 printf 一次，现在只记计数，printf 的锁和格式化开销比 epoll_wait 本身还大
+        // 自旋时空转的次数记在 hist 的第 0 个桶里
+        loop_stats_wakeup(ls, event_cnt);
+        loop_stats_poll();
+        if (spin_ns > 0 && event_cnt > 0)
+            last_event_ns = ll_now_ns();
 
         for (int i = 0; i < event_cnt; i++)
         {
-
-            if (ep_events[i].data.fd == serv_sock) // connection requets
+            if (ep_events[i].data.fd == -1) // 已经交出去的监听套接字
+                continue;
+            if (ep_events[i].data.fd == ctl_sock) // 新进程来接管监听套接字
+            {
+                int fds[2] = {serv_sock, unix_sock};
+                if (hr_handoff(ctl_sock, fds, unix_sock != -1 ? 2 : 1, HR_TIMEOUT_MS) == -1)
+                {
+                    fputs("hot restart aborted, still serving\n", stderr);
+                    continue;
+                }
+                int *socks[] = {&serv_sock, &unix_sock, &ctl_sock};
+                for (int j = 0; j < 3; j++)
+                {
+                    if (*socks[j] == -1)
+                        continue;
+                    // 这一批后面可能还有这个监听套接字的事件，去掉它们，免得被当成客户端连接
+                    for (int k = i + 1; k < event_cnt; k++)
+                        if (ep_events[k].data.fd == *socks[j])
+                            ep_events[k].data.fd = -1;
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, *socks[j], NULL);
+                    close(*socks[j]);
+                    *socks[j] = -1;
+                }
+                retire_deadline_ns = ll_now_ns() + (uint64_t)RETIRE_TIMEOUT * 1000000000;
+                fprintf(stderr, "handed off listeners, draining %lu connections\n", ls->queue_depth);
+            }
+            else if (ep_events[i].data.fd == serv_sock || ep_events[i].data.fd == unix_sock) // connection requets
             {
                 clnt_addr_size = sizeof(clnt_addr);
-                clnt_sock = accept(serv_sock, (struct sockaddr *)&clnt_addr, &clnt_addr_size);
+                clnt_sock = accept(ep_events[i].data.fd, (struct sockaddr *)&clnt_addr, &clnt_addr_size);
+                if (clnt_sock == -1) // 被另一个进程抢先取走了
+                    continue;
                 // 把新受理的连接请求对应的socket放入监视列表
                 // 奇怪：这里的 event 可以复用，而不会出现冲突？特别是下面 epoll_ctl 还是用的 event 的地址。
                 event.events = EPOLLIN;
                 event.data.fd = clnt_sock;
                 epoll_ctl(epfd, EPOLL_CTL_ADD, clnt_sock, &event);
-                printf("connected client fd: %d\n", clnt_sock);
+                LS_ADD(ls, syscalls, 2);
+                LS_INC(ls, accepts);
+                LS_INC(ls, queue_depth);
             }
             else // read message
             {
                 str_len = read(ep_events[i].data.fd, buf, BUF_SIZE);
-                if (str_len == 0) // close request
+                LS_INC(ls, syscalls);
+                if (str_len <= 0) // close request
                 {
                     // 把即将要关闭的socket从监视列表中清除
                     epoll_ctl(epfd, EPOLL_CTL_DEL, ep_events[i].data.fd, NULL);
                     close(ep_events[i].data.fd);
-                    printf("closed client fd: %d\n", ep_events[i].data.fd);
+                    LS_ADD(ls, syscalls, 2);
+                    LS_INC(ls, closes);
+                    LS_DEC(ls, queue_depth);
                 }
                 else
-                    write(ep_events[i].data.fd, buf, str_len);
+                {
+                    LS_ADD(ls, bytes_in, str_len);
+                    str_len = write(ep_events[i].data.fd, buf, str_len);
+                    LS_INC(ls, syscalls);
+                    if (str_len > 0)
+                        LS_ADD(ls, bytes_out, str_len);
+                }
             }
         }
     }
 
-    close(serv_sock);
+    if (serv_sock != -1)
+        close(serv_sock);
     // 记得关闭 epoll fd
     close(epfd);
     // 记得释放内存
@@ -0,0 +1,121 @@
+/**
+ * 和 thread_server.c 一样 “一个连接一个执行流” 的 echo 服务端，只是执行流换成了用户态协程（00-lib/green.h）：
+ * - 每个连接一个协程，栈只有 GREEN_STACK_SIZE（默认 64KB，实际只用到一两页），而不是每个线程 8MB 栈和一个内核任务；
+ * - conn_run 里仍然是直线式的 read -> write 循环，green_read 遇到 EAGAIN 时切到别的协程，数据到了再回来；
+ * - 所有协程由 threads 个系统线程调度，一万个连接也只有 threads 个内核线程。
+ *
+ *   ./green_server 9190 4
+ *
+ * 每个协程要占两段内存映射（栈和保护页），连接数超过三万左右时要调大 vm.max_map_count。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <errno.h>
+#include "../00-lib/error.h"
+#include "../00-lib/green.h"
+
+#define BUF_SIZE 1024
+#define DEFAULT_THREADS 4
+#define ACCEPT_BACKOFF_MS 10 // fd 用完时等这么久再 accept
+
+void accept_run(void *arg);
+void conn_run(void *arg);
+
+int main(int argc, char *argv[])
+{
+    int serv_sock;
+    struct sockaddr_in serv_addr;
+    int nthreads = DEFAULT_THREADS;
+
+    if (argc < 2 || argc > 3)
+    {
+        printf("Usage: %s <port> [threads]\n", argv[0]);
+        exit(1);
+    }
+    if (argc == 3)
+        nthreads = atoi(argv[2]);
+
+    serv_sock = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (serv_sock == -1)
+        error_handling("socket() error");
+
+    // 打开 SO_REUSEADDR
+    int option = 1;
+    int optlen = sizeof(option);
+    setsockopt(serv_sock, SOL_SOCKET, SO_REUSEADDR, (void *)&option, optlen);
+
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    serv_addr.sin_port = htons(atoi(argv[1]));
+
+    if (bind(serv_sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
+        error_handling("bind() error");
+
+    if (listen(serv_sock, 1024) == -1)
+        error_handling("listen error");
+
+    if (green_init(nthreads) == -1)
+        error_handling("green_init() error");
+    // 接受连接本身也是一个协程
+    green_spawn(accept_run, (void *)(intptr_t)serv_sock);
+    green_run();
+
+    close(serv_sock);
+    return 0;
+}
+
+void accept_run(void *arg)
+{
+    int serv_sock = (int)(intptr_t)arg;
+    // fd 用完之后就创建不出 timerfd 了，所以一开始就准备好
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec backoff = {{0, 0}, {0, ACCEPT_BACKOFF_MS * 1000000L}};
+
+    while (1)
+    {
+        int clnt_sock = green_accept(serv_sock, NULL, NULL);
+        if (clnt_sock == -1)
+        {
+            if ((errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) && timer != -1)
+            {
+                // 文件描述符用完了：只是 yield 的话，就绪队列里没有别的协程时会马上又轮到自己，空转占满一个 CPU；
+                // 在定时器上睡一会儿，等别的连接结束释放 fd
+                uint64_t expirations;
+                timerfd_settime(timer, 0, &backoff, NULL);
+                green_wait_fd(timer, EPOLLIN);
+                read(timer, &expirations, sizeof(expirations));
+            }
+            else
+                green_yield(); // ECONNABORTED 之类，连接已经没了，接着 accept 下一个
+            continue;
+        }
+        if (green_spawn(conn_run, (void *)(intptr_t)clnt_sock) == -1)
+            close(clnt_sock);
+    }
+}
+
+// 和 thread_server.c 的 thread_run 一样，只是 read / write 换成了会切换协程的版本
+void conn_run(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+
+    char buf[BUF_SIZE];
+    int str_len;
+
+    while ((str_len = green_read(fd, buf, BUF_SIZE)) > 0)
+    {
+        if (green_write(fd, buf, str_len) == -1)
+            break;
+    }
+    close(fd);
+}
@@ -0,0 +1,301 @@
+/**
+ * 多 reactor 的 echo 服务端：每个线程一个 epoll 循环，各自 accept、各自服务自己的连接，线程之间不共享连接。
+ * 用来对比线程绑核、以及把新连接分给 “收包的那个 CPU 上的线程” 的效果（原理见 00-lib/cpu_steer.h）。
+ *
+ * -m 选择连接怎么分到各个线程：
+ * - shared    : 一个监听套接字，所有线程用 EPOLLEXCLUSIVE 等它，谁被唤醒谁 accept，和收包的 CPU 无关
+ * - reuseport : 每个线程一个 SO_REUSEPORT 监听套接字，内核按四元组哈希选一个，同样和 CPU 无关
+ * - incoming  : 在 reuseport 的基础上给每个监听套接字设置 SO_INCOMING_CPU = 线程绑定的 CPU，内核优先选 CPU 匹配的
+ * - cbpf      : 在 reuseport 的基础上挂一个经典 BPF 程序，按收到 SYN 的 CPU 直接选出第几个监听套接字（默认）
+ * 后两种需要 -c 把线程绑到 CPU 上，CPU 列表可以直接写，也可以写成 irq:<网卡名>，取网卡队列中断所在的 CPU：
+ *   ./reactor_server -m shared 9190              // 不绑核，不分流
+ *   ./reactor_server -m cbpf -c irq:eth0 9191    // 每个网卡中断所在的 CPU 一个线程
+ *   ../90-benchmark/pingpong_bench <server IP> 9190 9191    // 交替测两个服务端，输出 p99 的差值
+ *
+ * 每个线程统计 accept 到的连接里有多少个的 SO_INCOMING_CPU 就是自己所在的 CPU（local），其他算 cross，
+ * 以及本线程用户态的 cache miss（00-lib/perf_counter.h，没有硬件计数器时为 0），kill -USR1 <pid> 时输出。
+ * cross 的比例就是需要跨核搬运 cache line 的连接的比例；内核态的跨核流量用 perf stat -e cache-misses 或 perf c2c 看。
+ *
+ * 用法：./reactor_server [-m shared|reuseport|incoming|cbpf] [-c cpus|irq:<dev>] <port> [threads]
+ * threads 默认等于 -c 给出的 CPU 个数，没有 -c 时等于在线 CPU 个数；线程比 CPU 多时轮流绑。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "../00-lib/error.h"
+#include "../00-lib/loop_stats.h"
+#include "../00-lib/low_latency.h"
+#include "../00-lib/cpu_steer.h"
+#include "../00-lib/perf_counter.h"
+
+#define BUF_SIZE 1024
+#define EPOLL_SIZE 64
+#define ACCEPT_BATCH 64
+
+enum steer_mode
+{
+    STEER_SHARED,
+    STEER_REUSEPORT,
+    STEER_INCOMING,
+    STEER_CBPF,
+};
+
+// 每个线程一份，只有自己写，按 cache line 对齐避免伪共享
+typedef struct
+{
+    int id;
+    int cpu; // 绑定的 CPU，-1 表示不绑
+    int listen_sock;
+    int epfd;
+    loop_stats *ls;
+    uint64_t local; // SO_INCOMING_CPU 和本线程当时所在的 CPU 相同的连接数
+    uint64_t cross;
+    perf_counter misses;
+} __attribute__((aligned(64))) reactor;
+
+static reactor *reactors;
+static int nreactors;
+static int steer_mode;
+
+int parse_mode(const char *name);
+int open_listener(int port, int reuseport);
+void *reactor_run(void *arg);
+void handle_accept(reactor *r);
+void dump_reactors(int fd);
+
+int main(int argc, char *argv[])
+{
+    int mode = STEER_CBPF, opt;
+    int cpus[CPU_STEER_MAX], ncpus = 0;
+
+    while ((opt = getopt(argc, argv, "m:c:")) != -1)
+    {
+        if (opt == 'm')
+        {
+            mode = parse_mode(optarg);
+            if (mode == -1)
+                optind = argc; // 输出用法
+        }
+        else if (opt == 'c')
+        {
+            ncpus = cpu_steer_parse(optarg, cpus, CPU_STEER_MAX);
+            if (ncpus <= 0)
+            {
+                fprintf(stderr, "bad cpu list or no interrupts found: %s\n", optarg);
+                exit(1);
+            }
+        }
+        else
+            break;
+    }
+    if (optind != argc - 1 && optind != argc - 2)
+    {
+        printf("Usage: %s [-m shared|reuseport|incoming|cbpf] [-c cpus|irq:<dev>] <port> [threads]\n", argv[0]);
+        exit(1);
+    }
+    int port = atoi(argv[optind]);
+    nreactors = optind == argc - 2 ? atoi(argv[optind + 1]) : ncpus > 0 ? ncpus : sysconf(_SC_NPROCESSORS_ONLN);
+    if (nreactors < 1 || nreactors > CPU_STEER_MAX)
+        error_handling("threads must be 1..64");
+    if ((mode == STEER_INCOMING || mode == STEER_CBPF) && ncpus == 0)
+    {
+        // 不绑核时线程所在的 CPU 随时会变，按 CPU 分流没有意义
+        fputs("incoming/cbpf need -c, falling back to reuseport\n", stderr);
+        mode = STEER_REUSEPORT;
+    }
+
+    reactors = aligned_alloc(64, sizeof(reactor) * nreactors);
+    memset(reactors, 0, sizeof(reactor) * nreactors);
+    int shared_sock = mode == STEER_SHARED ? open_listener(port, 0) : -1;
+    for (int i = 0; i < nreactors; i++)
+    {
+        reactor *r = &reactors[i];
+        r->id = i;
+        r->cpu = ncpus > 0 ? cpus[i % ncpus] : -1;
+        r->misses.fd = -1; // 线程启动后才打开
+        // reuseport 组里套接字的序号就是 bind 的先后顺序，所以要在这里按线程顺序依次创建，不能放到各个线程里
+        r->listen_sock = mode == STEER_SHARED ? shared_sock : open_listener(port, 1);
+        if (mode == STEER_INCOMING && setsockopt(r->listen_sock, SOL_SOCKET, SO_INCOMING_CPU, &r->cpu, sizeof(r->cpu)) == -1)
+            perror("setsockopt(SO_INCOMING_CPU) error");
+    }
+    if (mode == STEER_CBPF)
+    {
+        int order[CPU_STEER_MAX];
+        for (int i = 0; i < nreactors; i++)
+            order[i] = reactors[i].cpu;
+        if (reuseport_attach_cpu_bpf(reactors[0].listen_sock, order, nreactors) == -1)
+            perror("SO_ATTACH_REUSEPORT_CBPF error");
+    }
+    steer_mode = mode;
+    loop_stats_set_dump_hook(dump_reactors);
+
+    // 主线程只等在 pthread_join 里，SIGUSR1 要交给 reactor 线程才能打断 epoll_wait 输出计数
+    sigset_t usr1;
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &usr1, NULL);
+
+    pthread_t *tids = calloc(nreactors, sizeof(pthread_t));
+    for (int i = 0; i < nreactors; i++)
+        pthread_create(&tids[i], NULL, reactor_run, &reactors[i]);
+    for (int i = 0; i < nreactors; i++)
+        pthread_join(tids[i], NULL);
+    return 0;
+}
+
+int parse_mode(const char *name)
+{
+    static const char *names[] = {"shared", "reuseport", "incoming", "cbpf"};
+    for (int i = 0; i < 4; i++)
+        if (strcmp(name, names[i]) == 0)
+            return i;
+    return -1;
+}
+
+int open_listener(int port, int reuseport)
+{
+    struct sockaddr_in serv_addr;
+    int sock = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (sock == -1)
+        error_handling("socket() error");
+
+    int option = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+    if (reuseport)
+        setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &option, sizeof(option));
+
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    serv_addr.sin_port = htons(port);
+    if (bind(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
+        error_handling("bind() error");
+    if (listen(sock, 1024) == -1)
+        error_handling("listen error");
+    return sock;
+}
+
+void *reactor_run(void *arg)
+{
+    reactor *r = arg;
+    struct epoll_event event, ep_events[EPOLL_SIZE];
+    char buf[BUF_SIZE], name[32];
+
+    // 先绑核再分配 epoll 和统计结构，它们的内存会落在这个 CPU 所在的 NUMA 节点上
+    if (r->cpu >= 0 && ll_pin_to_cpu(r->cpu) == -1)
+        perror("sched_setaffinity() error");
+    snprintf(name, sizeof(name), "reactor%d", r->id);
+    r->ls = loop_stats_register(strdup(name));
+    sigset_t usr1;
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    pthread_sigmask(SIG_UNBLOCK, &usr1, NULL);
+    perf_counter_open(&r->misses, "cache_misses", PERF_COUNT_HW_CACHE_MISSES);
+
+    r->epfd = epoll_create1(0);
+    // 共享的监听套接字用 EPOLLEXCLUSIVE，来一个连接只唤醒一个线程，而不是所有线程一起醒来抢
+    event.events = EPOLLIN | (steer_mode == STEER_SHARED ? EPOLLEXCLUSIVE : 0);
+    event.data.fd = r->listen_sock;
+    epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->listen_sock, &event);
+
+    while (1)
+    {
+        int n = epoll_wait(r->epfd, ep_events, EPOLL_SIZE, -1);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                loop_stats_poll();
+                continue;
+            }
+            perror("epoll_wait() error");
+            break;
+        }
+        loop_stats_wakeup(r->ls, n);
+        loop_stats_poll();
+
+        for (int i = 0; i < n; i++)
+        {
+            int fd = ep_events[i].data.fd;
+            if (fd == r->listen_sock)
+            {
+                handle_accept(r);
+                continue;
+            }
+            int str_len = read(fd, buf, BUF_SIZE);
+            LS_INC(r->ls, syscalls);
+            if (str_len <= 0)
+            {
+                epoll_ctl(r->epfd, EPOLL_CTL_DEL, fd, NULL);
+                close(fd);
+                LS_ADD(r->ls, syscalls, 2);
+                LS_INC(r->ls, closes);
+                LS_DEC(r->ls, queue_depth);
+                continue;
+            }
+            LS_ADD(r->ls, bytes_in, str_len);
+            str_len = write(fd, buf, str_len);
+            LS_INC(r->ls, syscalls);
+            if (str_len > 0)
+                LS_ADD(r->ls, bytes_out, str_len);
+        }
+    }
+    return NULL;
+}
+
+void handle_accept(reactor *r)
+{
+    struct epoll_event event;
+
+    for (int i = 0; i < ACCEPT_BATCH; i++)
+    {
+        int clnt_sock = accept(r->listen_sock, NULL, NULL);
+        LS_INC(r->ls, syscalls);
+        if (clnt_sock == -1)
+            return; // EAGAIN：取空了，或者共享监听套接字时被别的线程抢先
+
+        // 没绑核时拿线程此刻所在的 CPU 比较，下一次调度后可能就不一样了
+        int cpu = r->cpu >= 0 ? r->cpu : sched_getcpu();
+        if (sock_incoming_cpu(clnt_sock) == cpu)
+            r->local++;
+        else
+            r->cross++;
+
+        event.events = EPOLLIN;
+        event.data.fd = clnt_sock;
+        epoll_ctl(r->epfd, EPOLL_CTL_ADD, clnt_sock, &event);
+        LS_ADD(r->ls, syscalls, 2);
+        LS_INC(r->ls, accepts);
+        LS_INC(r->ls, queue_depth);
+    }
+}
+
+// SIGUSR1 时在 loop_stats 的输出后面追加每个线程的分流情况
+void dump_reactors(int fd)
+{
+    char line[256];
+    uint64_t local = 0, cross = 0;
+    for (int i = 0; i < nreactors; i++)
+    {
+        reactor *r = &reactors[i];
+        uint64_t misses = perf_counter_read(&r->misses);
+        uint64_t events = r->ls ? r->ls->events : 0;
+        int len = snprintf(line, sizeof(line), "reactor=%d cpu=%d local=%lu cross=%lu cache_misses=%lu misses_per_event=%.2f\n",
+                           r->id, r->cpu, r->local, r->cross, misses, events ? (double)misses / events : 0.0);
+        write(fd, line, len);
+        local += r->local;
+        cross += r->cross;
+    }
+    int len = snprintf(line, sizeof(line), "steering local=%lu cross=%lu local_pct=%.1f\n", local, cross,
+                       local + cross ? 100.0 * local / (local + cross) : 0.0);
+    write(fd, line, len);
+}
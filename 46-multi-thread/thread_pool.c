@@ -6,8 +6,38 @@
  * 当有新连接建立时，往连接字队列里放置这个新连接描述字，线程池里的线程负责从连接字队列里取出连接描述字进行处理。
  *
  * 除了连接池，还有一个关键是连接字队列的设计，因为这里既有往这个队列里放置描述符的操作，也有从这个队列里取出描述符的操作。
+ *
+ * -c 把 worker 绑到 CPU 上（第 i 个 worker 绑 cpus[i % n]，也可以写成 irq:<网卡名>，见 00-lib/cpu_steer.h），
+ * 绑核之后队列里每个连接还带上它的 SO_INCOMING_CPU，worker 取连接时在队头附近的 STEER_SCAN 个里优先挑在自己 CPU 上收包的，
+ * 找不到就照常取队头，不会让连接因为等 “对的” worker 而多等。worker 比 CPU 少时只有一部分连接能挑中。
+ *   ./thread_pool -c 0-3 9190
+ *
+ * 线程数不是固定的，而是跟着排队时间伸缩（负载一天里能差 20 倍，固定大小要么不够用、要么大部分时间闲着）：
+ * - 连接在队列里等的时间（从 push 到被 worker 取走）超过目标值 -t 毫秒，而且没有空闲的 worker 时，
+ *   按排队的连接数一次补足线程，最多到 -M 个。这里每个 worker 一次服务一个连接直到对方关闭，
+ *   所以排着队的连接只能等新线程或者等某个连接结束，补线程要按排队的个数补，而不是一次加一个；
+ * - 除了 push 时检查，还有一个监视线程每隔目标值的一半检查一次队头，所有 worker 都被长连接占住、又没有新连接来的时候也能及时扩容；
+ * - worker 空闲超过 -i 毫秒（pthread_cond_timedwait 超时）并且线程数多于 -m 时退出。
+ * 每次扩容、缩容都记一条日志，kill -USR1 <pid> 输出当前线程数、排队情况和累计的扩缩容次数：
+ *   ./thread_pool -m 2 -M 256 -t 5 -i 10000 9190
+ *
+ * 线程数到了上限以后还是来不及处理时，队列会越排越长，每个连接都要等前面所有连接，大家一起超时。
+ * 这里按 CoDel 的思路做过载控制（-s 选择做法，-D 是排队时间的目标值）：
+ * - 每个 CODEL_INTERVAL 的窗口里记下最短的排队时间（worker 取连接时的等待时间，队列被取空时算 0）。
+ *   短暂的突发会被很快消化，窗口里总有排得很短的时候；最短的都超过目标值，说明队列是一直排着的 “坏队列”，进入过载状态；
+ * - 过载时，新连接不进队列，直接用 SO_LINGER {1, 0} close 发 RST 拒绝（reject，默认），客户端马上就知道，可以重试别的服务端；
+ *   或者暂停 accept（pause），让连接留在内核的监听队列里，满了之后新的 SYN 被丢掉，客户端按 SYN 重传退避；
+ * - 不管哪种做法，worker 取到排队超过时限的连接都直接拒绝，不再服务：过载时时限是目标值，平时是 CODEL_INTERVAL。
+ *   等了这么久的客户端多半已经超时走了，服务它只是浪费一个 worker；
+ * - none 不做过载控制，只在队列满时拒绝（原来的实现在这里会覆盖队头的连接）。
+ * 用 ../90-benchmark/overload_bench 在 2 倍过载下对比有效吞吐（在期限内完成的请求数）：
+ *   ./thread_pool -M 8 -s none 9190         ../90-benchmark/overload_bench 127.0.0.1 9190 320 10 50
+ *   ./thread_pool -M 8 -s reject 9191       ../90-benchmark/overload_bench 127.0.0.1 9191 320 10 50
+ * 回环上 8 个线程、hold 50ms（处理能力约 160/s）、每秒 320 个请求时，none 的有效吞吐只有个位数（大家都在排队、都超时），
+ * reject 稳定在 150/s 左右；pause 介于两者之间，暂停期间连接仍然在内核的监听队列里排着，取出来时往往已经超时。
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,94 +46,414 @@
 #include <sys/socket.h>
 #include <pthread.h>
 #include <errno.h>
+#include <stdint.h>
 #include "../00-lib/error.h"
+#include "../00-lib/async_log.h"
+#include "../00-lib/loop_stats.h"
+#include "../00-lib/low_latency.h"
+#include "../00-lib/cpu_steer.h"
 
 #define BUF_SIZE 30
 
-#define THREAD_POOL_SIZE 2
+// 下面几个是默认值，都可以在命令行上修改
+#define POOL_MIN_THREADS 2
+#define POOL_MAX_THREADS 64
+#define POOL_TARGET_MS 5    // 排队时间的目标值
+#define POOL_IDLE_MS 10000  // 多出来的 worker 空闲这么久就退出
 #define QUEQUE_SIZE 100
+#define CODEL_TARGET_MS 10  // 过载控制的排队时间目标值
+#define CODEL_INTERVAL_MS 100
+#define STEER_SCAN 8 // 取连接时最多往后看几个，找收包 CPU 和自己相同的
 
 void *thread_run(void *arg);
+void *pool_monitor(void *arg);
 void do_echo(int fd);
+void dump_pool(int fd);
+void reject_conn(int fd);
+
+// 过载时的做法
+enum shed_mode
+{
+    SHED_NONE,
+    SHED_REJECT,
+    SHED_PAUSE,
+};
+
+// 队列里的一个连接
+typedef struct
+{
+    int fd;
+    int cpu; // 连接的 SO_INCOMING_CPU，-1 表示不知道
+    uint64_t enq_ns; // 入队时间，用来算排队时间
+} queue_item;
 
 // 定义一个队列
 typedef struct
 {
     int capacity;          // 队列容量
-    int *fd;               // fd数组指针
+    queue_item *items;     // 连接数组指针
     int head;              // 队列头位置
     int tail;              // 队列尾位置
     pthread_mutex_t mutex; // 互斥锁
     pthread_cond_t cond;   // 条件变量
 } block_queue;
 
-// 初始化队列
+// 初始化队列，条件变量用 CLOCK_MONOTONIC 计时，和入队时间用同一个时钟
 void init_block_queue(block_queue *queue, int cap)
 {
+    pthread_condattr_t attr;
     queue->capacity = cap;
-    queue->fd = calloc(QUEQUE_SIZE, sizeof(int));
+    queue->items = calloc(cap, sizeof(queue_item));
     queue->head = 0;
     queue->tail = 0;
     pthread_mutex_init(&queue->mutex, NULL);
-    pthread_cond_init(&queue->cond, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue->cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// 队列里的连接数
+int queue_length(block_queue *queue)
+{
+    return (queue->tail - queue->head + queue->capacity) % queue->capacity;
+}
+
+// 线程池：队列加上伸缩的配置、当前状态和统计，除了配置以外都由 queue.mutex 保护
+typedef struct
+{
+    block_queue queue;
+    int min_threads;
+    int max_threads;
+    uint64_t target_ns;
+    uint64_t idle_ns;
+    int cpus[CPU_STEER_MAX];
+    int ncpus;
+    int threads;      // 当前的 worker 数
+    int idle;         // 正在等连接的 worker 数
+    unsigned spawned; // 累计创建的 worker 数，新 worker 按它轮流绑 CPU
+    // 统计
+    uint64_t grown;
+    uint64_t shrunk;
+    uint64_t served;
+    uint64_t wait_sum_ns;
+    uint64_t wait_max_ns; // 上次输出统计以来的最大排队时间
+    // 过载控制
+    int shed_mode;
+    uint64_t codel_target_ns;
+    uint64_t window_end_ns;
+    uint64_t window_min_ns; // 当前窗口里最短的排队时间
+    int overloaded;
+    pthread_cond_t admit; // 过载解除时唤醒暂停 accept 的线程
+    uint64_t rejected;    // 过载时拒绝的新连接
+    uint64_t shed;        // 排队超时被拒绝的连接
+    uint64_t full;        // 队列满被拒绝的连接
+    uint64_t paused_ns;
+} pool;
+
+// 每个 worker 的参数
+typedef struct
+{
+    pool *pool;
+    int cpu; // 绑定的 CPU，-1 表示不绑
+} worker;
+
+// 新建一个 worker，调用时持有 queue.mutex
+int pool_spawn(pool *p)
+{
+    pthread_t tid;
+    worker *w = malloc(sizeof(worker));
+    w->pool = p;
+    w->cpu = p->ncpus > 0 ? p->cpus[p->spawned % p->ncpus] : -1;
+    if (pthread_create(&tid, NULL, thread_run, w) != 0)
+    {
+        free(w);
+        return -1;
+    }
+    p->spawned++;
+    p->threads++;
+    return 0;
+}
+
+// 队头等得超过目标值、又没有空闲的 worker 时扩容，调用时持有 queue.mutex
+void pool_maybe_grow(pool *p, uint64_t now)
+{
+    block_queue *queue = &p->queue;
+    int queued = queue_length(queue);
+    if (queued == 0 || p->idle >= queued || p->threads >= p->max_threads)
+        return;
+    uint64_t wait_ns = now - queue->items[queue->head].enq_ns;
+    if (wait_ns < p->target_ns)
+        return;
+
+    int want = queued - p->idle;
+    if (want > p->max_threads - p->threads)
+        want = p->max_threads - p->threads;
+    int added = 0;
+    while (added < want && pool_spawn(p) == 0)
+        added++;
+    p->grown += added;
+    LOG_INFO("pool grow +%ld threads == %ld queued == %ld head wait us == %ld", added, p->threads, queued, wait_ns / 1000);
+}
+
+// 窗口结束时根据窗口里最短的排队时间判断是否过载，调用时持有 queue.mutex
+void codel_update(pool *p, uint64_t now)
+{
+    block_queue *queue = &p->queue;
+    if (now < p->window_end_ns)
+        return;
+
+    uint64_t min_ns = p->window_min_ns;
+    // 整个窗口里一个连接也没取走时，队头已经等了的时间也算
+    if (queue->head != queue->tail && now - queue->items[queue->head].enq_ns < min_ns)
+        min_ns = now - queue->items[queue->head].enq_ns;
+    int overloaded = min_ns != UINT64_MAX && min_ns > p->codel_target_ns;
+    if (overloaded != p->overloaded)
+    {
+        // 日志的参数只能是整数，两种状态各用一个格式串
+        long min_us = min_ns == UINT64_MAX ? 0 : min_ns / 1000;
+        if (overloaded)
+            LOG_INFO("pool overloaded, min wait us == %ld queued == %ld", min_us, queue_length(queue));
+        else
+        {
+            LOG_INFO("pool recovered, min wait us == %ld queued == %ld", min_us, queue_length(queue));
+            pthread_cond_broadcast(&p->admit);
+        }
+    }
+    p->overloaded = overloaded;
+    p->window_min_ns = UINT64_MAX;
+    p->window_end_ns = now + (uint64_t)CODEL_INTERVAL_MS * 1000000;
 }
 
-// 往队列里放一个fd
-void push_fd(block_queue *queue, int fd)
+/**
+ * 往队列里放一个fd，返回 -1 表示没有放进去（队列满了，或者过载时拒绝新连接），调用方应当拒绝这个连接。
+ * 原来的实现不检查队列满，尾部会覆盖头部，被覆盖的连接既没人服务也没人关闭。
+ */
+int push_fd(pool *p, int fd, int cpu)
 {
+    block_queue *queue = &p->queue;
+    uint64_t now = ll_now_ns();
     pthread_mutex_lock(&queue->mutex);
-    queue->fd[queue->tail] = fd;
-    printf("push fd %d\n", fd);
+    codel_update(p, now);
+    if (queue_length(queue) == queue->capacity - 1)
+    {
+        p->full++;
+        pthread_mutex_unlock(&queue->mutex);
+        return -1;
+    }
+    // 线程数还能增加时先扩容，到了上限、也没有空闲的 worker 时才拒绝
+    if (p->shed_mode == SHED_REJECT && p->overloaded && p->idle == 0 && p->threads >= p->max_threads)
+    {
+        p->rejected++;
+        pthread_mutex_unlock(&queue->mutex);
+        return -1;
+    }
+    queue->items[queue->tail].fd = fd;
+    queue->items[queue->tail].cpu = cpu;
+    queue->items[queue->tail].enq_ns = now;
+    // 循环队列，上面已经检查过队列满的情况（空出一个位置区分满和空），尾部不会覆盖头部
     if (++queue->tail >= queue->capacity)
         queue->tail = 0;
-    // 上面的判断和处理其实是做成了一个 循环队列，
-    // todo 但是循环队列还有一个很重要的逻辑没有处理，就是尾部覆盖了头部
 
     pthread_cond_signal(&queue->cond);
+    pool_maybe_grow(p, now);
     pthread_mutex_unlock(&queue->mutex);
+
+    // 日志放在锁外面，而且只是写入本线程的日志环，不会和其他线程抢 stdio 的锁
+    LOG_DEBUG("push fd %ld", fd);
+    return 0;
 }
 
-// 从队列里拿出一个fd
-int pop_fd(block_queue *queue)
+// 过载时暂停 accept，直到过载解除
+void pool_wait_admit(pool *p)
 {
+    block_queue *queue = &p->queue;
+    pthread_mutex_lock(&queue->mutex);
+    uint64_t start = ll_now_ns(), now = start;
+    codel_update(p, now);
+    while (p->overloaded)
+    {
+        // worker 都在忙着时没有人调用 codel_update，所以定时醒来自己检查
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += CODEL_INTERVAL_MS / 4 * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&p->admit, &queue->mutex, &deadline);
+        now = ll_now_ns();
+        codel_update(p, now);
+    }
+    p->paused_ns += now - start;
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+/**
+ * 从队列里拿出一个fd，cpu >= 0 时优先拿队头附近在这个 CPU 上收包的连接。
+ * 空闲超过 idle_ns 并且线程数多于下限时返回 -1，调用的 worker 应当退出（线程数已经减掉了）。
+ * 开启过载控制时，*stale 为 1 表示这个连接排队超时了，调用方应当拒绝它，再取下一个。
+ */
+int pop_fd(pool *p, int cpu, int *stale)
+{
+    block_queue *queue = &p->queue;
     pthread_mutex_lock(&queue->mutex);
     while (queue->head == queue->tail)
-        pthread_cond_wait(&queue->cond, &queue->mutex);
-    int fd = queue->fd[queue->head];
+    {
+        p->window_min_ns = 0; // 队列被取空了，说明没有一直排着的队
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += p->idle_ns / 1000000000;
+        deadline.tv_nsec += p->idle_ns % 1000000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        p->idle++;
+        int ret = pthread_cond_timedwait(&queue->cond, &queue->mutex, &deadline);
+        p->idle--;
+        if (ret == ETIMEDOUT && queue->head == queue->tail && p->threads > p->min_threads)
+        {
+            p->threads--;
+            p->shrunk++;
+            int threads = p->threads;
+            pthread_mutex_unlock(&queue->mutex);
+            LOG_INFO("pool shrink threads == %ld", threads);
+            return -1;
+        }
+    }
+    if (cpu >= 0)
+    {
+        // 找到后和队头交换，被换下去的队头仍然在前 STEER_SCAN 个里，很快会被取走
+        for (int i = 0, pos = queue->head; i < STEER_SCAN && pos != queue->tail; i++)
+        {
+            if (queue->items[pos].cpu == cpu)
+            {
+                queue_item item = queue->items[pos];
+                queue->items[pos] = queue->items[queue->head];
+                queue->items[queue->head] = item;
+                break;
+            }
+            if (++pos >= queue->capacity)
+                pos = 0;
+        }
+    }
+    uint64_t now = ll_now_ns();
+    uint64_t wait_ns = now - queue->items[queue->head].enq_ns;
+    int fd = queue->items[queue->head].fd;
     if (++queue->head >= queue->capacity)
         queue->head = 0;
-
-    printf("pop fd %d\n", fd);
+    if (wait_ns < p->window_min_ns)
+        p->window_min_ns = wait_ns;
+    codel_update(p, now);
+    // 过载时只服务排队不超过目标值的连接，平时放宽到一个窗口
+    uint64_t limit_ns = p->overloaded ? p->codel_target_ns : (uint64_t)CODEL_INTERVAL_MS * 1000000;
+    *stale = p->shed_mode != SHED_NONE && wait_ns > limit_ns;
+    if (*stale)
+        p->shed++;
+    else
+    {
+        p->served++;
+        p->wait_sum_ns += wait_ns;
+        if (wait_ns > p->wait_max_ns)
+            p->wait_max_ns = wait_ns;
+    }
     pthread_mutex_unlock(&queue->mutex);
 
+    LOG_DEBUG("pop fd %ld", fd);
     return fd;
 }
 
+static pool *main_pool;
+
 int main(int argc, char *argv[])
 {
     int serv_sock, clnt_sock;
     struct sockaddr_in serv_addr, clnt_addr;
     socklen_t clnt_addr_size;
+    int opt, queue_size = QUEQUE_SIZE, usage = 0;
+    static const char *shed_names[] = {"none", "reject", "pause"};
     // char buf[BUF_SIZE];
     // int str_len;
 
-    // 准备队列
-    block_queue queue;
-    init_block_queue(&queue, QUEQUE_SIZE);
-
-    // 准备线程池
-    pthread_t *thread_pool = calloc(THREAD_POOL_SIZE, sizeof(pthread_t));
-    for (int i = 0; i < THREAD_POOL_SIZE; i++)
+    static pool p;
+    p.min_threads = POOL_MIN_THREADS;
+    p.max_threads = POOL_MAX_THREADS;
+    p.target_ns = (uint64_t)POOL_TARGET_MS * 1000000;
+    p.idle_ns = (uint64_t)POOL_IDLE_MS * 1000000;
+    p.shed_mode = SHED_REJECT;
+    p.codel_target_ns = (uint64_t)CODEL_TARGET_MS * 1000000;
+    while ((opt = getopt(argc, argv, "c:m:M:t:i:q:s:D:")) != -1)
     {
-        pthread_create(&thread_pool[i], NULL, thread_run, (void *)&queue);
+        if (opt == 'c')
+            usage |= (p.ncpus = cpu_steer_parse(optarg, p.cpus, CPU_STEER_MAX)) <= 0;
+        else if (opt == 'm')
+            p.min_threads = atoi(optarg);
+        else if (opt == 'M')
+            p.max_threads = atoi(optarg);
+        else if (opt == 't')
+            p.target_ns = (uint64_t)(atof(optarg) * 1000000);
+        else if (opt == 'i')
+            p.idle_ns = (uint64_t)atoi(optarg) * 1000000;
+        else if (opt == 'q')
+            queue_size = atoi(optarg);
+        else if (opt == 's')
+        {
+            p.shed_mode = -1;
+            for (int i = 0; i < 3; i++)
+                if (strcmp(optarg, shed_names[i]) == 0)
+                    p.shed_mode = i;
+            usage |= p.shed_mode == -1;
+        }
+        else if (opt == 'D')
+            p.codel_target_ns = (uint64_t)(atof(optarg) * 1000000);
+        else
+            usage = 1;
     }
-
-    if (argc != 2)
+    if (usage || optind != argc - 1 || p.min_threads < 1 || p.max_threads < p.min_threads || queue_size < 2 ||
+        p.target_ns == 0 || p.codel_target_ns == 0)
     {
-        printf("Usage: %s <port>\n", argv[0]);
+        printf("Usage: %s [-c cpus|irq:<dev>] [-m min threads] [-M max threads] [-t target wait ms] "
+               "[-i idle ms] [-q queue size] [-s none|reject|pause] [-D codel target ms] <port>\n", argv[0]);
         exit(1);
     }
 
+    // 只有 accept 线程处理 SIGUSR1（accept 被打断后输出统计），其他线程都从这里继承屏蔽 SIGUSR1 的信号掩码
+    loop_stats *ls = loop_stats_register("accept");
+    loop_stats_set_dump_hook(dump_pool);
+    sigset_t usr1;
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &usr1, NULL);
+
+    // 启动后台日志线程，业务线程只写各自的日志环
+    log_init(STDOUT_FILENO);
+    log_thread_init();
+
+    // 准备队列
+    init_block_queue(&p.queue, queue_size);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&p.admit, &attr);
+    pthread_condattr_destroy(&attr);
+    p.window_min_ns = UINT64_MAX;
+    p.window_end_ns = ll_now_ns() + (uint64_t)CODEL_INTERVAL_MS * 1000000;
+    main_pool = &p;
+
+    // 准备线程池，先创建下限个数的 worker
+    pthread_mutex_lock(&p.queue.mutex);
+    for (int i = 0; i < p.min_threads; i++)
+        if (pool_spawn(&p) == -1)
+            error_handling("pthread_create() error");
+    pthread_mutex_unlock(&p.queue.mutex);
+    pthread_t monitor;
+    pthread_create(&monitor, NULL, pool_monitor, &p);
+    pthread_sigmask(SIG_UNBLOCK, &usr1, NULL);
+
     serv_sock = socket(PF_INET, SOCK_STREAM, 0);
     if (serv_sock == -1)
         error_handling("socket() error");
@@ -116,27 +466,37 @@ int main(int argc, char *argv[])
     memset(&serv_addr, 0, sizeof(serv_addr));
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    serv_addr.sin_port = htons(atoi(argv[1]));
+    serv_addr.sin_port = htons(atoi(argv[optind]));
 
     if (bind(serv_sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
         error_handling("bind() error");
 
-    if (listen(serv_sock, 5) == -1)
+    // 监听队列太短时，还没到过载控制就先在内核里丢 SYN 了
+    if (listen(serv_sock, 1024) == -1)
         error_handling("listen error");
 
     while (1)
     {
+        if (p.shed_mode == SHED_PAUSE)
+            pool_wait_admit(&p);
         clnt_addr_size = sizeof(clnt_addr);
         clnt_sock = accept(serv_sock, (struct sockaddr *)&clnt_addr, &clnt_addr_size);
         if (clnt_sock == -1)
+        {
+            loop_stats_poll(); // 被 SIGUSR1 打断时输出统计
             continue;
+        }
         else
-            puts("new client connected......");
+            LOG_INFO("new client connected, fd == %ld", clnt_sock);
+        LS_INC(ls, accepts);
 
-        push_fd(&queue, clnt_sock);
+        // 不绑核时 worker 不挑连接，也就不用多一次 getsockopt
+        if (push_fd(&p, clnt_sock, p.ncpus > 0 ? sock_incoming_cpu(clnt_sock) : -1) == -1)
+            reject_conn(clnt_sock);
     }
 
     close(serv_sock);
+    log_shutdown();
     return 0;
 }
 
@@ -145,17 +505,48 @@ void *thread_run(void *arg)
     // 把自己分离，自己负责资源回收
     pthread_t tid = pthread_self();
     pthread_detach(tid);
+    log_thread_init();
 
-    while (1)
+    worker *w = arg;
+    if (w->cpu >= 0 && ll_pin_to_cpu(w->cpu) == -1)
+        LOG_WARN("failed to pin worker to cpu %ld", w->cpu);
+
+    int fd, stale;
+    while ((fd = pop_fd(w->pool, w->cpu, &stale)) != -1)
     {
-        int fd = pop_fd((block_queue *)arg);
-        printf("get fd in thread, fd==%d, tid == %lu \n", fd, tid);
+        if (stale)
+        {
+            reject_conn(fd);
+            continue;
+        }
+        LOG_DEBUG("get fd in thread, fd == %ld, tid == %lu, incoming cpu == %ld", fd, tid, sock_incoming_cpu(fd));
         do_echo(fd);
     }
 
+    // 空闲太久被缩容
+    free(w);
+    log_thread_exit();
     return 0;
 }
 
+// 定期检查队头的排队时间，worker 都被长连接占住、又没有新连接触发 push 时也能扩容
+void *pool_monitor(void *arg)
+{
+    pool *p = arg;
+    useconds_t interval = p->target_ns / 2000;
+    log_thread_init();
+    while (1)
+    {
+        usleep(interval > 1000 ? interval : 1000);
+        pthread_mutex_lock(&p->queue.mutex);
+        uint64_t now = ll_now_ns();
+        pool_maybe_grow(p, now);
+        codel_update(p, now);
+        pthread_mutex_unlock(&p->queue.mutex);
+    }
+    return NULL;
+}
+
 void do_echo(int fd)
 {
     char buf[BUF_SIZE];
@@ -163,12 +554,37 @@ void do_echo(int fd)
 
     while ((str_len = read(fd, buf, BUF_SIZE)) > 0)
     {
-        buf[str_len] = '\0';
-        printf("(%lu) Message from client: %s", (unsigned long)pthread_self(), buf);
+        LOG_DEBUG_STR("(%lu) Message from client: ", buf, str_len, pthread_self());
         write(fd, buf, str_len);
     }
     if (str_len < 0)
-        perror("read error");
+        LOG_WARN("read error on fd %ld, errno == %ld", fd, errno);
+    close(fd);
+    LOG_INFO("client disconnected, fd == %ld", fd);
+}
+
+// SIGUSR1 时输出线程池的状态，在 accept 线程里调用
+void dump_pool(int fd)
+{
+    char line[640];
+    pool *p = main_pool;
+    pthread_mutex_lock(&p->queue.mutex);
+    int len = snprintf(line, sizeof(line),
+                       "pool threads=%d idle=%d min=%d max=%d queued=%d target_ms=%.1f grown=%lu shrunk=%lu "
+                       "served=%lu avg_wait_us=%.1f max_wait_us=%.1f overloaded=%d rejected=%lu shed=%lu full=%lu "
+                       "paused_ms=%lu\n",
+                       p->threads, p->idle, p->min_threads, p->max_threads, queue_length(&p->queue), p->target_ns / 1e6,
+                       p->grown, p->shrunk, p->served, p->served ? p->wait_sum_ns / 1e3 / p->served : 0.0,
+                       p->wait_max_ns / 1e3, p->overloaded, p->rejected, p->shed, p->full, p->paused_ns / 1000000);
+    p->wait_max_ns = 0;
+    pthread_mutex_unlock(&p->queue.mutex);
+    write(fd, line, len);
+}
+
+// 快速拒绝：SO_LINGER {1, 0} 让 close 直接发 RST，客户端立即收到 ECONNRESET，也不会在服务端留下 TIME_WAIT
+void reject_conn(int fd)
+{
+    struct linger lg = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
     close(fd);
-    puts("client disconnected...");
 }
@@ -11,9 +11,13 @@
  *                      在高并发的例子里，每个连接都由一个线程单独处理，在这种情况下，服务器程序并不需要对每个子线程进行终止，
  *                      这样的话，每个子线程可以在入口函数开始的地方，把自己设置为分离的，这样就能在它终止后自动回收相关的线程资源了，
  *                      就不需要调用 pthread_join 函数了。
+ *
+ * 每个连接一个线程，每个线程默认预留 8MB 的栈（ulimit -s），连接一多，线程的创建、调度和内存都吃不消，
+ * 同样的直线式写法跑在用户态协程上的版本见 green_server.c。
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -72,7 +76,13 @@ int main(int argc, char *argv[])
         else
             puts("new client connected......");
 
-        pthread_create(&tid, NULL, thread_run, (void*)&clnt_sock);
+        // fd 按值塞进指针里传过去。传 &clnt_sock 的话，新线程还没来得及读它，主线程可能已经 accept 了下一个连接把它改掉，
+        // 两个线程就会服务同一个 fd，另一个连接没人管
+        if (pthread_create(&tid, NULL, thread_run, (void *)(intptr_t)clnt_sock) != 0)
+        {
+            perror("pthread_create() error");
+            close(clnt_sock);
+        }
     }
 
     close(serv_sock);
@@ -84,7 +94,7 @@ void* thread_run(void *arg)
     // 把自己分离，自己负责资源回收
     pthread_detach(pthread_self());
 
-    int fd = *(int *)arg;
+    int fd = (int)(intptr_t)arg;
 
     char buf[BUF_SIZE];
     int str_len;
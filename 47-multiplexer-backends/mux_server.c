@@ -0,0 +1,537 @@
+/**
+ * 42、43、44 里的 select、poll、epoll 服务端是三个独立的程序，连接处理的写法各不相同，
+ * 拿它们比较性能时，测出来的差异里混进了代码本身的差异。
+ *
+ * 这里把多路复用抽象成一个接口（00-lib/mux.h），后端在运行时用 -b 选择：
+ * - select : 动态位图，突破 FD_SETSIZE，ctz 遍历就绪位
+ * - poll   : 紧凑的 pollfd 数组 + fd 下标表
+ * - epoll  : 条件触发
+ * - uring  : io_uring 的 IORING_OP_POLL_ADD，批量提交
+ * 连接处理代码对所有后端完全相同，这样就可以做同条件下的对比，也可以按主机挑选最合适的后端：
+ *   ./mux_server -b uring 9190
+ *   kill -USR1 <pid>      // 输出事件循环计数，见 00-lib/loop_stats.h
+ *
+ * 每个连接的状态放在以 fd 为下标的连接表里（00-lib/conn_table.h），
+ * 处理一批事件时会提前预取后面几个事件的表项，-P 关闭预取，-c 用硬件计数器统计每个事件的 cache miss，
+ * 方便对比：
+ *   ./mux_server -c 9190        和     ./mux_server -c -P 9190
+ *   ../90-benchmark/conn_flood 127.0.0.1 9190 100000
+ *
+ * 发送策略记在每个连接上（conn_hot.user），accept 时确定：TCP 连接用 -s 选的策略，UNIX 域连接没有 Nagle，固定 nodelay。
+ * 一次唤醒里同一个连接上的多次写会在这批事件处理完后统一推出去：
+ * - nagle   : 什么都不设置，小包受 Nagle 算法 + 对端延迟 ACK 的影响，可能卡几十毫秒
+ * - nodelay : TCP_NODELAY，每次 write 立即成为一个数据段（默认）
+ * - cork    : 这一批里第一次写之前打开 TCP_CORK，批处理结束后关闭，内核把这批数据合并成尽量少的满段
+ * - more    : 每次 send 带 MSG_MORE，批处理结束后重新设置一次 TCP_NODELAY 把攒下的数据推出去
+ * 一次读不完的大请求会被读成多块、写成多块，用 ../90-benchmark/pingpong_bench 的 segs_per_msg 可以看出差别：
+ *   ../90-benchmark/pingpong_bench 127.0.0.1 9190 0 20000 4096
+ *
+ * -u 热重启（00-lib/hot_restart.h）：不自己 bind，而是从同一端口上正在运行的 mux_server 手里接过 TCP 和 UNIX 域的监听套接字，
+ * 旧进程随即停止 accept，等已有的连接都关闭后退出（最多等 DRAIN_TIMEOUT 秒，之后强制关闭）。
+ * 升级期间监听队列一直存在，压测客户端看不到 ECONNREFUSED：
+ *   ../90-benchmark/churn_bench 127.0.0.1 9190 30 &
+ *   ./mux_server -u 9190 &      // 可以反复执行，每次换一个进程
+ * 没有正在运行的进程时 -u 和普通启动一样。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "../00-lib/error.h"
+#include "../00-lib/loop_stats.h"
+#include "../00-lib/mux.h"
+#include "../00-lib/conn_table.h"
+#include "../00-lib/unix_sock.h"
+#include "../00-lib/hot_restart.h"
+#include "../00-lib/perf_counter.h"
+
+#define BUF_SIZE 1024
+#define MAX_EVENTS 256
+#define ACCEPT_BATCH 64
+#define READ_BATCH 16 // 一个事件里最多连续读几次，避免一个连接占住整个循环
+#define DRAIN_TIMEOUT 30 // 交出监听套接字后最多等已有连接多少秒
+
+enum send_policy
+{
+    SEND_NAGLE,
+    SEND_NODELAY,
+    SEND_CORK,
+    SEND_MORE,
+};
+
+// conn_hot.flags
+#define CONN_DIRTY 1  // 这一批里写过数据，已经在 dirty 列表中
+#define CONN_CORKED 2 // 已经打开 TCP_CORK
+
+typedef struct
+{
+    mux *m;
+    loop_stats *ls;
+    conn_table conns;
+    int serv_sock;
+    int unix_sock; // 同样服务的 UNIX 域监听套接字，见 00-lib/unix_sock.h
+    int ctl_sock;  // 热重启的控制套接字，见 00-lib/hot_restart.h
+    uint64_t drain_deadline_ns; // 不为 0 时已经交出监听套接字，正在排空连接
+    int prefetch;
+    int policy; // 新的 TCP 连接使用的发送策略
+    int dirty[MAX_EVENTS]; // 这一批里写过数据的连接，每个连接在一批里最多出现一次
+    int ndirty;
+} server;
+
+static perf_counter cache_misses;
+static loop_stats *main_ls;
+
+void set_nonblocking_mode(int fd);
+void handle_accept(server *srv, int listen_sock);
+void handle_client(server *srv, int fd, int events);
+void close_client(server *srv, conn_hot *c);
+void flush_batch(server *srv);
+void handle_upgrade(server *srv);
+int drain_done(server *srv);
+int parse_policy(const char *name);
+void dump_perf(int fd);
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in serv_addr;
+    const char *backend = "epoll";
+    mux_event events[MAX_EVENTS];
+    int count_misses = 0, upgrade = 0;
+    int opt;
+    server srv;
+
+    memset(&srv, 0, sizeof(srv));
+    srv.prefetch = 1;
+    srv.policy = SEND_NODELAY;
+    while ((opt = getopt(argc, argv, "b:Pcs:u")) != -1)
+    {
+        if (opt == 'b')
+            backend = optarg;
+        else if (opt == 's')
+        {
+            srv.policy = parse_policy(optarg);
+            if (srv.policy == -1)
+                optind = argc; // 输出用法
+        }
+        else if (opt == 'P')
+            srv.prefetch = 0;
+        else if (opt == 'c')
+            count_misses = 1;
+        else if (opt == 'u')
+            upgrade = 1;
+        else
+            break;
+    }
+    if (optind != argc - 1)
+    {
+        printf("Usage: %s [-b select|poll|epoll|uring] [-s nagle|nodelay|cork|more] [-P] [-c] [-u] <port>\n", argv[0]);
+        exit(1);
+    }
+
+    srv.m = mux_create(backend);
+    if (srv.m == NULL)
+    {
+        fprintf(stderr, "unknown or unsupported backend: %s\n", backend);
+        exit(1);
+    }
+    // 连接表按 RLIMIT_NOFILE 分配，没用到的页不会占用物理内存
+    if (conn_table_init(&srv.conns, 0) == -1)
+        error_handling("conn_table_init() error");
+
+    int port = atoi(argv[optind]);
+    int ctl = -1;
+    if (upgrade)
+    {
+        int fds[2], nfds;
+        ctl = hr_takeover(port, fds, 2, &nfds);
+        if (ctl == -1)
+            fputs("no running instance to take over, starting normally\n", stderr);
+        else
+        {
+            srv.serv_sock = fds[0];
+            srv.unix_sock = nfds > 1 ? fds[1] : -1;
+        }
+    }
+
+    if (ctl == -1)
+    {
+        srv.serv_sock = socket(PF_INET, SOCK_STREAM, 0);
+        if (srv.serv_sock == -1)
+            error_handling("socket() error");
+
+        // 打开 SO_REUSEADDR
+        int option = 1;
+        int optlen = sizeof(option);
+        setsockopt(srv.serv_sock, SOL_SOCKET, SO_REUSEADDR, (void *)&option, optlen);
+
+        memset(&serv_addr, 0, sizeof(serv_addr));
+        serv_addr.sin_family = AF_INET;
+        serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        serv_addr.sin_port = htons(port);
+
+        if (bind(srv.serv_sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
+            error_handling("bind() error");
+
+        if (listen(srv.serv_sock, 1024) == -1)
+            error_handling("listen error");
+
+        srv.unix_sock = unix_listen_port(port, 1024);
+        if (srv.unix_sock == -1)
+            perror("unix_listen() error");
+    }
+
+    // 监听套接字设置为非阻塞，一次唤醒里可以把已完成连接队列里的连接都取出来（见 45-nonblocking-io）
+    set_nonblocking_mode(srv.serv_sock);
+    if (mux_add(srv.m, srv.serv_sock, MUX_READ) == -1)
+        error_handling("mux_add() error");
+    if (srv.unix_sock != -1)
+    {
+        set_nonblocking_mode(srv.unix_sock);
+        mux_add(srv.m, srv.unix_sock, MUX_READ);
+    }
+
+    // 已经在监听套接字上等事件了，这时再让旧进程停止 accept
+    if (ctl != -1 && hr_ready(ctl) == -1)
+        fputs("previous instance did not confirm the handoff\n", stderr);
+    srv.ctl_sock = hr_listen(port);
+    if (srv.ctl_sock == -1)
+        perror("hr_listen() error");
+    else
+        mux_add(srv.m, srv.ctl_sock, MUX_READ);
+
+    srv.ls = main_ls = loop_stats_register(mux_name(srv.m));
+    if (count_misses)
+    {
+        if (perf_counter_open(&cache_misses, "cache_misses", PERF_COUNT_HW_CACHE_MISSES) == -1)
+            fputs("hardware cache-miss counter unavailable\n", stderr);
+        loop_stats_set_dump_hook(dump_perf);
+    }
+
+    while (!drain_done(&srv))
+    {
+        // 排空期间定时醒来检查是否超时
+        int n = mux_wait(srv.m, events, MAX_EVENTS, srv.drain_deadline_ns ? 1000 : -1);
+        if (n == -1)
+        {
+            if (errno == EINTR) // 被 SIGUSR1 打断
+            {
+                loop_stats_poll();
+                continue;
+            }
+            perror("mux_wait() error");
+            break;
+        }
+        loop_stats_wakeup(srv.ls, n);
+        loop_stats_poll();
+
+        if (srv.prefetch)
+            for (int i = 0; i < n && i < CONN_PREFETCH_DISTANCE; i++)
+                conn_prefetch(&srv.conns, events[i].fd);
+
+        for (int i = 0; i < n; i++)
+        {
+            // 处理第 i 个事件时，第 i + CONN_PREFETCH_DISTANCE 个事件的表项已经在路上了
+            if (srv.prefetch && i + CONN_PREFETCH_DISTANCE < n)
+                conn_prefetch(&srv.conns, events[i + CONN_PREFETCH_DISTANCE].fd);
+
+            if (events[i].fd == srv.serv_sock || events[i].fd == srv.unix_sock)
+                handle_accept(&srv, events[i].fd);
+            else if (events[i].fd == srv.ctl_sock)
+                handle_upgrade(&srv);
+            else
+                handle_client(&srv, events[i].fd, events[i].events);
+        }
+        flush_batch(&srv);
+    }
+
+    if (srv.serv_sock != -1)
+        close(srv.serv_sock);
+    mux_destroy(srv.m);
+    return 0;
+}
+
+void set_nonblocking_mode(int fd)
+{
+    int flag = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flag | O_NONBLOCK);
+}
+
+// 新进程来接管监听套接字，交接成功后停止 accept，开始排空
+void handle_upgrade(server *srv)
+{
+    int fds[2] = {srv->serv_sock, srv->unix_sock};
+    if (hr_handoff(srv->ctl_sock, fds, srv->unix_sock != -1 ? 2 : 1, HR_TIMEOUT_MS) == -1)
+    {
+        fputs("hot restart aborted, still serving\n", stderr);
+        return;
+    }
+
+    // 这一批后面可能还有监听套接字的事件，fd 置为 -1 后不会再被当成监听套接字
+    int *socks[] = {&srv->serv_sock, &srv->unix_sock, &srv->ctl_sock};
+    for (int i = 0; i < 3; i++)
+    {
+        if (*socks[i] == -1)
+            continue;
+        mux_del(srv->m, *socks[i]);
+        close(*socks[i]);
+        *socks[i] = -1;
+    }
+    srv->drain_deadline_ns = conn_clock_ns() + (uint64_t)DRAIN_TIMEOUT * 1000000000;
+    fprintf(stderr, "handed off listeners, draining %d connections\n", srv->conns.count);
+}
+
+// 交出监听套接字后，连接都已关闭或者排空超时时返回 1，超时的连接直接关闭
+int drain_done(server *srv)
+{
+    if (srv->drain_deadline_ns == 0)
+        return 0;
+    if (srv->conns.count > 0 && conn_clock_ns() < srv->drain_deadline_ns)
+        return 0;
+
+    int forced = srv->conns.count;
+    for (int fd = 0; fd < srv->conns.capacity && srv->conns.count > 0; fd++)
+    {
+        conn_hot *c = conn_get(&srv->conns, fd);
+        if (c != NULL)
+            close_client(srv, c);
+    }
+    if (forced > 0)
+        fprintf(stderr, "drain timeout, closed %d connections\n", forced);
+    return 1;
+}
+
+void handle_accept(server *srv, int listen_sock)
+{
+    loop_stats *ls = srv->ls;
+
+    for (int i = 0; i < ACCEPT_BATCH; i++)
+    {
+        struct sockaddr_storage clnt_addr;
+        socklen_t clnt_addr_size = sizeof(clnt_addr);
+        int clnt_sock = accept(listen_sock, (struct sockaddr *)&clnt_addr, &clnt_addr_size);
+        LS_INC(ls, syscalls);
+        if (clnt_sock == -1)
+            return; // EAGAIN：已完成连接队列已经取空
+
+        conn_hot *c = conn_open(&srv->conns, clnt_sock);
+        if (c == NULL || mux_add(srv->m, clnt_sock, MUX_READ) == -1)
+        {
+            if (c != NULL)
+                conn_close(&srv->conns, clnt_sock);
+            close(clnt_sock);
+            continue;
+        }
+        // 连接套接字也是非阻塞的，写不完的数据放进连接的输出缓冲，等可写事件再发
+        set_nonblocking_mode(clnt_sock);
+        // TCP 选项只对 TCP 连接有意义
+        c->user = listen_sock == srv->unix_sock ? SEND_NODELAY : srv->policy;
+        if (listen_sock != srv->unix_sock && c->user != SEND_NAGLE)
+        {
+            int option = 1;
+            setsockopt(clnt_sock, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+        }
+        c->events = MUX_READ;
+        c->last_active_ns = conn_clock_ns();
+
+        conn_cold *cold = conn_get_cold(&srv->conns, clnt_sock);
+        memcpy(&cold->peer, &clnt_addr, clnt_addr_size);
+        cold->peer_len = clnt_addr_size;
+        cold->accepted_ns = c->last_active_ns;
+
+        LS_INC(ls, accepts);
+        LS_INC(ls, queue_depth);
+    }
+}
+
+// 尽量把输出缓冲写出去，返回 -1 表示连接出错
+int flush_output(server *srv, conn_hot *c)
+{
+    while (conn_pending_output(c) > 0)
+    {
+        int n = write(c->fd, c->out_buf + c->out_off, conn_pending_output(c));
+        LS_INC(srv->ls, syscalls);
+        if (n == -1)
+            return errno == EAGAIN ? 0 : -1;
+        c->out_off += n;
+        LS_ADD(srv->ls, bytes_out, n);
+    }
+    c->out_off = c->out_len = 0;
+    return 0;
+}
+
+/**
+ * 根据是否还有待发送的数据，调整在多路复用器里关注的事件。
+ * 对端只发不收时回显会积压在输出缓冲里，积压过多就先不读，只等可写，写下去了再接着读。
+ */
+void update_interest(server *srv, conn_hot *c)
+{
+    int want = c->state == CONN_OPEN && conn_want_read(c, c->events & MUX_READ) ? MUX_READ : 0;
+    if (conn_pending_output(c) > 0)
+        want |= MUX_WRITE;
+    if (want != c->events)
+    {
+        mux_mod(srv->m, c->fd, want);
+        c->events = want;
+    }
+}
+
+// 按发送策略写一块数据，写不完的部分进输出缓冲，返回 -1 表示连接出错
+int send_data(server *srv, conn_hot *c, const char *data, int len)
+{
+    int sent = 0;
+
+    // 前面还有数据排队时不能直接写，否则会打乱顺序
+    if (conn_pending_output(c) == 0)
+    {
+        int flags = 0;
+        if (c->user == SEND_CORK && !(c->flags & CONN_CORKED))
+        {
+            int option = 1;
+            setsockopt(c->fd, IPPROTO_TCP, TCP_CORK, &option, sizeof(option));
+            LS_INC(srv->ls, syscalls);
+            c->flags |= CONN_CORKED;
+        }
+        else if (c->user == SEND_MORE)
+            flags = MSG_MORE;
+
+        sent = send(c->fd, data, len, flags);
+        LS_INC(srv->ls, syscalls);
+        if (sent == -1)
+        {
+            if (errno != EAGAIN)
+                return -1;
+            sent = 0;
+        }
+        LS_ADD(srv->ls, bytes_out, sent);
+    }
+    if (sent < len && conn_buffer_output(c, data + sent, len - sent) == -1)
+        return -1;
+
+    if (!(c->flags & CONN_DIRTY) && srv->ndirty < MAX_EVENTS)
+    {
+        c->flags |= CONN_DIRTY;
+        srv->dirty[srv->ndirty++] = c->fd;
+    }
+    return 0;
+}
+
+/**
+ * 一批事件处理完后，把攒在内核里的数据推出去：
+ * cork 模式关闭 TCP_CORK，more 模式重新设置 TCP_NODELAY（设置时内核会立即推送挂起的数据）。
+ */
+void flush_batch(server *srv)
+{
+    int option;
+
+    for (int i = 0; i < srv->ndirty; i++)
+    {
+        // 连接可能已经在这一批里关闭，fd 甚至可能已被新连接复用，新连接的 flags 是清零的
+        conn_hot *c = conn_get(&srv->conns, srv->dirty[i]);
+        if (c == NULL || !(c->flags & CONN_DIRTY))
+            continue;
+        if (c->flags & CONN_CORKED)
+        {
+            option = 0;
+            setsockopt(c->fd, IPPROTO_TCP, TCP_CORK, &option, sizeof(option));
+            LS_INC(srv->ls, syscalls);
+        }
+        else if (c->user == SEND_MORE)
+        {
+            option = 1;
+            setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+            LS_INC(srv->ls, syscalls);
+        }
+        c->flags &= ~(CONN_DIRTY | CONN_CORKED);
+    }
+    srv->ndirty = 0;
+}
+
+void handle_client(server *srv, int fd, int events)
+{
+    loop_stats *ls = srv->ls;
+    char buf[BUF_SIZE];
+
+    conn_hot *c = conn_get(&srv->conns, fd);
+    if (c == NULL)
+        return;
+
+    if ((events & MUX_WRITE) && flush_output(srv, c) == -1)
+    {
+        close_client(srv, c);
+        return;
+    }
+
+    // 一次读不完的请求连续读几次，每块都回显一次，这样一个事件里会有多次写，发送策略才有区别
+    for (int r = 0; r < READ_BATCH && c->state == CONN_OPEN && (events & (MUX_READ | MUX_ERROR)); r++)
+    {
+        int str_len = read(fd, buf, BUF_SIZE);
+        LS_INC(ls, syscalls);
+        if (str_len == 0 || (str_len == -1 && errno != EAGAIN)) // close request
+        {
+            // 还有没发完的回显数据时，先停止读，等写完再关闭
+            c->state = CONN_CLOSING;
+            break;
+        }
+        if (str_len == -1) // EAGAIN：已经读空
+            break;
+
+        LS_ADD(ls, bytes_in, str_len);
+        conn_get_cold(&srv->conns, fd)->requests++;
+        c->last_active_ns = conn_clock_ns();
+        if (send_data(srv, c, buf, str_len) == -1)
+        {
+            close_client(srv, c);
+            return;
+        }
+        // 没读满说明已经读空；写不下去了也先停下，不然对端只发不收时每个事件都往输出缓冲里塞 READ_BATCH 块
+        if (str_len < BUF_SIZE || conn_pending_output(c) > 0)
+            break;
+    }
+
+    if (c->state == CONN_CLOSING && conn_pending_output(c) == 0)
+    {
+        close_client(srv, c);
+        return;
+    }
+    update_interest(srv, c);
+}
+
+void close_client(server *srv, conn_hot *c)
+{
+    int fd = c->fd;
+    // 先从多路复用器里注销再 close，io_uring 后端需要用这个时机取消内核里的 poll 请求
+    mux_del(srv->m, fd);
+    conn_close(&srv->conns, fd);
+    close(fd);
+    LS_INC(srv->ls, syscalls);
+    LS_INC(srv->ls, closes);
+    LS_DEC(srv->ls, queue_depth);
+}
+
+int parse_policy(const char *name)
+{
+    static const char *names[] = {"nagle", "nodelay", "cork", "more"};
+    for (int i = 0; i < 4; i++)
+        if (strcmp(name, names[i]) == 0)
+            return i;
+    return -1;
+}
+
+void dump_perf(int fd)
+{
+    char line[256];
+    uint64_t misses = perf_counter_read(&cache_misses);
+    uint64_t events = main_ls->events;
+    int len = snprintf(line, sizeof(line), "perf available=%d cache_misses=%lu events=%lu misses_per_event=%.2f\n",
+                       cache_misses.fd >= 0, misses, events, events ? (double)misses / events : 0.0);
+    write(fd, line, len);
+}
+
+// 客户端可以用 05/echo_client.c
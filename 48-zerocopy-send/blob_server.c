@@ -0,0 +1,573 @@
+/**
+ * 发送大块内存数据的服务端，演示 MSG_ZEROCOPY 发送路径（00-lib/zerocopy.h）。
+ *
+ * 协议：客户端发送 4 字节（网络字节序）的长度 n，服务端回复 n 字节数据，可以在同一个连接上重复请求。
+ * 数据来自一个缓冲池，每块 POOL_BUF_SIZE 字节，相当于已经生成好、放在内存里的响应（比如缓存的对象），
+ * 不是文件，所以用不了 sendfile。
+ *
+ * 每次 send 的长度 >= 阈值（-z，默认 16KB）时走零拷贝，否则走普通复制；-Z 完全关闭零拷贝，用来对比。
+ * 内核报告数据最终还是被复制了（回环、veth 到本机套接字）时，连接会自动退回普通发送，-F 强制一直用零拷贝。
+ * 零拷贝发送的缓冲块要等错误队列里的完成通知到了才能还给缓冲池，通知到达时套接字会出现 POLLERR（MUX_ERROR）。
+ * 缓冲池用完时，连接暂停发送，等其他发送完成后再继续。
+ * 连接关闭时还有缓冲块在内核里的，先 shutdown，等完成通知把缓冲块都还回来再 close（见 zerocopy.h 的 zc_drain）。
+ *
+ *   ./blob_server 9190              和       ./blob_server -Z 9190
+ *   ../90-benchmark/blob_bench 127.0.0.1 9190 1048576
+ *   kill -USR1 <pid>                // 输出零拷贝次数、内核报告的 “仍然复制了” 的次数和进程 CPU 时间
+ *
+ * -u 热重启，和 47-multiplexer-backends/mux_server -u 一样（00-lib/hot_restart.h）：从同一端口上正在运行的 blob_server
+ * 接过监听套接字，旧进程停止 accept，等已有连接结束（包括排空零拷贝缓冲块）后退出，最多等 RETIRE_TIMEOUT 秒。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "../00-lib/error.h"
+#include "../00-lib/loop_stats.h"
+#include "../00-lib/mux.h"
+#include "../00-lib/conn_table.h"
+#include "../00-lib/unix_sock.h"
+#include "../00-lib/hot_restart.h"
+#include "../00-lib/zerocopy.h"
+
+#define MAX_EVENTS 256
+#define POOL_BUF_SIZE (64 * 1024)
+#define POOL_COUNT 1024
+#define MAX_REQUEST (1u << 30)
+#define DRAIN_SWEEP_MS 10          // 有连接在排空或者在等缓冲池时，每隔这么久检查一次它们的完成通知
+#define DRAIN_USER_TIMEOUT_MS 10000 // 排空中的连接上数据这么久没被确认，内核就放弃连接，缓冲块随之释放
+#define DRAIN_TIMEOUT_NS (3 * DRAIN_USER_TIMEOUT_MS * 1000000ull)
+#define RETIRE_TIMEOUT 30 // 热重启交出监听套接字后，最多再服务已有连接这么多秒
+
+typedef struct
+{
+    zc_queue zq;
+    uint32_t req;       // 正在读取的请求长度
+    int req_got;        // 已读到的请求字节数
+    uint64_t remaining; // 还要发送的字节数（不含 buf 中的）
+    char *buf;          // 正在发送的缓冲块
+    int len;
+    int off;
+    int waiting;        // 在等缓冲池
+} blob_conn;
+
+typedef struct
+{
+    mux *m;
+    loop_stats *ls;
+    conn_table conns;
+    zc_pool pool;
+    int serv_sock;
+    int unix_sock; // 同样服务的 UNIX 域监听套接字，见 00-lib/unix_sock.h
+    int ctl_sock;  // 热重启的控制套接字，见 00-lib/hot_restart.h
+    uint64_t retire_deadline_ns; // 不为 0 时已经交出监听套接字，等已有连接结束
+    size_t threshold;
+    int zerocopy;
+    int fallback; // 内核总是复制时对连接关闭零拷贝，-F 强制保持
+    int *waiters; // 等待缓冲块的连接
+    int nwaiters;
+    int *draining; // 已经关闭、还在等缓冲块回来的连接
+    int ndraining;
+    uint64_t next_sweep_ns;
+    uint64_t zc_sends, copy_sends, copied, lost;
+} server;
+
+static server srv;
+
+void set_nonblocking_mode(int fd);
+void handle_accept(server *s, int listen_sock);
+void handle_client(server *s, int fd, int events);
+void close_client(server *s, conn_hot *c);
+void finish_close(server *s, conn_hot *c);
+void sweep(server *s);
+void handle_upgrade(server *s);
+int retire_done(server *s);
+void set_interest(server *s, conn_hot *c, int events);
+void wake_waiters(server *s);
+void dump_zerocopy(int fd);
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in serv_addr;
+    const char *backend = "epoll";
+    mux_event events[MAX_EVENTS];
+    int opt, upgrade = 0;
+
+    srv.threshold = 16 * 1024;
+    srv.zerocopy = 1;
+    srv.fallback = 1;
+    while ((opt = getopt(argc, argv, "b:z:ZFu")) != -1)
+    {
+        if (opt == 'b')
+            backend = optarg;
+        else if (opt == 'z')
+            srv.threshold = atol(optarg);
+        else if (opt == 'Z')
+            srv.zerocopy = 0;
+        else if (opt == 'F')
+            srv.fallback = 0;
+        else if (opt == 'u')
+            upgrade = 1;
+        else
+            break;
+    }
+    if (optind != argc - 1)
+    {
+        printf("Usage: %s [-b backend] [-z threshold] [-Z] [-F] [-u] <port>\n", argv[0]);
+        exit(1);
+    }
+
+    srv.m = mux_create(backend);
+    if (srv.m == NULL)
+    {
+        fprintf(stderr, "unknown or unsupported backend: %s\n", backend);
+        exit(1);
+    }
+    if (conn_table_init(&srv.conns, 0) == -1)
+        error_handling("conn_table_init() error");
+    if (zc_pool_init(&srv.pool, POOL_BUF_SIZE, POOL_COUNT) == -1)
+        error_handling("zc_pool_init() error");
+    // 缓冲池的内容一次性生成，之后每次发送都直接用
+    for (size_t i = 0; i < (size_t)POOL_BUF_SIZE * POOL_COUNT; i++)
+        srv.pool.mem[i] = 'a' + i % 26;
+    srv.waiters = malloc(sizeof(int) * srv.conns.capacity);
+    srv.draining = malloc(sizeof(int) * srv.conns.capacity);
+
+    int port = atoi(argv[optind]);
+    int ctl = -1;
+    if (upgrade)
+    {
+        int fds[2], nfds;
+        ctl = hr_takeover(port, fds, 2, &nfds);
+        if (ctl == -1)
+            fputs("no running instance to take over, starting normally\n", stderr);
+        else
+        {
+            srv.serv_sock = fds[0];
+            srv.unix_sock = nfds > 1 ? fds[1] : -1;
+        }
+    }
+
+    if (ctl == -1)
+    {
+        srv.serv_sock = socket(PF_INET, SOCK_STREAM, 0);
+        if (srv.serv_sock == -1)
+            error_handling("socket() error");
+
+        int option = 1;
+        setsockopt(srv.serv_sock, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+
+        memset(&serv_addr, 0, sizeof(serv_addr));
+        serv_addr.sin_family = AF_INET;
+        serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        serv_addr.sin_port = htons(port);
+
+        if (bind(srv.serv_sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
+            error_handling("bind() error");
+        if (listen(srv.serv_sock, 128) == -1)
+            error_handling("listen error");
+
+        srv.unix_sock = unix_listen_port(port, 128);
+        if (srv.unix_sock == -1)
+            perror("unix_listen() error");
+    }
+
+    set_nonblocking_mode(srv.serv_sock);
+    if (mux_add(srv.m, srv.serv_sock, MUX_READ) == -1)
+        error_handling("mux_add() error");
+    if (srv.unix_sock != -1)
+    {
+        set_nonblocking_mode(srv.unix_sock);
+        mux_add(srv.m, srv.unix_sock, MUX_READ);
+    }
+
+    // 已经在监听套接字上等事件了，这时再让旧进程停止 accept
+    if (ctl != -1 && hr_ready(ctl) == -1)
+        fputs("previous instance did not confirm the handoff\n", stderr);
+    srv.ctl_sock = hr_listen(port);
+    if (srv.ctl_sock == -1)
+        perror("hr_listen() error");
+    else
+        mux_add(srv.m, srv.ctl_sock, MUX_READ);
+
+    srv.ls = loop_stats_register(mux_name(srv.m));
+    loop_stats_set_dump_hook(dump_zerocopy);
+
+    while (!retire_done(&srv))
+    {
+        // select 后端不能只等 POLLERR，排空和等缓冲池的连接靠定时检查兜底；交出监听套接字后定时检查是否超时
+        int timeout = srv.retire_deadline_ns ? 1000 : -1;
+        if (srv.ndraining > 0 || srv.nwaiters > 0)
+            timeout = DRAIN_SWEEP_MS;
+        int n = mux_wait(srv.m, events, MAX_EVENTS, timeout);
+        if (n == -1)
+        {
+            if (errno == EINTR) // 被 SIGUSR1 打断
+            {
+                loop_stats_poll();
+                continue;
+            }
+            perror("mux_wait() error");
+            break;
+        }
+        loop_stats_wakeup(srv.ls, n);
+        loop_stats_poll();
+
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].fd == srv.serv_sock || events[i].fd == srv.unix_sock)
+                handle_accept(&srv, events[i].fd);
+            else if (events[i].fd == srv.ctl_sock)
+                handle_upgrade(&srv);
+            else
+                handle_client(&srv, events[i].fd, events[i].events);
+        }
+        if ((srv.ndraining > 0 || srv.nwaiters > 0) && conn_clock_ns() >= srv.next_sweep_ns)
+            sweep(&srv);
+        if (srv.nwaiters > 0 && srv.pool.free_cnt > 0)
+            wake_waiters(&srv);
+    }
+
+    if (srv.serv_sock != -1)
+        close(srv.serv_sock);
+    mux_destroy(srv.m);
+    return 0;
+}
+
+void set_nonblocking_mode(int fd)
+{
+    int flag = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flag | O_NONBLOCK);
+}
+
+// 新进程来接管监听套接字，交接成功后停止 accept，已有连接照常服务到结束
+void handle_upgrade(server *s)
+{
+    int fds[2] = {s->serv_sock, s->unix_sock};
+    if (hr_handoff(s->ctl_sock, fds, s->unix_sock != -1 ? 2 : 1, HR_TIMEOUT_MS) == -1)
+    {
+        fputs("hot restart aborted, still serving\n", stderr);
+        return;
+    }
+
+    // 这一批后面可能还有监听套接字的事件，fd 置为 -1 后不会再被当成监听套接字
+    int *socks[] = {&s->serv_sock, &s->unix_sock, &s->ctl_sock};
+    for (int i = 0; i < 3; i++)
+    {
+        if (*socks[i] == -1)
+            continue;
+        mux_del(s->m, *socks[i]);
+        close(*socks[i]);
+        *socks[i] = -1;
+    }
+    s->retire_deadline_ns = conn_clock_ns() + (uint64_t)RETIRE_TIMEOUT * 1000000000;
+    fprintf(stderr, "handed off listeners, draining %d connections\n", s->conns.count);
+}
+
+/**
+ * 交出监听套接字后，连接都已结束或者超时时返回 1。
+ * 连接数里包括还在排空零拷贝缓冲块的连接；超时的直接关闭，进程马上退出，缓冲块也就不用回收了。
+ */
+int retire_done(server *s)
+{
+    if (s->retire_deadline_ns == 0)
+        return 0;
+    if (s->conns.count > 0 && conn_clock_ns() < s->retire_deadline_ns)
+        return 0;
+
+    int forced = s->conns.count;
+    for (int fd = 0; fd < s->conns.capacity && s->conns.count > 0; fd++)
+    {
+        conn_hot *c = conn_get(&s->conns, fd);
+        if (c != NULL && c->state == CONN_OPEN)
+            close_client(s, c);
+    }
+    while (s->ndraining > 0)
+        finish_close(s, conn_get(&s->conns, s->draining[--s->ndraining]));
+    if (forced > 0)
+        fprintf(stderr, "retire timeout, closed %d connections\n", forced);
+    return 1;
+}
+
+void handle_accept(server *s, int listen_sock)
+{
+    while (1)
+    {
+        int clnt_sock = accept(listen_sock, NULL, NULL);
+        LS_INC(s->ls, syscalls);
+        if (clnt_sock == -1)
+            return; // EAGAIN：已完成连接队列已经取空
+
+        conn_hot *c = conn_open(&s->conns, clnt_sock);
+        blob_conn *b = calloc(1, sizeof(blob_conn));
+        if (c == NULL || b == NULL || mux_add(s->m, clnt_sock, MUX_READ) == -1)
+        {
+            if (c != NULL)
+                conn_close(&s->conns, clnt_sock);
+            free(b);
+            close(clnt_sock);
+            continue;
+        }
+        set_nonblocking_mode(clnt_sock);
+        // UNIX 域套接字不支持 MSG_ZEROCOPY，zc_send 会一直走普通发送
+        if (s->zerocopy && listen_sock == s->serv_sock && zc_enable(&b->zq, clnt_sock) == -1)
+            perror("SO_ZEROCOPY");
+        b->zq.fallback = s->fallback;
+        c->events = MUX_READ;
+        c->user = (uintptr_t)b;
+        LS_INC(s->ls, accepts);
+        LS_INC(s->ls, queue_depth);
+    }
+}
+
+/**
+ * 发送当前请求剩下的数据，直到发完、套接字写满或者缓冲池用完。
+ * 返回 -1 表示连接出错。
+ */
+int pump(server *s, conn_hot *c, blob_conn *b)
+{
+    while (b->buf != NULL || b->remaining > 0)
+    {
+        if (b->buf == NULL)
+        {
+            b->buf = zc_pool_get(&s->pool);
+            if (b->buf == NULL)
+            {
+                // 暂停写，等别的连接的零拷贝发送完成、归还缓冲块后再被唤醒。
+                // 读事件要留着：自己在途发送的完成通知也得回收，select 后端里 POLLERR 只会表现为可读
+                if (!b->waiting)
+                {
+                    b->waiting = 1;
+                    s->waiters[s->nwaiters++] = c->fd;
+                }
+                set_interest(s, c, MUX_READ);
+                return 0;
+            }
+            b->len = b->remaining < POOL_BUF_SIZE ? b->remaining : POOL_BUF_SIZE;
+            b->off = 0;
+            b->remaining -= b->len;
+        }
+
+        ssize_t n = zc_send(&b->zq, c->fd, b->buf + b->off, b->len - b->off, s->threshold);
+        LS_INC(s->ls, syscalls);
+        if (n == -1)
+        {
+            if (errno != EAGAIN && errno != ENOBUFS) // ENOBUFS：超过了可以钉住的内存上限，稍后重试
+                return -1;
+            // 发送期间不读新请求，只关注可写，否则客户端流水线发来的请求会让读事件一直就绪
+            set_interest(s, c, MUX_WRITE);
+            return 0;
+        }
+        LS_ADD(s->ls, bytes_out, n);
+        b->off += n;
+        if (b->off == b->len)
+        {
+            zc_release(&b->zq, &s->pool, b->buf);
+            b->buf = NULL;
+        }
+    }
+    set_interest(s, c, MUX_READ);
+    return 0;
+}
+
+void handle_client(server *s, int fd, int events)
+{
+    conn_hot *c = conn_get(&s->conns, fd);
+    if (c == NULL || c->state == CONN_CLOSING) // 同一批事件里前面已经把它关了
+        return;
+    blob_conn *b = (blob_conn *)(uintptr_t)c->user;
+
+    // 错误队列里有完成通知（select 后端报告为可读或可写）；没有可回收的缓冲块时，再确认一下是不是真的出错了
+    int released = zc_inflight(&b->zq) > 0 ? zc_reap(&b->zq, fd, &s->pool) : 0;
+    if ((events & MUX_ERROR) && released == 0)
+    {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0)
+        {
+            close_client(s, c);
+            return;
+        }
+    }
+
+    // 在等缓冲池时可读：对端关闭了就关闭连接；是流水线发来的下一个请求的话，先不读它，
+    // 去掉读事件免得一直就绪（完成通知 epoll / poll / uring 照样报告，select 靠 sweep）
+    if (b->waiting && (events & MUX_READ))
+    {
+        char peek;
+        int n = recv(fd, &peek, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n == 0 || (n == -1 && errno != EAGAIN))
+        {
+            close_client(s, c);
+            return;
+        }
+        if (n > 0)
+            set_interest(s, c, 0);
+    }
+
+    // 上一个请求还没发完时不读新请求
+    if ((events & (MUX_READ | MUX_ERROR)) && b->buf == NULL && b->remaining == 0)
+    {
+        int n = read(fd, (char *)&b->req + b->req_got, sizeof(b->req) - b->req_got);
+        LS_INC(s->ls, syscalls);
+        if (n == 0 || (n == -1 && errno != EAGAIN))
+        {
+            close_client(s, c);
+            return;
+        }
+        if (n > 0)
+        {
+            LS_ADD(s->ls, bytes_in, n);
+            b->req_got += n;
+            if (b->req_got == sizeof(b->req))
+            {
+                uint32_t len = ntohl(b->req);
+                b->remaining = len < MAX_REQUEST ? len : MAX_REQUEST;
+                b->req_got = 0;
+            }
+        }
+    }
+
+    if (!b->waiting && (b->buf != NULL || b->remaining > 0) && pump(s, c, b) == -1)
+        close_client(s, c);
+}
+
+void set_interest(server *s, conn_hot *c, int events)
+{
+    if (c->events != events)
+    {
+        mux_mod(s->m, c->fd, events);
+        c->events = events;
+    }
+}
+
+// 缓冲池有空闲后，让等待中的连接继续发送
+void wake_waiters(server *s)
+{
+    int n = s->nwaiters;
+    s->nwaiters = 0;
+    for (int i = 0; i < n; i++)
+    {
+        conn_hot *c = conn_get(&s->conns, s->waiters[i]);
+        if (c == NULL)
+            continue;
+        blob_conn *b = (blob_conn *)(uintptr_t)c->user;
+        if (!b->waiting) // fd 已经被新连接复用
+            continue;
+        b->waiting = 0;
+        if (pump(s, c, b) == -1)
+            close_client(s, c);
+    }
+}
+
+void close_client(server *s, conn_hot *c)
+{
+    int fd = c->fd;
+    blob_conn *b = (blob_conn *)(uintptr_t)c->user;
+
+    if (b->buf != NULL)
+        zc_release(&b->zq, &s->pool, b->buf);
+    b->buf = NULL;
+    b->remaining = 0;
+    b->waiting = 0;
+    mux_del(s->m, fd);
+    LS_INC(s->ls, closes);
+    LS_DEC(s->ls, queue_depth);
+    if (zc_drain(&b->zq, fd, &s->pool) == 0)
+    {
+        finish_close(s, c);
+        return;
+    }
+
+    /**
+     * 还有缓冲块被内核引用着，现在 close 就再也收不到它们的完成通知了。
+     * shutdown 之后数据照样发完，对端确认（或者连接出错被内核放弃）时通知到达，由 sweep 回收；
+     * 不留在多路复用器里：对端也关闭之后 POLLHUP 会一直就绪。
+     * TCP_USER_TIMEOUT 限制对端一直不确认时的等待时间，超过 DRAIN_TIMEOUT_NS 还没回来的才算丢失。
+     */
+    int timeout = DRAIN_USER_TIMEOUT_MS;
+    shutdown(fd, SHUT_WR);
+    setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &timeout, sizeof(timeout));
+    c->state = CONN_CLOSING;
+    c->deadline_ns = conn_clock_ns() + DRAIN_TIMEOUT_NS;
+    s->draining[s->ndraining++] = fd;
+}
+
+// 连接的缓冲块都回来了（或者放弃了），真正关闭
+void finish_close(server *s, conn_hot *c)
+{
+    int fd = c->fd;
+    blob_conn *b = (blob_conn *)(uintptr_t)c->user;
+
+    s->lost += b->zq.held;
+    s->zc_sends += b->zq.zc_sends;
+    s->copy_sends += b->zq.copy_sends;
+    s->copied += b->zq.copied;
+    free(b);
+    conn_close(&s->conns, fd);
+    close(fd);
+}
+
+// 回收排空中的连接和等缓冲池的连接的完成通知，排空完的连接关闭
+void sweep(server *s)
+{
+    uint64_t now = conn_clock_ns();
+    s->next_sweep_ns = now + DRAIN_SWEEP_MS * 1000000ull;
+
+    for (int i = 0; i < s->nwaiters; i++)
+    {
+        conn_hot *c = conn_get(&s->conns, s->waiters[i]);
+        blob_conn *b = c != NULL ? (blob_conn *)(uintptr_t)c->user : NULL;
+        if (b != NULL && b->waiting && zc_inflight(&b->zq) > 0)
+            zc_reap(&b->zq, c->fd, &s->pool);
+    }
+
+    for (int i = 0; i < s->ndraining;)
+    {
+        conn_hot *c = conn_get(&s->conns, s->draining[i]);
+        blob_conn *b = (blob_conn *)(uintptr_t)c->user;
+        if (zc_drain(&b->zq, c->fd, &s->pool) > 0 && now < c->deadline_ns)
+        {
+            i++;
+            continue;
+        }
+        finish_close(s, c);
+        s->draining[i] = s->draining[--s->ndraining];
+    }
+}
+
+// 已关闭连接的累计值加上当前连接的值
+void dump_zerocopy(int fd)
+{
+    char line[256];
+    uint64_t zc = srv.zc_sends, copy = srv.copy_sends, copied = srv.copied;
+    for (int i = 0; i < srv.conns.capacity && srv.conns.count > 0; i++)
+    {
+        conn_hot *c = conn_get(&srv.conns, i);
+        if (c == NULL)
+            continue;
+        blob_conn *b = (blob_conn *)(uintptr_t)c->user;
+        zc += b->zq.zc_sends;
+        copy += b->zq.copy_sends;
+        copied += b->zq.copied;
+    }
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    int len = snprintf(line, sizeof(line),
+                       "zerocopy enabled=%d threshold=%zu zc_sends=%lu copy_sends=%lu kernel_copied=%lu "
+                       "pool_free=%d draining=%d lost=%lu cpu_user_ms=%ld cpu_sys_ms=%ld\n",
+                       srv.zerocopy, srv.threshold, zc, copy, copied, srv.pool.free_cnt, srv.ndraining, srv.lost,
+                       ru.ru_utime.tv_sec * 1000 + ru.ru_utime.tv_usec / 1000,
+                       ru.ru_stime.tv_sec * 1000 + ru.ru_stime.tv_usec / 1000);
+    write(fd, line, len);
+}
@@ -0,0 +1,60 @@
+/**
+ * 共享内存环的 echo 客户端，和 05-tcp-simple-echo/echo_client_fixed.c 的流程一样，
+ * 只是把 socket / connect / write / read / close 换成了 00-lib/shm_ring.h 里对应的 shm_connect / shm_write / shm_read / shm_close。
+ * 服务端必须在同一台机器上：./shm_echo_server 9190
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <unistd.h>
+#include "../00-lib/error.h"
+#include "../00-lib/shm_ring.h"
+
+#define BUF_SIZE 1024
+
+int main(int argc, char *argv[])
+{
+    shm_conn *conn;
+    char message[BUF_SIZE];
+    int str_len, recv_len, recv_cnt;
+
+    if (argc != 2)
+    {
+        printf("Usage: %s <server port>\n", argv[0]);
+        exit(1);
+    }
+
+    conn = shm_connect(atoi(argv[1]), 0);
+    if (conn == NULL)
+        error_handling("shm_connect() error");
+    else
+        puts("Connected.............");
+
+    while (1)
+    {
+        fputs("Input message(Q to quit): ", stdout);
+        if (fgets(message, BUF_SIZE, stdin) == NULL)
+            break;
+
+        if (!strcmp(message, "q\n") || !strcmp(message, "Q\n"))
+            break;
+
+        str_len = shm_write(conn, message, strlen(message));
+        if (str_len == -1)
+            error_handling("shm_write() error, server closed?");
+        recv_len = 0;
+        while (recv_len < str_len)
+        {
+            recv_cnt = shm_read(conn, &message[recv_len], BUF_SIZE - 1 - recv_len);
+            if (recv_cnt <= 0)
+                error_handling("shm_read() error, server closed?");
+
+            recv_len += recv_cnt;
+        }
+        message[str_len] = 0;
+        printf("Message from server: %s", message);
+    }
+
+    shm_close(conn);
+    return 0;
+}
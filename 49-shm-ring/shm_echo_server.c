@@ -0,0 +1,281 @@
+/**
+ * 通过共享内存环（00-lib/shm_ring.h）提供 echo 服务，给同一台机器上的客户端用。
+ *
+ * 控制连接在 UNIX 域套接字 /tmp/netsock-<port>.shm 上，客户端连上后把共享内存和 eventfd 发过来，
+ * 之后的数据完全在共享内存里交换：服务端直接从 c2s 环复制到 s2c 环，没有中间缓冲区，也没有系统调用。
+ *
+ * 事件循环和 44-io-multiplexing-epoll/epoll_server.c 的低延迟模式类似：
+ * - 每一轮把所有连接的 c2s 环都扫一遍，有数据就回写；
+ * - 连续 spin us 没有数据时才准备睡眠：在每个环上打上 reader_waiting 标记（回写被 s2c 写满卡住的连接
+ *   再打上 writer_waiting），然后再检查一遍，确实没事可做才阻塞在 epoll_wait 上，
+ *   epoll 同时监视监听套接字、每个连接的 eventfd（客户端看到标记时写它）和控制连接（客户端退出）。
+ * 服务端醒着的时候客户端写数据不需要任何系统调用。
+ *
+ *   ./shm_echo_server 9190 20 0    // 自旋 20 微秒再睡，绑在 CPU 0 上
+ *   ./shm_echo_client 9190
+ *   ../90-benchmark/pingpong_bench shm 9190
+ *
+ * 自旋要有空闲的 CPU 才有意义：客户端和服务端挤在同一个 CPU 上时，一方自旋只会推迟另一方运行，spin 应该设为 0。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <errno.h>
+#include "../00-lib/error.h"
+#include "../00-lib/loop_stats.h"
+#include "../00-lib/low_latency.h"
+#include "../00-lib/shm_ring.h"
+
+#define MAX_CONNS 64
+#define EPOLL_SIZE (MAX_CONNS * 2 + 1)
+
+// epoll 事件的 data.u64：低 32 位是连接下标，高位区分是 eventfd 还是控制连接
+#define EV_LISTEN UINT64_MAX
+#define EV_CTL (1ull << 32)
+
+static shm_conn *conns[MAX_CONNS];
+static int nconns;
+static uint64_t closed_notifies, sleeps;
+
+size_t echo_conn(shm_conn *c);
+int arm_all(void);
+void disarm_all(void);
+void close_conn(int epfd, int idx, loop_stats *ls);
+void dump_shm(int fd);
+
+int main(int argc, char *argv[])
+{
+    int spin_us = 0, cpu = -1;
+    struct epoll_event events[EPOLL_SIZE];
+    struct epoll_event event;
+
+    if (argc < 2 || argc > 4)
+    {
+        printf("Usage: %s <port> [spin us] [cpu]\n", argv[0]);
+        exit(1);
+    }
+    if (argc >= 3)
+        spin_us = atoi(argv[2]);
+    if (argc == 4)
+        cpu = atoi(argv[3]);
+    if (cpu >= 0 && ll_pin_to_cpu(cpu) == -1)
+        perror("sched_setaffinity() error");
+
+    char path[108];
+    shm_ring_path(path, sizeof(path), atoi(argv[1]));
+    int listen_sock = unix_listen(path, 16);
+    if (listen_sock == -1)
+        error_handling("unix_listen() error");
+
+    loop_stats *ls = loop_stats_register("shm");
+    loop_stats_set_dump_hook(dump_shm);
+
+    int epfd = epoll_create(EPOLL_SIZE);
+    event.events = EPOLLIN;
+    event.data.u64 = EV_LISTEN;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listen_sock, &event);
+
+    uint64_t spin_ns = (uint64_t)spin_us * 1000;
+    uint64_t last_data_ns = 0;
+
+    while (1)
+    {
+        size_t moved = 0;
+        for (int i = 0; i < nconns; i++)
+        {
+            moved += echo_conn(conns[i]);
+            // 客户端写坏了环的下标，不能再信任这块共享内存
+            if (conns[i]->corrupt)
+                close_conn(epfd, i--, ls);
+        }
+        if (moved > 0)
+        {
+            LS_ADD(ls, bytes_in, moved);
+            LS_ADD(ls, bytes_out, moved);
+            if (spin_ns > 0)
+                last_data_ns = ll_now_ns();
+            continue;
+        }
+        if (spin_ns > 0 && nconns > 0 && ll_now_ns() - last_data_ns < spin_ns)
+        {
+            shm_cpu_relax();
+            continue;
+        }
+
+        // 打标记之后有连接又有活干了，就不睡
+        if (arm_all())
+        {
+            disarm_all();
+            continue;
+        }
+        int n = epoll_wait(epfd, events, EPOLL_SIZE, -1);
+        disarm_all();
+        if (n == -1)
+        {
+            if (errno == EINTR) // 被 SIGUSR1 打断
+            {
+                loop_stats_poll();
+                continue;
+            }
+            perror("epoll_wait() error");
+            break;
+        }
+        loop_stats_wakeup(ls, n);
+        loop_stats_poll();
+        last_data_ns = ll_now_ns();
+
+        // 先处理 eventfd 和关闭，最后处理新连接。关闭连接会挪动下标，这一批剩下的旧下标就不可信了
+        for (int i = 0; i < n; i++)
+        {
+            uint64_t tag = events[i].data.u64;
+            if (tag == EV_LISTEN)
+                continue;
+            int idx = (int)(uint32_t)tag;
+            if (idx >= nconns)
+                continue;
+            if (tag & EV_CTL)
+            {
+                close_conn(epfd, idx, ls);
+                // 剩下的事件都是水平触发的，没处理的下一次 epoll_wait 还会返回；数据每一轮都会扫描，不依赖事件
+                break;
+            }
+            uint64_t cnt;
+            read(conns[idx]->wake_efd, &cnt, sizeof(cnt));
+            LS_INC(ls, syscalls);
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.u64 != EV_LISTEN)
+                continue;
+            int ctl = accept(listen_sock, NULL, NULL);
+            LS_INC(ls, syscalls);
+            if (ctl == -1)
+                continue;
+            shm_conn *c = nconns < MAX_CONNS ? shm_accept(ctl) : NULL;
+            if (c == NULL)
+            {
+                close(ctl);
+                continue;
+            }
+            conns[nconns] = c;
+            event.events = EPOLLIN;
+            event.data.u64 = nconns;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, c->wake_efd, &event);
+            event.data.u64 = EV_CTL | nconns;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, c->ctl, &event);
+            nconns++;
+            LS_ADD(ls, syscalls, 3);
+            LS_INC(ls, accepts);
+            LS_INC(ls, queue_depth);
+        }
+    }
+
+    close(listen_sock);
+    unlink(path);
+    return 0;
+}
+
+/**
+ * 把 c2s 环里的数据原样复制到 s2c 环，返回复制的字节数。
+ * s2c 写满时剩下的数据留在 c2s 里，等客户端读走回复再继续，客户端那边自然也就写不进新请求了。
+ * 每次最多复制一个环的量：客户端一边写一边读时这里可以一直有数据，不加限制其他连接就轮不到了。
+ */
+size_t echo_conn(shm_conn *c)
+{
+    size_t total = 0;
+    while (total < SHM_RING_SIZE)
+    {
+        uint32_t avail = shm_ring_readable(c);
+        if (avail == 0)
+            break;
+        uint64_t head = c->rx->head;
+        uint32_t off = head & (SHM_RING_SIZE - 1);
+        // 只取环尾部连续的一段，绕回的部分下一圈再处理
+        uint32_t len = avail < SHM_RING_SIZE - off ? avail : SHM_RING_SIZE - off;
+        if (len > SHM_RING_SIZE - total)
+            len = SHM_RING_SIZE - total;
+        size_t n = shm_try_write(c, c->rx->data + off, len);
+        if (n == 0)
+            break;
+        shm_rx_consume(c, head + n);
+        total += n;
+    }
+    return total;
+}
+
+/**
+ * 准备睡眠：给每个连接打上标记，返回 1 表示打完标记后发现还有连接可以继续处理。
+ * 回写没被卡住的连接只等数据（reader_waiting）；卡住的连接只等空间（writer_waiting），
+ * 不然客户端每读一次回复都要白白唤醒服务端一次。
+ */
+int arm_all(void)
+{
+    for (int i = 0; i < nconns; i++)
+    {
+        shm_conn *c = conns[i];
+        if (shm_ring_readable(c) > 0)
+            __atomic_store_n(&c->tx->writer_waiting, 1, __ATOMIC_RELAXED);
+        else
+            __atomic_store_n(&c->rx->reader_waiting, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (int i = 0; i < nconns; i++)
+    {
+        shm_conn *c = conns[i];
+        c->rx_tail = __atomic_load_n(&c->rx->tail, __ATOMIC_ACQUIRE);
+        c->tx_head = __atomic_load_n(&c->tx->head, __ATOMIC_ACQUIRE);
+        if (c->rx_tail != c->rx->head && c->tx->tail - c->tx_head < SHM_RING_SIZE)
+            return 1;
+    }
+    sleeps++;
+    return 0;
+}
+
+void disarm_all(void)
+{
+    for (int i = 0; i < nconns; i++)
+    {
+        __atomic_store_n(&conns[i]->rx->reader_waiting, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&conns[i]->tx->writer_waiting, 0, __ATOMIC_RELAXED);
+    }
+}
+
+// 关闭第 idx 个连接，把最后一个连接挪到这个位置，并更新它在 epoll 里的下标
+void close_conn(int epfd, int idx, loop_stats *ls)
+{
+    shm_conn *c = conns[idx];
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->wake_efd, NULL);
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->ctl, NULL);
+    closed_notifies += c->notifies;
+    shm_close(c);
+
+    conns[idx] = conns[--nconns];
+    if (idx < nconns)
+    {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = idx;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, conns[idx]->wake_efd, &event);
+        event.data.u64 = EV_CTL | idx;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, conns[idx]->ctl, &event);
+    }
+    LS_ADD(ls, syscalls, 4);
+    LS_INC(ls, closes);
+    LS_DEC(ls, queue_depth);
+}
+
+// SIGUSR1 时追加一行：服务端唤醒客户端的次数，以及服务端真正睡眠的次数
+void dump_shm(int fd)
+{
+    char line[128];
+    uint64_t notifies = closed_notifies;
+    for (int i = 0; i < nconns; i++)
+        notifies += conns[i]->notifies;
+    int len = snprintf(line, sizeof(line), "shm notifies=%lu sleeps=%lu conns=%d\n", notifies, sleeps, nconns);
+    write(fd, line, len);
+}
@@ -0,0 +1,81 @@
+/**
+ * 大块响应的吞吐测试，配合 48-zerocopy-send/blob_server：
+ * 在一个连接上反复请求 size 字节，读完整个响应再发下一个请求，输出每秒请求数、MB/s 和平均延迟。
+ *
+ * 零拷贝省下的是服务端的 CPU，单连接吞吐不一定变化，
+ * 对比时同时看服务端 kill -USR1 输出的 cpu_sys_ms 和 kernel_copied。
+ *
+ * server IP 写成 unix 时走端口对应的 UNIX 域套接字，用来对比 TCP 回环和 UNIX 域的吞吐。
+ *
+ * 用法：./blob_bench <server IP> <port> <size> [seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "../00-lib/error.h"
+#include "../00-lib/unix_sock.h"
+
+#define RECV_BUF (1024 * 1024)
+
+double now_sec(void);
+
+int main(int argc, char *argv[])
+{
+    int seconds = 5;
+
+    if (argc < 4 || argc > 5)
+    {
+        printf("Usage: %s <server IP> <port> <size> [seconds]\n", argv[0]);
+        exit(1);
+    }
+    uint32_t size = strtoul(argv[3], NULL, 10);
+    if (argc == 5)
+        seconds = atoi(argv[4]);
+    if (size == 0)
+        error_handling("invalid size");
+
+    int sock = stream_connect(argv[1], atoi(argv[2]));
+    if (sock == -1)
+        error_handling("connect() error");
+
+    char *buf = malloc(RECV_BUF);
+    uint32_t req = htonl(size);
+    uint64_t requests = 0, bytes = 0;
+    double start = now_sec(), end = start + seconds;
+
+    while (now_sec() < end)
+    {
+        if (write(sock, &req, sizeof(req)) != sizeof(req))
+            error_handling("write() error");
+        uint64_t got = 0;
+        while (got < size)
+        {
+            uint64_t want = size - got < RECV_BUF ? size - got : RECV_BUF;
+            int n = read(sock, buf, want);
+            if (n <= 0)
+                error_handling("read() error, server closed connection?");
+            got += n;
+        }
+        requests++;
+        bytes += got;
+    }
+    double elapsed = now_sec() - start;
+
+    printf("size=%u requests=%lu req_per_sec=%.0f mb_per_sec=%.1f avg_latency_us=%.1f\n",
+           size, requests, requests / elapsed, bytes / elapsed / 1e6, elapsed * 1e6 / requests);
+    close(sock);
+    return 0;
+}
+
+double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,219 @@
+/**
+ * 短连接压测：一个连接接一个连接地 connect、发一条消息读回显、close，越快越好，
+ * 每秒输出一次建立的连接数、失败次数和当前 TIME_WAIT 的个数（00-lib/proc_net.h），用来观察 22-time-wait 里讲的端口耗尽。
+ * 服务端随便用一个回声服务器，比如 44-io-multiplexing-epoll/epoll_server 或者 47-multiplexer-backends/mux_server。
+ *
+ * 主动关闭的一方进入 TIME_WAIT，这里是客户端先 close，所以 TIME_WAIT 都留在客户端这边，
+ * 每个占着一个 (源地址, 源端口, 目的地址, 目的端口) 四元组 60 秒；临时端口只有 ip_local_port_range 那么多（默认 28232 个），
+ * 每秒建几千个连接时几秒钟就能把端口用完。几个选项对应几种缓解办法：
+ * -s N  源地址在 127.0.0.1 ~ 127.0.0.N 之间轮换（只对回环地址有效，127.0.0.0/8 都是本机地址），
+ *       四元组的空间扩大 N 倍；需要先 bind 源地址
+ * -n    bind 源地址时设置 IP_BIND_ADDRESS_NO_PORT，推迟到 connect 时再选源端口。
+ *       不设置时 bind(端口 0) 就得当场选一个端口，只能按 (源地址, 源端口) 判断是否可用，不能和其他目的地址的连接共用端口，
+ *       也用不上 tcp_tw_reuse，端口会先于四元组被用完（bind 报 EADDRINUSE）
+ * -l    SO_LINGER {1, 0}：close 时直接发 RST，不经过四次挥手，也就没有 TIME_WAIT。
+ *       代价是发送缓冲区里还没发出去的数据会被丢掉，对端读到的是 ECONNRESET，只适合确定已经收完回复的场合
+ * -z    不收发数据，connect 成功后马上 close，只测建立和关闭连接本身
+ * 端口紧张时 Linux 往往不是直接报错，而是 connect / bind 在端口空间里线性查找空位，每个连接要花几毫秒，
+ * 表现为每秒连接数掉到几百；tcp_tw_reuse（回环上默认打开）允许 connect 复用时间戳足够旧的 TIME_WAIT 四元组，
+ * TIME_WAIT 总数还受 tcp_max_tw_buckets 限制，超过后新关闭的连接直接跳过 TIME_WAIT（内核日志里有 overflow 的警告）。
+ * 失败按 errno 分类统计：EADDRNOTAVAIL（connect 找不到可用的源端口）、EADDRINUSE（bind 时端口用完）、ECONNREFUSED（accept 队列满）等。
+ * 连续失败时每次等 1ms，不然端口用完之后会空转出几百万次失败。
+ *
+ * 用法：./churn_bench [-n] [-s sources] [-l] [-z] <server IP> <port> [seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "../00-lib/error.h"
+#include "../00-lib/proc_net.h"
+
+#define MSG_SIZE 16
+#define MAX_ERRNO 256
+
+static unsigned long errors[MAX_ERRNO];
+
+double now_sec(void);
+int churn_once(struct sockaddr_in *serv_addr, int source, int nsources, int no_port, int abortive, int zero);
+int read_sysctl(const char *path, char *buf, size_t len);
+
+int main(int argc, char *argv[])
+{
+    int opt, no_port = 0, nsources = 0, abortive = 0, zero = 0, seconds = 10;
+    struct sockaddr_in serv_addr;
+    char range[64] = "?", tw_reuse[16] = "?", tw_buckets[32] = "?";
+
+    while ((opt = getopt(argc, argv, "ns:lz")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            no_port = 1;
+            break;
+        case 's':
+            nsources = atoi(optarg);
+            break;
+        case 'l':
+            abortive = 1;
+            break;
+        case 'z':
+            zero = 1;
+            break;
+        default:
+            optind = argc; // 下面打印用法
+        }
+    }
+    if (argc - optind != 2 && argc - optind != 3)
+    {
+        printf("Usage: %s [-n] [-s sources] [-l] [-z] <server IP> <port> [seconds]\n", argv[0]);
+        exit(1);
+    }
+    if (argc - optind == 3)
+        seconds = atoi(argv[optind + 2]);
+    if (nsources < 0 || nsources > 254)
+        error_handling("sources must be 0..254");
+    if (no_port && nsources == 0)
+        nsources = 1; // IP_BIND_ADDRESS_NO_PORT 只在 bind 源地址时有意义
+
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = inet_addr(argv[optind]);
+    serv_addr.sin_port = htons(atoi(argv[optind + 1]));
+    int port = atoi(argv[optind + 1]);
+
+    read_sysctl("/proc/sys/net/ipv4/ip_local_port_range", range, sizeof(range));
+    read_sysctl("/proc/sys/net/ipv4/tcp_tw_reuse", tw_reuse, sizeof(tw_reuse));
+    read_sysctl("/proc/sys/net/ipv4/tcp_max_tw_buckets", tw_buckets, sizeof(tw_buckets));
+    printf("ip_local_port_range=%s tcp_tw_reuse=%s tcp_max_tw_buckets=%s sources=%d no_port=%d linger_abort=%d exchange=%d\n",
+           range, tw_reuse, tw_buckets, nsources, no_port, abortive, !zero);
+    int tw_start = proc_net_count(port, TCP_STATE_TIME_WAIT);
+
+    unsigned long total = 0, failed = 0, sec_ok = 0, sec_failed = 0;
+    int tw_peak = tw_start, source = 0;
+    double start = now_sec(), next_report = start + 1, end = start + seconds;
+    while (1)
+    {
+        double now = now_sec();
+        if (now >= next_report)
+        {
+            int tw = proc_net_count(port, TCP_STATE_TIME_WAIT);
+            if (tw > tw_peak)
+                tw_peak = tw;
+            printf("t=%2.0fs conn_per_sec=%lu failed=%lu time_wait=%d\n", next_report - start, sec_ok, sec_failed, tw);
+            sec_ok = sec_failed = 0;
+            next_report += 1;
+        }
+        if (now >= end)
+            break;
+
+        if (churn_once(&serv_addr, source, nsources, no_port, abortive, zero) == 0)
+        {
+            total++;
+            sec_ok++;
+        }
+        else
+        {
+            failed++;
+            sec_failed++;
+            usleep(1000);
+        }
+        if (nsources > 0)
+            source = (source + 1) % nsources;
+    }
+    double elapsed = now_sec() - start;
+
+    printf("connections=%lu conn_per_sec=%.0f failed=%lu time_wait_start=%d time_wait_peak=%d\n",
+           total, total / elapsed, failed, tw_start, tw_peak);
+    for (int i = 0; i < MAX_ERRNO; i++)
+        if (errors[i] > 0)
+            printf("  %lu x %s\n", errors[i], strerror(i));
+    return 0;
+}
+
+// 一次完整的短连接，成功返回 0，失败时按 errno 记一笔并返回 -1
+int churn_once(struct sockaddr_in *serv_addr, int source, int nsources, int no_port, int abortive, int zero)
+{
+    char msg[MSG_SIZE], buf[MSG_SIZE];
+    int sock = socket(PF_INET, SOCK_STREAM, 0);
+    if (sock == -1)
+        goto fail;
+
+    if (nsources > 0)
+    {
+        struct sockaddr_in src_addr;
+        memset(&src_addr, 0, sizeof(src_addr));
+        src_addr.sin_family = AF_INET;
+        src_addr.sin_addr.s_addr = htonl((127u << 24) | (source + 1));
+        int option = 1;
+        if (no_port)
+            setsockopt(sock, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &option, sizeof(option));
+        if (bind(sock, (struct sockaddr *)&src_addr, sizeof(src_addr)) == -1)
+            goto fail;
+    }
+    if (connect(sock, (struct sockaddr *)serv_addr, sizeof(*serv_addr)) == -1)
+        goto fail;
+
+    if (!zero)
+    {
+        memset(msg, 'x', MSG_SIZE);
+        int got = 0;
+        if (write(sock, msg, MSG_SIZE) != MSG_SIZE)
+            goto fail;
+        while (got < MSG_SIZE)
+        {
+            int n = read(sock, buf + got, MSG_SIZE - got);
+            if (n <= 0)
+            {
+                if (n == 0)
+                    errno = ECONNRESET;
+                goto fail;
+            }
+            got += n;
+        }
+    }
+
+    if (abortive)
+    {
+        struct linger lg = {1, 0};
+        setsockopt(sock, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    }
+    close(sock);
+    return 0;
+
+fail:
+    if (errno > 0 && errno < MAX_ERRNO)
+        errors[errno]++;
+    if (sock != -1)
+        close(sock);
+    return -1;
+}
+
+// 读一个 sysctl 的值，去掉换行，把制表符换成 '-'
+int read_sysctl(const char *path, char *buf, size_t len)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return -1;
+    if (fgets(buf, len, fp) == NULL)
+        buf[0] = 0;
+    fclose(fp);
+    for (char *p = buf; *p; p++)
+        if (*p == '\n')
+            *p = 0;
+        else if (*p == '\t' || *p == ' ')
+            *p = '-';
+    return 0;
+}
+
+double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
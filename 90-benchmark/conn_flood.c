@@ -0,0 +1,144 @@
+/**
+ * 大量并发连接的压测客户端：先建立 N 个长连接，然后每一轮随机挑 batch 个连接，
+ * 先全部发出一条消息，再逐个读回显。这样服务端的一次唤醒里会有很多分散在连接表各处的就绪 fd，
+ * 用来观察连接表的 cache 行为（配合 47-multiplexer-backends/mux_server -c）。
+ *
+ * 单个源地址最多只有三万来个临时端口（net.ipv4.ip_local_port_range），
+ * 目标是回环地址时，每 CONN_PER_SRC 个连接换一个 127.0.x.1 的源地址，这样可以建立 10 万以上的连接。
+ * 注意进程的 RLIMIT_NOFILE 也要足够大（ulimit -n），程序会尝试把软限制提到硬限制。
+ *
+ * 用法：./conn_flood <server IP> <port> <connections> [seconds] [batch]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include "../00-lib/error.h"
+
+#define MSG_SIZE 16
+#define CONN_PER_SRC 20000
+
+double now_sec(void);
+int read_full(int fd, char *buf, int len);
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in serv_addr, src_addr;
+    int nconn, seconds = 10, batch = 64;
+    char msg[MSG_SIZE], buf[MSG_SIZE];
+
+    if (argc < 4 || argc > 6)
+    {
+        printf("Usage: %s <server IP> <port> <connections> [seconds] [batch]\n", argv[0]);
+        exit(1);
+    }
+    nconn = atoi(argv[3]);
+    if (argc >= 5)
+        seconds = atoi(argv[4]);
+    if (argc == 6)
+        batch = atoi(argv[5]);
+    if (batch > nconn)
+        batch = nconn;
+
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = inet_addr(argv[1]);
+    serv_addr.sin_port = htons(atoi(argv[2]));
+    int loopback = (ntohl(serv_addr.sin_addr.s_addr) >> 24) == 127;
+
+    int *socks = malloc(sizeof(int) * nconn);
+    double start = now_sec();
+    for (int i = 0; i < nconn; i++)
+    {
+        socks[i] = socket(PF_INET, SOCK_STREAM, 0);
+        if (socks[i] == -1)
+        {
+            printf("socket() failed after %d connections (raise ulimit -n)\n", i);
+            nconn = i;
+            break;
+        }
+        if (loopback)
+        {
+            memset(&src_addr, 0, sizeof(src_addr));
+            src_addr.sin_family = AF_INET;
+            src_addr.sin_addr.s_addr = htonl((127u << 24) | ((i / CONN_PER_SRC) << 8) | 1);
+            // 推迟到 connect 时再分配源端口，内核才能按四元组判断端口是否可用，而不是按 bind 的二元组
+            int option = 1;
+            setsockopt(socks[i], IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &option, sizeof(option));
+            bind(socks[i], (struct sockaddr *)&src_addr, sizeof(src_addr));
+        }
+        if (connect(socks[i], (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
+        {
+            printf("connect() failed after %d connections\n", i);
+            close(socks[i]);
+            nconn = i;
+            break;
+        }
+    }
+    if (nconn == 0)
+        error_handling("no connection established");
+    printf("%d connections established in %.2f s\n", nconn, now_sec() - start);
+
+    memset(msg, 'x', MSG_SIZE);
+    int *picked = malloc(sizeof(int) * batch);
+    unsigned long msgs = 0, rounds = 0;
+    srand(time(NULL));
+
+    start = now_sec();
+    double end = start + seconds;
+    while (now_sec() < end)
+    {
+        // 先把一批消息都发出去，服务端一次唤醒就能拿到一批就绪 fd
+        for (int i = 0; i < batch; i++)
+        {
+            picked[i] = socks[rand() % nconn];
+            write(picked[i], msg, MSG_SIZE);
+        }
+        for (int i = 0; i < batch; i++)
+        {
+            if (read_full(picked[i], buf, MSG_SIZE) != MSG_SIZE)
+                error_handling("read() error, server closed connection?");
+        }
+        msgs += batch;
+        rounds++;
+    }
+    double elapsed = now_sec() - start;
+
+    printf("connections=%d batch=%d rounds=%lu msgs=%lu msgs_per_sec=%.0f\n",
+           nconn, batch, rounds, msgs, msgs / elapsed);
+
+    for (int i = 0; i < nconn; i++)
+        close(socks[i]);
+    return 0;
+}
+
+double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 同一个连接上可能同时有多个同批次的消息，回显可能被拆开，要读满 len 字节
+int read_full(int fd, char *buf, int len)
+{
+    int got = 0;
+    while (got < len)
+    {
+        int n = read(fd, buf + got, len - got);
+        if (n <= 0)
+            return got;
+        got += n;
+    }
+    return got;
+}
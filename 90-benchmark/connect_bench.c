@@ -0,0 +1,125 @@
+/**
+ * connect 延迟测试：对同一组候选地址，比较
+ * - single：只对第一个候选做阻塞 connect（原来各个客户端 inet_addr(argv[1]) + connect 的做法）；
+ * - race：用 00-lib/race_connect.h 对所有候选错开发起非阻塞 connect，取最先完成的。
+ * 每种方式连 count 次，输出 p50/p99/max 建立连接的耗时，race 还会统计每个地址胜出的次数。
+ * 第一个候选是慢副本（见 slow_listener.c）时，single 的尾延迟是 SYN 重传的秒级，race 大约是一个 stagger。
+ *
+ * 用法：./connect_bench <candidates> <port> [count] [stagger ms]
+ * candidates 的格式见 race_connect.h，比如 localhost 或 127.0.0.1:9191,[::1]:9190；没写端口的项用 port。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../00-lib/error.h"
+#include "../00-lib/race_connect.h"
+
+#define MAX_WINNERS 8
+
+typedef struct
+{
+    char addr[64];
+    int wins;
+} winner_count;
+
+int cmp_double(const void *a, const void *b);
+void report(const char *mode, double *ms, int count, int failures);
+double now_ms(void);
+
+int main(int argc, char *argv[])
+{
+    int count = 20, stagger_ms = 50;
+    winner_count winners[MAX_WINNERS];
+    int nwinners = 0;
+
+    if (argc < 3 || argc > 5)
+    {
+        printf("Usage: %s <candidates> <port> [count] [stagger ms]\n", argv[0]);
+        exit(1);
+    }
+    int port = atoi(argv[2]);
+    if (argc >= 4)
+        count = atoi(argv[3]);
+    if (argc == 5)
+        stagger_ms = atoi(argv[4]);
+
+    race_candidate cands[RACE_MAX];
+    if (race_resolve(argv[1], port, cands, RACE_MAX) == 0)
+        error_handling("no usable candidate address");
+
+    double *ms = malloc(sizeof(double) * count);
+
+    // 阻塞 connect 第一个候选
+    int failures = 0, n = 0;
+    for (int i = 0; i < count; i++)
+    {
+        double start = now_ms();
+        int sock = socket(cands[0].addr.ss_family, SOCK_STREAM, 0);
+        if (connect(sock, (struct sockaddr *)&cands[0].addr, cands[0].addrlen) == -1)
+            failures++;
+        else
+            ms[n++] = now_ms() - start;
+        close(sock);
+    }
+    report("single", ms, n, failures);
+
+    failures = n = 0;
+    for (int i = 0; i < count; i++)
+    {
+        char winner[64];
+        double start = now_ms();
+        int sock = race_connect(argv[1], port, stagger_ms, 0, winner, sizeof(winner));
+        if (sock == -1)
+        {
+            failures++;
+            continue;
+        }
+        ms[n++] = now_ms() - start;
+        close(sock);
+
+        int w = 0;
+        while (w < nwinners && strcmp(winners[w].addr, winner) != 0)
+            w++;
+        if (w == nwinners && nwinners < MAX_WINNERS)
+        {
+            strcpy(winners[nwinners].addr, winner);
+            winners[nwinners++].wins = 0;
+        }
+        if (w < nwinners)
+            winners[w].wins++;
+    }
+    report("race", ms, n, failures);
+    for (int w = 0; w < nwinners; w++)
+        printf("winner=%s wins=%d\n", winners[w].addr, winners[w].wins);
+
+    free(ms);
+    return 0;
+}
+
+int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+void report(const char *mode, double *ms, int count, int failures)
+{
+    if (count == 0)
+    {
+        printf("mode=%s connects=0 failures=%d\n", mode, failures);
+        return;
+    }
+    qsort(ms, count, sizeof(double), cmp_double);
+    int p99 = (int)(count * 0.99);
+    printf("mode=%s connects=%d failures=%d p50_ms=%.2f p99_ms=%.2f max_ms=%.2f\n",
+           mode, count, failures, ms[count / 2], ms[p99 < count ? p99 : count - 1], ms[count - 1]);
+}
+
+double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
@@ -0,0 +1,111 @@
+/**
+ * 短行回声的吞吐：一个线程不停地发 lines 行（每行 line len 字节，含换行符），主线程读回显并数换行符，
+ * 全部收回来后输出 lines/s。用来比较 09-std-io-func 里的两个服务端：
+ *   ./std_io_server 9190 &        // fdopen + fgets / fputs / fflush，每行一次 write
+ *   ./stream_io_server 9191 &     // 00-lib/sock_stream.h，一批行一次 write
+ *   ./line_bench 127.0.0.1 9190 && ./line_bench 127.0.0.1 9191
+ *
+ * 发送方一次写 BATCH 行，不等回显，客户端和服务端之间始终有足够多的行在路上，测到的是服务端处理行的能力。
+ *
+ * 用法：./line_bench <server IP> <port> [lines] [line len]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "../00-lib/error.h"
+#include "../00-lib/unix_sock.h"
+
+#define BATCH 256
+#define MAX_LINE 1024
+
+typedef struct
+{
+    int sock;
+    long lines;
+    int line_len;
+} sender_arg;
+
+void *sender_run(void *arg);
+double now_sec(void);
+
+int main(int argc, char *argv[])
+{
+    long lines = 1000000;
+    int line_len = 16;
+    char buf[64 * 1024];
+
+    if (argc < 3 || argc > 5)
+    {
+        printf("Usage: %s <server IP> <port> [lines] [line len]\n", argv[0]);
+        exit(1);
+    }
+    if (argc >= 4)
+        lines = atol(argv[3]);
+    if (argc == 5)
+        line_len = atoi(argv[4]);
+    if (line_len < 1 || line_len > MAX_LINE)
+        error_handling("invalid line length");
+
+    int sock = stream_connect(argv[1], atoi(argv[2]));
+    if (sock == -1)
+        error_handling("connect() error");
+
+    sender_arg arg = {sock, lines, line_len};
+    pthread_t tid;
+    double start = now_sec();
+    pthread_create(&tid, NULL, sender_run, &arg);
+
+    long received = 0;
+    while (received < lines)
+    {
+        ssize_t n = read(sock, buf, sizeof(buf));
+        if (n <= 0)
+            error_handling("read() error, server closed connection?");
+        for (char *p = buf; (p = memchr(p, '\n', buf + n - p)) != NULL; p++)
+            received++;
+    }
+    double elapsed = now_sec() - start;
+    pthread_join(tid, NULL);
+
+    printf("lines=%ld line_len=%d lines_per_sec=%.0f MB_per_sec=%.1f\n",
+           lines, line_len, lines / elapsed, lines * (double)line_len / elapsed / 1e6);
+    close(sock);
+    return 0;
+}
+
+void *sender_run(void *arg)
+{
+    sender_arg *s = arg;
+    char *chunk = malloc((size_t)BATCH * s->line_len);
+    for (int i = 0; i < BATCH; i++)
+    {
+        memset(chunk + (size_t)i * s->line_len, 'a' + i % 26, s->line_len - 1);
+        chunk[(size_t)(i + 1) * s->line_len - 1] = '\n';
+    }
+
+    for (long sent = 0; sent < s->lines; sent += BATCH)
+    {
+        long n = s->lines - sent < BATCH ? s->lines - sent : BATCH;
+        size_t len = n * s->line_len, done = 0;
+        while (done < len)
+        {
+            ssize_t w = write(s->sock, chunk + done, len - done);
+            if (w <= 0)
+                error_handling("write() error");
+            done += w;
+        }
+    }
+    free(chunk);
+    return NULL;
+}
+
+double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,83 @@
+/**
+ * 00-lib/lz_fast.h 的压缩率和速度：把文件按块（默认 256KB，和 file_xfer 的块大小一样）压缩再解压，
+ * 输出压缩率、压缩和解压的 MB/s（按压缩前的字节数算），并检查解压结果和原文一致。
+ * 解压到同一块缓冲区里（和传输时一样，一块一块地处理），逐块和原文比较，比较的时间不计入。
+ * 和 file-client 的 lz 模式对照着看：压缩速度低于网络带宽时压缩反而会拖慢传输。
+ *
+ * 用法：./lz_bench <file> [chunk KB]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../00-lib/error.h"
+#include "../00-lib/lz_fast.h"
+
+double now_sec(void);
+
+int main(int argc, char *argv[])
+{
+    struct stat st;
+    if (argc != 2 && argc != 3)
+    {
+        printf("Usage: %s <file> [chunk KB]\n", argv[0]);
+        exit(1);
+    }
+    int chunk = (argc == 3 ? atoi(argv[2]) : 256) * 1024;
+    int fd = open(argv[1], O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1 || chunk <= 0)
+        error_handling("open() error");
+
+    size_t size = st.st_size, nchunks = (size + chunk - 1) / chunk;
+    char *raw = malloc(size + 1), *out = malloc(chunk);
+    char *comp = malloc(nchunks * lz_compress_bound(chunk) + 1);
+    int *clen = malloc(sizeof(int) * (nchunks + 1));
+    if (raw == NULL || out == NULL || comp == NULL || clen == NULL)
+        error_handling("malloc() error");
+    // 先把输出缓冲区都碰一遍，缺页的开销不要算进压缩 / 解压里
+    memset(out, 0, chunk);
+    memset(comp, 0, nchunks * lz_compress_bound(chunk) + 1);
+    for (size_t done = 0; done < size;)
+    {
+        ssize_t n = read(fd, raw + done, size - done);
+        if (n <= 0)
+            error_handling("read() error");
+        done += n;
+    }
+
+    size_t csize = 0;
+    double start = now_sec();
+    for (size_t i = 0; i < nchunks; i++)
+    {
+        int len = size - i * chunk < (size_t)chunk ? (int)(size - i * chunk) : chunk;
+        clen[i] = lz_compress(raw + i * chunk, len, comp + i * lz_compress_bound(chunk), lz_compress_bound(chunk));
+        csize += clen[i];
+    }
+    double compress_sec = now_sec() - start;
+
+    double decompress_sec = 0;
+    for (size_t i = 0; i < nchunks; i++)
+    {
+        int len = size - i * chunk < (size_t)chunk ? (int)(size - i * chunk) : chunk;
+        start = now_sec();
+        int n = lz_decompress(comp + i * lz_compress_bound(chunk), clen[i], out, len);
+        decompress_sec += now_sec() - start;
+        if (n != len || memcmp(raw + i * chunk, out, len) != 0)
+            error_handling("round trip mismatch");
+    }
+
+    printf("size=%zu compressed=%zu ratio=%.2f compress_MB_per_sec=%.0f decompress_MB_per_sec=%.0f\n",
+           size, csize, csize > 0 ? (double)size / csize : 0.0, size / compress_sec / 1e6, size / decompress_sec / 1e6);
+    return 0;
+}
+
+double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,276 @@
+/**
+ * 开环过载测试：按固定的平均速率（泊松到达）发起请求，不管服务端有没有处理完前面的请求，
+ * 用来看服务端在过载时的有效吞吐（goodput）和延迟，配合 46-multi-thread/thread_pool.c 的过载控制使用。
+ *
+ * 闭环的压测（pingpong_bench 这类，收到回复才发下一个）在服务端变慢时自己也会变慢，永远测不出过载，
+ * 真实的客户端是各自独立到达的，服务端慢了也不会少来。每个请求：
+ *   connect，发 16 字节，收到回显的时间减去开始时间就是响应延迟，之后再占着连接 hold 毫秒才关闭，
+ *   模拟服务端要花这么久处理一个请求（thread_pool 的 worker 在连接关闭前一直被占着），
+ *   所以服务端的处理能力大约是 最大线程数 / hold，比如 8 个线程、hold 50ms 时每秒 160 个，每秒发 320 个就是 2 倍过载。
+ * 结果按响应分类：
+ * - good     : 在 deadline 毫秒内收到回显，只有这部分算有效吞吐
+ * - late     : 收到了回显但超过 deadline，客户端已经不要了，服务端的工作白做
+ * - rejected : 被服务端拒绝（RST 或者连接被关闭），这是快速失败，客户端可以马上重试别处
+ * - timeout  : 超过 10 倍 deadline 还没有结果，测试端主动放弃
+ * 每秒输出一行，最后输出总的有效吞吐和 good 请求的延迟分位数。
+ *
+ * 用法：./overload_bench <server IP> <port> <requests per sec> [seconds] [hold ms] [deadline ms]
+ * 到达间隔要用 log 生成，编译时加 -lm。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include "../00-lib/error.h"
+
+#define MSG_SIZE 16
+#define MAX_EVENTS 256
+
+enum req_state
+{
+    REQ_FREE,
+    REQ_CONNECTING,
+    REQ_WAITING, // 已经发出请求，等回显
+    REQ_HOLDING, // 收到回显，占着连接模拟处理时间
+};
+
+typedef struct
+{
+    int state;
+    double start;
+    double close_at; // REQ_HOLDING 时到这个时间关闭
+} request;
+
+enum result
+{
+    RES_GOOD,
+    RES_LATE,
+    RES_REJECTED,
+    RES_TIMEOUT,
+    RES_COUNT,
+};
+
+static request *reqs;
+static int max_fd;
+static int fd_high; // 用过的最大 fd + 1，扫描请求表时只扫到这里
+static double hold_sec;
+static int epfd;
+static int pending; // 还没有结果的请求数
+static unsigned long sec_counts[RES_COUNT], total_counts[RES_COUNT];
+static double *latencies; // good 请求的响应延迟，毫秒
+static unsigned long nlat, lat_cap;
+
+double now_sec(void);
+int launch(struct sockaddr_in *serv_addr, double now);
+void finish(int fd, int result);
+void handle_event(int fd, double now, double deadline);
+int compare_double(const void *a, const void *b);
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in serv_addr;
+    struct epoll_event events[MAX_EVENTS];
+    struct rlimit rl;
+    int seconds = 10;
+    double deadline = 0.1;
+
+    if (argc < 4 || argc > 7)
+    {
+        printf("Usage: %s <server IP> <port> <requests per sec> [seconds] [hold ms] [deadline ms]\n", argv[0]);
+        exit(1);
+    }
+    double rate = atof(argv[3]);
+    hold_sec = 0.05;
+    if (argc >= 5)
+        seconds = atoi(argv[4]);
+    if (argc >= 6)
+        hold_sec = atof(argv[5]) / 1000;
+    if (argc == 7)
+        deadline = atof(argv[6]) / 1000;
+    if (rate <= 0)
+        error_handling("rate must be positive");
+
+    // 过载时同时挂着的连接很多，把 fd 上限提到硬限制
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    max_fd = rl.rlim_cur > 1 << 20 ? 1 << 20 : rl.rlim_cur;
+    reqs = calloc(max_fd, sizeof(request));
+    lat_cap = rate * seconds + 1024;
+    latencies = malloc(sizeof(double) * lat_cap);
+    epfd = epoll_create1(0);
+
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = inet_addr(argv[1]);
+    serv_addr.sin_port = htons(atoi(argv[2]));
+    printf("rate=%.0f seconds=%d hold_ms=%.0f deadline_ms=%.0f\n", rate, seconds, hold_sec * 1000, deadline * 1000);
+
+    unsigned long offered = 0, sec_offered = 0, launch_failed = 0;
+    double start = now_sec(), end = start + seconds, next_report = start + 1, next_sweep = start + 0.1;
+    double next_arrival = start;
+    srand48(start * 1e6);
+    // 发完之后再等最慢的请求出结果
+    double drain_end = end + deadline * 10 + 1;
+
+    while (1)
+    {
+        double now = now_sec();
+        while (now >= next_arrival && next_arrival < end)
+        {
+            offered++;
+            sec_offered++;
+            if (launch(&serv_addr, next_arrival) == -1)
+                launch_failed++;
+            // 泊松到达：间隔服从指数分布
+            next_arrival += -log(1 - drand48()) / rate;
+        }
+
+        if (now >= next_report)
+        {
+            printf("t=%2.0fs offered=%lu good=%lu late=%lu rejected=%lu timeout=%lu pending=%d\n", next_report - start,
+                   sec_offered, sec_counts[RES_GOOD], sec_counts[RES_LATE], sec_counts[RES_REJECTED],
+                   sec_counts[RES_TIMEOUT], pending);
+            sec_offered = 0;
+            memset(sec_counts, 0, sizeof(sec_counts));
+            next_report += 1;
+        }
+        if (now >= next_sweep)
+        {
+            // 到时间的 hold 连接关闭，等太久的请求放弃
+            for (int fd = 0; fd < fd_high; fd++)
+            {
+                request *r = &reqs[fd];
+                if (r->state == REQ_HOLDING && now >= r->close_at)
+                {
+                    close(fd);
+                    r->state = REQ_FREE;
+                }
+                else if ((r->state == REQ_CONNECTING || r->state == REQ_WAITING) && now - r->start > deadline * 10)
+                    finish(fd, RES_TIMEOUT);
+            }
+            next_sweep = now + 0.005;
+        }
+        if (now >= end && (pending == 0 || now >= drain_end))
+            break;
+
+        int n = epoll_wait(epfd, events, MAX_EVENTS, 1);
+        now = now_sec();
+        for (int i = 0; i < n; i++)
+            handle_event(events[i].data.fd, now, deadline);
+    }
+
+    qsort(latencies, nlat, sizeof(double), compare_double);
+    double elapsed = seconds;
+    printf("offered=%lu offered_per_sec=%.0f goodput_per_sec=%.1f good=%lu late=%lu rejected=%lu timeout=%lu "
+           "launch_failed=%lu\n",
+           offered, offered / elapsed, total_counts[RES_GOOD] / elapsed, total_counts[RES_GOOD], total_counts[RES_LATE],
+           total_counts[RES_REJECTED], total_counts[RES_TIMEOUT], launch_failed);
+    if (nlat > 0)
+        printf("good_latency_ms p50=%.1f p90=%.1f p99=%.1f max=%.1f\n", latencies[nlat / 2], latencies[nlat * 9 / 10],
+               latencies[nlat * 99 / 100], latencies[nlat - 1]);
+    return 0;
+}
+
+// 发起一个请求，start 是计划的到达时间（测试端自己来不及时，排在后面的请求也按计划时间算延迟）
+int launch(struct sockaddr_in *serv_addr, double start)
+{
+    struct epoll_event event;
+    int sock = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (sock == -1)
+        return -1;
+    if (sock >= max_fd || (connect(sock, (struct sockaddr *)serv_addr, sizeof(*serv_addr)) == -1 && errno != EINPROGRESS))
+    {
+        close(sock);
+        return -1;
+    }
+    if (sock >= fd_high)
+        fd_high = sock + 1;
+    reqs[sock].state = REQ_CONNECTING;
+    reqs[sock].start = start;
+    event.events = EPOLLOUT;
+    event.data.fd = sock;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &event);
+    pending++;
+    return 0;
+}
+
+// 请求有了结果；good / late 的连接转入 hold，其他的直接关闭
+void finish(int fd, int result)
+{
+    request *r = &reqs[fd];
+    sec_counts[result]++;
+    total_counts[result]++;
+    pending--;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    if (result == RES_GOOD || result == RES_LATE)
+        r->state = REQ_HOLDING;
+    else
+    {
+        close(fd);
+        r->state = REQ_FREE;
+    }
+}
+
+void handle_event(int fd, double now, double deadline)
+{
+    request *r = &reqs[fd];
+    char buf[MSG_SIZE];
+
+    if (r->state == REQ_CONNECTING)
+    {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        memset(buf, 'x', MSG_SIZE);
+        if (err != 0 || write(fd, buf, MSG_SIZE) != MSG_SIZE)
+        {
+            finish(fd, RES_REJECTED);
+            return;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &event);
+        r->state = REQ_WAITING;
+    }
+    else if (r->state == REQ_WAITING)
+    {
+        int n = read(fd, buf, MSG_SIZE);
+        if (n == -1 && errno == EAGAIN)
+            return;
+        if (n <= 0) // RST 或者被关闭
+        {
+            finish(fd, RES_REJECTED);
+            return;
+        }
+        // 回显只有 16 字节，一次就能读完
+        double latency = now - r->start;
+        if (latency <= deadline && nlat < lat_cap)
+            latencies[nlat++] = latency * 1000;
+        r->close_at = now + hold_sec;
+        finish(fd, latency <= deadline ? RES_GOOD : RES_LATE);
+    }
+}
+
+int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
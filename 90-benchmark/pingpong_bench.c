@@ -0,0 +1,217 @@
+/**
+ * 单连接 ping-pong 延迟测试：发一条消息，等回显读满后再发下一条，记录每一次的往返时间，
+ * 最后排序输出 p50/p90/p99/p999/max。
+ *
+ * 同一时刻只有一条消息在路上，测到的就是 “一次唤醒 + 一次处理” 的延迟，不受吞吐影响。
+ * 同时用 TCP_INFO 的 tcpi_data_segs_in 统计每条回复平均分成了几个数据段，
+ * 用来观察服务端的发送策略（Nagle、TCP_CORK、MSG_MORE，见 47-multiplexer-backends/mux_server -s）。
+ * 给出第二个端口时，会交替对两个服务端各测一轮（减少机器负载变化带来的偏差），并输出 p99 的差值，例如：
+ *   ./epoll_server 9190 &              // 普通模式
+ *   ./epoll_server 9191 50 0 &         // 自旋 50 微秒 + 绑核
+ *   ./pingpong_bench 127.0.0.1 9190 9191 100000
+ *
+ * server IP 写成 unix 时走端口对应的 UNIX 域套接字（00-lib/unix_sock.h），用来对比 TCP 回环和 UNIX 域的延迟：
+ *   ./pingpong_bench 127.0.0.1 9190 0 100000      和      ./pingpong_bench unix 9190 0 100000
+ *
+ * server IP 写成 shm 时走共享内存环（00-lib/shm_ring.h，服务端是 49-shm-ring/shm_echo_server），
+ * 机器有多个 CPU 时客户端读回复前先自旋 SHM_SPIN_US 微秒，只有一个 CPU 时不自旋：
+ *   ./shm_echo_server 9190 20 &
+ *   ./pingpong_bench shm 9190 0 100000
+ *
+ * 用法：./pingpong_bench <server IP> <port> [port2] [count] [msg size]
+ * 只测一个服务端但要指定 count 时，port2 写 0。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+// 要用新版的 struct tcp_info 字段，用内核头文件代替 netinet/tcp.h（两者不能同时包含）
+#include <linux/tcp.h>
+#include "../00-lib/error.h"
+#include "../00-lib/unix_sock.h"
+#include "../00-lib/shm_ring.h"
+
+#define MAX_MSG 4096
+#define ROUNDS 10
+#define WARMUP 1000
+#define SHM_SPIN_US 50
+
+typedef struct
+{
+    int sock;
+    shm_conn *shm; // 走共享内存环时非空，sock 为 -1
+    int port;
+    double *rtt_us;
+    int count;
+    uint64_t segs; // 测量期间收到的数据段数
+} target;
+
+void connect_to(target *t, const char *ip);
+ssize_t target_write(target *t, const void *buf, size_t len);
+ssize_t target_read(target *t, void *buf, size_t len);
+uint32_t data_segs_in(int sock);
+void run_round(target *t, int n, int msg_size);
+int cmp_double(const void *a, const void *b);
+double percentile(const double *sorted, int count, double p);
+void report(target *t);
+double now_us(void);
+
+int main(int argc, char *argv[])
+{
+    int ntargets = 1, count = 100000, msg_size = 16;
+    target targets[2];
+
+    if (argc < 3 || argc > 6)
+    {
+        printf("Usage: %s <server IP> <port> [port2] [count] [msg size]\n", argv[0]);
+        exit(1);
+    }
+    targets[0].port = atoi(argv[2]);
+    if (argc >= 4 && atoi(argv[3]) > 0)
+    {
+        targets[1].port = atoi(argv[3]);
+        ntargets = 2;
+    }
+    if (argc >= 5)
+        count = atoi(argv[4]);
+    if (argc == 6)
+        msg_size = atoi(argv[5]);
+    if (msg_size <= 0 || msg_size > MAX_MSG || count < ROUNDS)
+        error_handling("invalid count or message size");
+
+    for (int t = 0; t < ntargets; t++)
+    {
+        connect_to(&targets[t], argv[1]);
+        targets[t].rtt_us = malloc(sizeof(double) * (count > WARMUP ? count : WARMUP));
+        targets[t].count = 0;
+        // 先预热，让连接、cache 和 CPU 频率都进入稳定状态
+        run_round(&targets[t], WARMUP, msg_size);
+        targets[t].count = 0;
+        targets[t].segs = 0;
+    }
+
+    // 分成若干轮交替测量
+    for (int r = 0; r < ROUNDS; r++)
+        for (int t = 0; t < ntargets; t++)
+            run_round(&targets[t], count / ROUNDS, msg_size);
+
+    for (int t = 0; t < ntargets; t++)
+        report(&targets[t]);
+
+    if (ntargets == 2)
+    {
+        double p99_a = percentile(targets[0].rtt_us, targets[0].count, 0.99);
+        double p99_b = percentile(targets[1].rtt_us, targets[1].count, 0.99);
+        printf("p99_diff_us=%.1f (port %d - port %d)\n", p99_a - p99_b, targets[0].port, targets[1].port);
+    }
+
+    for (int t = 0; t < ntargets; t++)
+    {
+        if (targets[t].shm != NULL)
+            shm_close(targets[t].shm);
+        else
+            close(targets[t].sock);
+    }
+    return 0;
+}
+
+void connect_to(target *t, const char *ip)
+{
+    t->sock = -1;
+    t->shm = NULL;
+    if (strcmp(ip, "shm") == 0)
+    {
+        // 只有一个 CPU 时客户端自旋只会挡住服务端运行
+        t->shm = shm_connect(t->port, sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SHM_SPIN_US : 0);
+        if (t->shm == NULL)
+            error_handling("shm_connect() error");
+        return;
+    }
+
+    t->sock = stream_connect(ip, t->port);
+    if (t->sock == -1)
+        error_handling("connect() error");
+
+    // 小消息立即发出，不让 Nagle 算法把延迟混进结果（UNIX 域套接字没有这个选项，设置失败不影响）
+    int option = 1;
+    setsockopt(t->sock, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+}
+
+ssize_t target_write(target *t, const void *buf, size_t len)
+{
+    return t->shm != NULL ? shm_write(t->shm, buf, len) : write(t->sock, buf, len);
+}
+
+ssize_t target_read(target *t, void *buf, size_t len)
+{
+    return t->shm != NULL ? shm_read(t->shm, buf, len) : read(t->sock, buf, len);
+}
+
+uint32_t data_segs_in(int sock)
+{
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    memset(&info, 0, sizeof(info));
+    getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &len);
+    return info.tcpi_data_segs_in;
+}
+
+void run_round(target *t, int n, int msg_size)
+{
+    char msg[MAX_MSG], buf[MAX_MSG];
+    memset(msg, 'p', msg_size);
+    uint32_t segs_before = data_segs_in(t->sock);
+
+    for (int i = 0; i < n; i++)
+    {
+        double start = now_us();
+        if (target_write(t, msg, msg_size) != msg_size)
+            error_handling("write() error");
+        int got = 0;
+        while (got < msg_size)
+        {
+            int len = target_read(t, buf + got, msg_size - got);
+            if (len <= 0)
+                error_handling("read() error, server closed connection?");
+            got += len;
+        }
+        t->rtt_us[t->count++] = now_us() - start;
+    }
+    t->segs += data_segs_in(t->sock) - segs_before;
+}
+
+int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// sorted 必须已经排好序
+double percentile(const double *sorted, int count, double p)
+{
+    int idx = (int)(p * count);
+    return sorted[idx < count ? idx : count - 1];
+}
+
+void report(target *t)
+{
+    qsort(t->rtt_us, t->count, sizeof(double), cmp_double);
+    printf("port=%d samples=%d p50_us=%.1f p90_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f segs_per_msg=%.2f\n",
+           t->port, t->count,
+           percentile(t->rtt_us, t->count, 0.50), percentile(t->rtt_us, t->count, 0.90),
+           percentile(t->rtt_us, t->count, 0.99), percentile(t->rtt_us, t->count, 0.999),
+           t->rtt_us[t->count - 1], (double)t->segs / t->count);
+}
+
+double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
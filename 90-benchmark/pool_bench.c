@@ -0,0 +1,138 @@
+/**
+ * 连接池的效果：对 06-tcp-ctrl-by-application-layer/op_server 发计算请求，比较两种客户端：
+ * - connect：每个请求新建一个连接，拿到结果就关闭（早先 op_client 的做法）；
+ * - pool：从连接池（00-lib/conn_pool.h）取连接，用完放回去。
+ * 每种模式用 threads 个线程各发 requests / threads 个请求，输出 req/s，
+ * 以及跑完后指向服务端端口的 TIME_WAIT 套接字增加了多少（00-lib/proc_net.h）。
+ *
+ * TIME_WAIT 要 60 秒才消失，连续跑两次时第二次的基数里会带着第一次留下的，看增量即可。
+ *
+ * 用法：./pool_bench <server IP> <port> [requests] [threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "../00-lib/error.h"
+#include "../00-lib/conn_pool.h"
+#include "../00-lib/proc_net.h"
+
+#define OPSZ 4
+
+typedef struct
+{
+    conn_pool *pool; // 为 NULL 时每个请求新建连接
+    const char *host;
+    int port;
+    int requests;
+    int failures;
+} worker_arg;
+
+void *worker_run(void *arg);
+int do_request(int sock, int a, int b);
+void run_mode(const char *name, const char *host, int port, int requests, int nthreads, conn_pool *pool);
+double now_sec(void);
+
+int main(int argc, char *argv[])
+{
+    int requests = 20000, nthreads = 4;
+
+    if (argc < 3 || argc > 5)
+    {
+        printf("Usage: %s <server IP> <port> [requests] [threads]\n", argv[0]);
+        exit(1);
+    }
+    if (argc >= 4)
+        requests = atoi(argv[3]);
+    if (argc == 5)
+        nthreads = atoi(argv[4]);
+
+    run_mode("connect", argv[1], atoi(argv[2]), requests, nthreads, NULL);
+
+    // 池子的上限等于线程数，全部预热
+    conn_pool pool;
+    if (pool_init(&pool, argv[1], atoi(argv[2]), nthreads, nthreads, 30000) == -1)
+        error_handling("pool_init() error");
+    run_mode("pool", argv[1], atoi(argv[2]), requests, nthreads, &pool);
+    printf("pool connects=%lu reuses=%lu evictions=%lu broken=%lu\n",
+           pool.connects, pool.reuses, pool.evictions, pool.broken);
+    pool_destroy(&pool);
+    return 0;
+}
+
+void run_mode(const char *name, const char *host, int port, int requests, int nthreads, conn_pool *pool)
+{
+    pthread_t tids[nthreads];
+    worker_arg args[nthreads];
+    int tw_before = proc_net_count(port, TCP_STATE_TIME_WAIT);
+
+    double start = now_sec();
+    for (int i = 0; i < nthreads; i++)
+    {
+        args[i].pool = pool;
+        args[i].host = host;
+        args[i].port = port;
+        args[i].requests = requests / nthreads;
+        args[i].failures = 0;
+        pthread_create(&tids[i], NULL, worker_run, &args[i]);
+    }
+    int failures = 0;
+    for (int i = 0; i < nthreads; i++)
+    {
+        pthread_join(tids[i], NULL);
+        failures += args[i].failures;
+    }
+    double elapsed = now_sec() - start;
+
+    int done = requests / nthreads * nthreads;
+    printf("mode=%s requests=%d failures=%d req_per_sec=%.0f time_wait_added=%d\n",
+           name, done, failures, done / elapsed, proc_net_count(port, TCP_STATE_TIME_WAIT) - tw_before);
+}
+
+void *worker_run(void *arg)
+{
+    worker_arg *w = arg;
+    for (int i = 0; i < w->requests; i++)
+    {
+        int sock = w->pool != NULL ? pool_get(w->pool) : stream_connect(w->host, w->port);
+        if (sock == -1)
+        {
+            w->failures++;
+            continue;
+        }
+        int ok = do_request(sock, i, 1) == i + 1;
+        if (!ok)
+            w->failures++;
+        if (w->pool != NULL)
+            pool_put(w->pool, sock, ok);
+        else
+            close(sock);
+    }
+    return NULL;
+}
+
+// 发一个 a + b 的请求，返回服务端算出的结果，出错返回 -1
+int do_request(int sock, int a, int b)
+{
+    char opmsg[2 * OPSZ + 2];
+    int result;
+    opmsg[0] = 2;
+    memcpy(&opmsg[1], &a, OPSZ);
+    memcpy(&opmsg[1 + OPSZ], &b, OPSZ);
+    opmsg[2 * OPSZ + 1] = '+';
+    if (write(sock, opmsg, sizeof(opmsg)) != sizeof(opmsg))
+        return -1;
+    if (read(sock, &result, sizeof(result)) != sizeof(result))
+        return -1;
+    return result;
+}
+
+double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
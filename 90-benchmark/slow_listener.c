@@ -0,0 +1,78 @@
+/**
+ * 故意很慢的监听端，用来模拟一个过载的副本：
+ * 监听队列很短（backlog 1），启动后自己先连上几次把队列占满，之后每隔 delay 毫秒才 accept 一个连接（accept 后立即关闭）。
+ * accept 队列满时内核直接丢掉新来的 SYN，客户端的 connect 要等 SYN 重传（1 秒、3 秒……）才可能成功，
+ * 这正是阻塞 connect 最怕的情况，用来验证 00-lib/race_connect.h 能绕开慢副本：
+ *   ./slow_listener 9191 500 &
+ *   ../44-io-multiplexing-epoll/epoll_server 9190 &
+ *   ./connect_bench 127.0.0.1:9191,127.0.0.1:9190 0 20
+ *
+ * 用法：./slow_listener <port> [accept delay ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/poll.h>
+#include <fcntl.h>
+#include "../00-lib/error.h"
+
+// 最多自己占用多少个连接来填满队列
+#define MAX_FILLERS 16
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in serv_addr;
+    int delay_ms = 1000;
+    int nfillers = 0;
+
+    if (argc < 2 || argc > 3)
+    {
+        printf("Usage: %s <port> [accept delay ms]\n", argv[0]);
+        exit(1);
+    }
+    if (argc == 3)
+        delay_ms = atoi(argv[2]);
+
+    int serv_sock = socket(PF_INET, SOCK_STREAM, 0);
+    if (serv_sock == -1)
+        error_handling("socket() error");
+    int option = 1;
+    setsockopt(serv_sock, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    serv_addr.sin_port = htons(atoi(argv[1]));
+    if (bind(serv_sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
+        error_handling("bind() error");
+    if (listen(serv_sock, 1) == -1)
+        error_handling("listen error");
+
+    // 自己连自己，直到新的连接在 100ms 内完成不了，说明队列已经满了
+    serv_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    while (nfillers < MAX_FILLERS)
+    {
+        int fd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        connect(fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr));
+        struct pollfd pfd = {fd, POLLOUT, 0};
+        nfillers++; // 不关闭，一直占着队列
+        if (poll(&pfd, 1, 100) == 0)
+            break;
+    }
+    printf("accept queue filled with %d connections, accepting one every %d ms\n", nfillers, delay_ms);
+    fflush(stdout);
+
+    // 每次腾出一个位置，排队重传 SYN 的客户端里会有一个挤进来
+    while (1)
+    {
+        usleep(delay_ms * 1000);
+        int clnt_sock = accept(serv_sock, NULL, NULL);
+        if (clnt_sock != -1)
+            close(clnt_sock);
+    }
+    return 0;
+}
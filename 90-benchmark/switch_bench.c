@@ -0,0 +1,98 @@
+/**
+ * 上下文切换开销：用户态协程（00-lib/green.h） vs 内核线程。
+ * - green：一个调度线程上的两个协程轮流 green_yield，每次 yield 是 协程 -> 调度器 -> 另一个协程 两次切换，
+ *   中间还有一次就绪队列的加锁入队出队，和 green_server 里 green_read 遇到 EAGAIN 时走的路径一样；
+ * - pthread：两个线程通过一对管道互相 ping-pong（lmbench lat_ctx 的做法），
+ *   每一趟是一次 write 唤醒对方 + 一次 read 阻塞让出 CPU，也就是 thread_server.c 里阻塞 read 的路径。
+ * 两者都只报告 “交出 CPU 到对方开始运行” 一次的平均耗时。
+ * 机器有多个 CPU 时，两个线程可能在不同 CPU 上跑，测到的是跨核唤醒而不是切换，可以用 taskset -c 0 绑在一个 CPU 上。
+ *
+ * 用法：./switch_bench [iterations]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "../00-lib/error.h"
+#include "../00-lib/green.h"
+
+static long iterations = 1000000;
+static int pipes[2][2];
+static int finished;
+static double green_start;
+
+double now_ns(void);
+void *pipe_peer(void *arg);
+void yield_task(void *arg);
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2)
+    {
+        printf("Usage: %s [iterations]\n", argv[0]);
+        exit(1);
+    }
+    if (argc == 2)
+        iterations = atol(argv[1]);
+
+    // 内核线程：主线程和 peer 线程通过两个管道来回传一个字节
+    if (pipe(pipes[0]) == -1 || pipe(pipes[1]) == -1)
+        error_handling("pipe() error");
+    pthread_t tid;
+    pthread_create(&tid, NULL, pipe_peer, NULL);
+    char c = 0;
+    double start = now_ns();
+    for (long i = 0; i < iterations; i++)
+    {
+        write(pipes[0][1], &c, 1);
+        read(pipes[1][0], &c, 1);
+    }
+    double elapsed = now_ns() - start;
+    pthread_join(tid, NULL);
+    // 每一趟有两次切换
+    printf("pthread switch_ns=%.1f\n", elapsed / iterations / 2);
+
+    // 协程：只用一个调度线程，排除跨核的影响
+    green_init(1);
+    green_spawn(yield_task, NULL);
+    green_spawn(yield_task, NULL);
+    green_start = now_ns();
+    green_run();
+    return 0;
+}
+
+void *pipe_peer(void *arg)
+{
+    (void)arg;
+    char c;
+    for (long i = 0; i < iterations; i++)
+    {
+        read(pipes[0][0], &c, 1);
+        write(pipes[1][1], &c, 1);
+    }
+    return NULL;
+}
+
+void yield_task(void *arg)
+{
+    (void)arg;
+    for (long i = 0; i < iterations; i++)
+        green_yield();
+    // 两个协程都跑完才算结束
+    if (__atomic_add_fetch(&finished, 1, __ATOMIC_RELAXED) == 2)
+    {
+        double elapsed = now_ns() - green_start;
+        printf("green switch_ns=%.1f switches=%lu\n", elapsed / (iterations * 2), green_switch_count());
+        exit(0);
+    }
+}
+
+double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}